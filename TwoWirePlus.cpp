@@ -19,23 +19,87 @@
  * is that data will be send in background already while application is on providing more data.
  * Positive side-effect is that size of buffer can be reduced.
  *
+ * In addition, device can act as two wire slave exposing a register file to a two wire
+ * master (see #TwoWirePlus::beginSlave). Register file is read and written directly in ISR.
+ * Alternatively, frames written by the master are received into rx ring buffer and processed
+ * later by application calling #TwoWirePlus::poll. Replies are sent from a pre-staged buffer.
+ * While being slave, master transactions can be queued (see #TwoWirePlus::queue). They are
+ * started as soon as the bus is free and restarted if arbitration was lost, e.g. because
+ * another master addressed this device. Complete device interactions, e.g. start conversion,
+ * poll status and read result, can be executed by a micro-sequencer in ISR without any
+ * involvement of the application (see #TwoWirePlus::run).
+ *
  * Every function which request a specific bus state (START, RE-START, STOP) is blocking
- * and can therefore be used to sync application with two wire bus.
+ * and can therefore be used to sync application with two wire bus. While blocking, the
+ * wait function of the current waiter (see #TwoWirePlus::setWaiter) is called and
+ * ISR(TWI_vect) calls its notify function. By default CPU is put into idle sleep mode which
+ * keeps two wire interface running and TWI interrupt will wake it up again. Other waiters
+ * allow to spin or to hand over CPU to other tasks of an RTOS or cooperative scheduler.
  *
  * @todo
  * - Complete error handling
  * - Timeout handling
  * - Think about where to add interrupt locking
  * - Add "whait until STOP was send to endX
- * - Add two wire slave functionality
  */
 
 /*******************| Inclusions |*************************************/
 #include "TwoWirePlus.h"
 #include <Arduino.h>
 #include <compat/twi.h>
+#include <avr/sleep.h>
+#include <avr/pgmspace.h>
+#include <string.h>
 
 /*******************| Macros |*****************************************/
+/**
+ * Phases of a queued transaction
+ */
+#define TWOWIREPLUS_PHASE_WRITE                0
+#define TWOWIREPLUS_PHASE_READ                 1
+#define TWOWIREPLUS_PHASE_WRITEBACK            2
+
+/**
+ * Blocks as long as #condition is true. Condition is evaluated with interrupts disabled
+ * and the wait hook is called without enabling them again. Thus, no TWI interrupt can
+ * be lost between evaluating the condition and going to sleep.
+ */
+#define TwoWirePlus_waitWhile(condition)       \
+  for (;;)                                     \
+  {                                            \
+    cli();                                     \
+    if (!(condition))                          \
+    {                                          \
+      sei();                                   \
+      break;                                   \
+    }                                          \
+    TwoWirePlus_waiter->wait();                \
+  }
+
+/**
+ * Requests START. In case STOP is still pending START is sent after STOP.
+ */
+#define TwoWirePlus_requestStart()             \
+  TWCR = (TWCR & _BV(TWSTO)) ? TWOWIREPLUS_TWCR_STOP_START : TWOWIREPLUS_TWCR_START
+
+/**
+ * True if TWINT was set by hardware but ISR did not run yet, e.g. own SLA arrived while interrupts
+ * are disabled. TWCR must not be written outside of ISR then, writing TWINT would drop the event.
+ * TWINT is never set while a STOP is pending.
+ */
+#define TwoWirePlus_eventPending()             ((TWCR & (_BV(TWINT) | _BV(TWSTO))) == _BV(TWINT))
+
+/**
+ * First address byte of queued master transaction. For 10bit addresses, the upper two
+ * address bits are sent in the first byte.
+ */
+#define TwoWirePlus_sla(address, direction)    \
+  (((address) & TWOWIREPLUS_ADDRESS_10BIT_FLAG) ? (uint8_t)(0xf0 | (((address) >> 7) & 0x06) | (direction)) : (uint8_t)(((address) << 1) | (direction)))
+
+/**
+ * Number of checksum bytes appended or checked for TWOWIREPLUS_CRC_xxx
+ */
+#define TwoWirePlus_crcLength(mode)            ((mode == TWOWIREPLUS_CRC_16) ? 2 : ((mode == TWOWIREPLUS_CRC_PEC) ? 1 : 0))
 
 /*******************| Type definitions |*******************************/
 
@@ -47,9 +111,243 @@ static TwoWirePlus_Status_t TwoWirePlus_status = 0x0;
 /**
  * Number of bytes requested to be received via two wire interface. In case
  * this variable hits one (1) NACK will be sent to two wire slave device for
- * the last byte.
+ * the last byte. Variable is wider than one byte, thus, accessing it outside
+ * of ISR must be done with interrupts disabled.
+ */
+static volatile TwoWirePlus_ByteCount_t TwoWirePlus_bytesToReceive = 0;
+
+/**
+ * True if reception was paused because rxRingBuffer is full. In this case TWINT is left
+ * set, thus SCL is held low by the two wire module (clock stretching) until #TwoWirePlus::read
+ * made space in the buffer again.
+ */
+static volatile bool TwoWirePlus_rxStalled = false;
+
+/**
+ * Point in time (micros) when the current clock stretching started
+ */
+static unsigned long TwoWirePlus_rxStallStart = 0;
+
+/**
+ * Accumulated time in microseconds SCL was held low because rxRingBuffer was full
+ */
+static uint32_t TwoWirePlus_rxStallTime = 0;
+
+/**
+ * Transmit source generating bytes in ISR without txRingBuffer: generator of
+ * #TwoWirePlus::stream, data in PROGMEM written by #TwoWirePlus::write_P or, if pointer is
+ * NULL, #TwoWirePlus_txFillData repeated by #TwoWirePlus::fill. Bytes are written by ISR
+ * directly into TWDR and are sent before any byte in txRingBuffer. Length is the number of
+ * bytes not sent yet and is only accessed by ISR once transfer started, main context uses
+ * #TwoWirePlus_txSourceActive.
+ */
+static TwoWirePlus_GeneratorCallback_t TwoWirePlus_txGenerator = NULL;
+static const uint8_t *TwoWirePlus_txSource = NULL;
+static uint8_t TwoWirePlus_txFillData = 0;
+static TwoWirePlus_ByteCount_t TwoWirePlus_txSourceLength = 0;
+static volatile bool TwoWirePlus_txSourceActive = false;
+
+/**
+ * Staging window filled by #TwoWirePlus_txGenerator
+ */
+static uint8_t TwoWirePlus_txWindow[TWOWIREPLUS_TXWINDOW_SIZE];
+static uint8_t TwoWirePlus_txWindowIndex = 0;
+static uint8_t TwoWirePlus_txWindowLength = 0;
+
+/**
+ * Consumer of bytes received as master and number of bytes in rxRingBuffer it is called at
+ */
+static TwoWirePlus_ConsumerCallback_t TwoWirePlus_rxConsumer = NULL;
+static uint8_t TwoWirePlus_rxWatermark = 0;
+
+/**
+ * Double buffered reception. ISR fills buffer #TwoWirePlus_pingPongFill, a completely filled
+ * buffer is flagged in #TwoWirePlus_pingPongReady (bit 0 or 1) until application released it.
+ */
+static uint8_t *TwoWirePlus_pingPong[2] = {NULL, NULL};
+static uint8_t TwoWirePlus_pingPongLength = 0;
+static uint8_t TwoWirePlus_pingPongIndex = 0;
+static uint8_t TwoWirePlus_pingPongFill = 0;
+static volatile uint8_t TwoWirePlus_pingPongReady = 0;
+static uint8_t TwoWirePlus_pingPongOverruns = 0;
+
+/** Busy waiting, no notification needed */
+const TwoWirePlus_Waiter_t TwoWirePlus_spinWaiter = { TwoWirePlus_spinWait, NULL };
+/** Idle sleep, CPU is woken up by any interrupt */
+const TwoWirePlus_Waiter_t TwoWirePlus_idleSleepWaiter = { TwoWirePlus_idleSleep, NULL };
+/** Idle sleep until semaphore is given by ISR(TWI_vect) */
+const TwoWirePlus_Waiter_t TwoWirePlus_semaphoreWaiter = { TwoWirePlus_semaphoreWait, TwoWirePlus_semaphoreNotify };
+
+/**
+ * Wait/notify functions used whenever a blocking function has to wait for the two wire interface
+ */
+static const TwoWirePlus_Waiter_t *TwoWirePlus_waiter = &TwoWirePlus_idleSleepWaiter;
+
+/**
+ * Waiter installed by #TwoWirePlus::setWaitHook
+ */
+static TwoWirePlus_Waiter_t TwoWirePlus_hookWaiter = { NULL, NULL };
+
+/**
+ * Register file exposed to two wire master while running as slave. ISR reads and writes
+ * it directly, thus no copy is needed.
+ */
+static volatile uint8_t *TwoWirePlus_slaveRegisters = NULL;
+
+/**
+ * Size of register file exposed to two wire master
+ */
+static uint16_t TwoWirePlus_slaveRegisterSize = 0;
+
+/**
+ * Register pointer for slave access. It's set by first byte written by two wire master and
+ * incremented after each byte read or written.
+ */
+static volatile uint16_t TwoWirePlus_slaveRegisterPointer = 0;
+
+/**
+ * True if next byte received as slave is the register pointer
+ */
+static bool TwoWirePlus_slaveExpectPointer = false;
+
+/**
+ * Events for frames received as slave if no register file is used
+ */
+static TwoWirePlus_EventQueue_t TwoWirePlus_slaveEvents;
+
+/**
+ * Number of bytes of the frame currently received as slave
+ */
+static uint8_t TwoWirePlus_slaveFrameLength = 0;
+
+/**
+ * Number of bytes not accepted (NACKed) as slave because rx ring buffer or event queue was full
+ */
+static uint8_t TwoWirePlus_slaveOverruns = 0;
+
+/**
+ * Pre-staged reply sent when addressed as slave transmitter if no register file is used
+ */
+static const uint8_t *TwoWirePlus_slaveReply = NULL;
+static uint8_t TwoWirePlus_slaveReplyLength = 0;
+
+/**
+ * Callbacks for slave frame processing
+ */
+static TwoWirePlus_ReceiveCallback_t TwoWirePlus_receiveCallback = NULL;
+static TwoWirePlus_RequestCallback_t TwoWirePlus_requestCallback = NULL;
+
+/**
+ * Bytes of current frame left to the receive callback. While #TwoWirePlus_frameActive is set,
+ * application can't read beyond the frame passed to the callback.
+ */
+static uint8_t TwoWirePlus_frameRemaining = 0;
+static bool TwoWirePlus_frameActive = false;
+
+/**
+ * True while addressed as slave, i.e. between own SLA and end of slave transfer
+ */
+static volatile bool TwoWirePlus_slaveActive = false;
+
+/**
+ * START of first queued transaction is requested by ISR(TWI_vect) after it processed the pending
+ * TWI event, see #TwoWirePlus_eventPending
+ */
+static volatile bool TwoWirePlus_startPending = false;
+
+/**
+ * Queue of master transactions. Head is the transaction currently processed by ISR.
+ */
+static TwoWirePlus_Transaction_t * volatile TwoWirePlus_transaction = NULL;
+static TwoWirePlus_Transaction_t *TwoWirePlus_transactionTail = NULL;
+
+/**
+ * Part of current transaction being processed, see TWOWIREPLUS_PHASE_xxx
+ */
+static uint8_t TwoWirePlus_transactionPhase = TWOWIREPLUS_PHASE_WRITE;
+
+/**
+ * True if lower byte of 10bit address has to be sent after SLA+W was acknowledged
+ */
+static bool TwoWirePlus_address10Pending = false;
+
+/**
+ * Number of times arbitration was lost while processing queued transactions
+ */
+static uint8_t TwoWirePlus_arbitrationLosses = 0;
+
+/**
+ * Presence of devices addressed so far, updated by ISR
+ */
+static TwoWirePlus_Device_t TwoWirePlus_devices[TWOWIREPLUS_DEVICETABLE_SIZE];
+
+/**
+ * Address only transaction used by #TwoWirePlus::revalidate
+ */
+static TwoWirePlus_Transaction_t TwoWirePlus_probe = {0, NULL, 0, NULL, 0, TWOWIREPLUS_TRANSACTION_DONE};
+
+/**
+ * Register writes merged into one auto-increment burst by #TwoWirePlus::writeRegisters. Each burst
+ * owns its transaction and buffer, a burst is free once its transaction left the queue. Burst
+ * #TwoWirePlus_coalesceIndex is collected while #TwoWirePlus_coalescePending is set and queued by
+ * #TwoWirePlus_tick after #TwoWirePlus_coalesceTicks ticks at the latest.
+ */
+static TwoWirePlus_Transaction_t TwoWirePlus_coalesce[TWOWIREPLUS_COALESCE_BURSTS];
+static uint8_t TwoWirePlus_coalesceBuffer[TWOWIREPLUS_COALESCE_BURSTS][1 + TWOWIREPLUS_COALESCE_SIZE];
+static uint8_t TwoWirePlus_coalesceIndex = 0;
+static uint8_t TwoWirePlus_coalesceTicks = 0;
+static uint8_t TwoWirePlus_coalesceDeadline = 0;
+static volatile bool TwoWirePlus_coalescePending = false;
+
+/**
+ * Channel mask selected at each multiplexer, 0xff if not known. Multiplexers deselect all
+ * channels at power-on. Index and mask of multiplexer written by #TwoWirePlus_selectMux.
+ */
+static uint8_t TwoWirePlus_muxSelected[TWOWIREPLUS_MUX_COUNT] = {0, 0, 0, 0, 0, 0, 0, 0};
+static uint8_t TwoWirePlus_muxIndex = 0;
+static uint8_t TwoWirePlus_muxMask = 0;
+
+/**
+ * Micro-sequencer: Slot and number of bytes left of current READ instruction. Count is also
+ * used for bytes already written by current WRITE_BYTES instruction.
+ */
+static uint8_t TwoWirePlus_scriptSlot = 0;
+static uint8_t TwoWirePlus_scriptCount = 0;
+
+/**
+ * Micro-sequencer: Scripts waiting in a DELAY instruction. They left the queue and are
+ * queued again by #TwoWirePlus_tick once their delay elapsed.
+ */
+static TwoWirePlus_Transaction_t *TwoWirePlus_delayed = NULL;
+
+/**
+ * Last address probed by bus scan. Only one scan is on-going at a time as #TwoWirePlus::scan
+ * is blocking.
  */
-static volatile uint8_t TwoWirePlus_bytesToReceive = 0;
+static uint8_t TwoWirePlus_scanLast = 0;
+
+/**
+ * Binary semaphore given by ISR(TWI_vect) and taken by #TwoWirePlus_semaphoreWait
+ */
+static volatile bool TwoWirePlus_semaphore = false;
+
+/*******************| Function prototypes |****************************/
+static void TwoWirePlus_requestNextByte(void);
+static void TwoWirePlus_startSource(TwoWirePlus_GeneratorCallback_t generator, const uint8_t *data, uint8_t fillData, TwoWirePlus_ByteCount_t length);
+static bool TwoWirePlus_txSourceAvailable(void);
+static uint8_t TwoWirePlus_txSourceByte(void);
+static void TwoWirePlus_consumeRx(void);
+static void TwoWirePlus_storePingPong(uint8_t data);
+static void TwoWirePlus_enableSlave(uint8_t address);
+static void TwoWirePlus_processTransaction(uint8_t status);
+static void TwoWirePlus_processScan(uint8_t status);
+static bool TwoWirePlus_selectMux(uint8_t status);
+static void TwoWirePlus_updateDevice(uint8_t address, bool ack);
+static TwoWirePlus_Device_t *TwoWirePlus_findDevice(uint8_t address);
+static void TwoWirePlus_executeScript(void);
+static void TwoWirePlus_enqueue(TwoWirePlus_Transaction_t *transaction);
+static void TwoWirePlus_queueBurst(void);
+static void TwoWirePlus_crcAdd(TwoWirePlus_Transaction_t *transaction, uint8_t data);
 
 /*******************| Function Definition |****************************/
 
@@ -78,6 +376,12 @@ TwoWirePlus::TwoWirePlus(void)
   TwoWirePlus_txRingBuffer.head = 0;
   TwoWirePlus_txRingBuffer.tail = 0;
   TwoWirePlus_txRingBuffer.lastOperation = TWOWIREPLUS_LASTOPERATION_READ; /* Buffer is empty on start-up */
+
+  /* All bursts of merged writes are free */
+  for (uint8_t i=0; i<TWOWIREPLUS_COALESCE_BURSTS; i++)
+  {
+    TwoWirePlus_coalesce[i].state = TWOWIREPLUS_TRANSACTION_DONE;
+  }
   
   /* Activate internal pullups for twi lines */
   digitalWrite(SDA, 1);
@@ -109,7 +413,7 @@ void TwoWirePlus::beginTransmission(uint8_t address)
   address = (address << 1) | TW_WRITE;
 
   /* wait until all previous communication has finished */
-  while ( ! TwoWirePlus_RingBufferEmpty(TwoWirePlus_txRingBuffer) ) ;
+  TwoWirePlus_waitWhile( ! TwoWirePlus_RingBufferEmpty(TwoWirePlus_txRingBuffer) || TwoWirePlus_txSourceActive );
   
   /* Unfortunately, we can't use write function here because TWDR register can't be pre-loaded */  
   /* Place data in buffer */
@@ -132,7 +436,7 @@ void TwoWirePlus::beginTransmission(uint8_t address)
 void TwoWirePlus::write(const uint8_t data)
 {
   /* In case buffer is empty (i.e. first byte to write), copy data directly to TWDR and ask for sent */
-  if ( TwoWirePlus_RingBufferEmpty(TwoWirePlus_txRingBuffer) )
+  if ( TwoWirePlus_RingBufferEmpty(TwoWirePlus_txRingBuffer) && !TwoWirePlus_txSourceActive )
   {
     /* need to increment first as the interrupt could happen directly after writing TWDR */
     TwoWirePlus_txRingBuffer.lastOperation = TWOWIREPLUS_LASTOPERATION_WRITE;
@@ -143,7 +447,7 @@ void TwoWirePlus::write(const uint8_t data)
   /* if not empty use buffer */
   else {
     /* wait in case no space left in buffer */
-    while( TwoWirePlus_RingBufferFull(TwoWirePlus_txRingBuffer) ) ;
+    TwoWirePlus_waitWhile( TwoWirePlus_RingBufferFull(TwoWirePlus_txRingBuffer) );
     /* Place data in buffer */
     TwoWirePlus_txRingBuffer.buffer[TwoWirePlus_txRingBuffer.head] = data;
     TwoWirePlus_txRingBuffer.lastOperation = TWOWIREPLUS_LASTOPERATION_WRITE;
@@ -151,6 +455,158 @@ void TwoWirePlus::write(const uint8_t data)
   }
 }
 
+/**
+ * Returns largest contiguous free region of tx ring buffer. Bytes can be encoded in place and
+ * are sent after #commit. Region ends at the end of the ring buffer, thus, call again after
+ * #commit to get space wrapped around.
+ * @param data Set to first free byte
+ * @return Number of bytes in region, zero if buffer is full
+ * @pre #beginTransmission was called
+ */
+uint8_t TwoWirePlus::reserveSpan(uint8_t **data)
+{
+  /* Tail can be altered in ISR at any time, free space only grows meanwhile */
+  uint8_t tail = TwoWirePlus_txRingBuffer.tail;
+  uint8_t head = TwoWirePlus_txRingBuffer.head;
+  *data = &TwoWirePlus_txRingBuffer.buffer[head];
+  if (TwoWirePlus_RingBufferFull(TwoWirePlus_txRingBuffer))
+  {
+    return 0;
+  }
+  if ((head < tail) && !TwoWirePlus_RingBufferEmpty(TwoWirePlus_txRingBuffer))
+  {
+    return tail - head;
+  }
+  return TWOWIREPLUS_RINGBUFFER_SIZE - head;
+}
+
+/**
+ * Hands #count bytes of region returned by #reserveSpan over to be sent. If nothing is
+ * currently sent, first byte is written to TWDR.
+ * @param count Number of bytes, must not exceed length returned by #reserveSpan
+ */
+void TwoWirePlus::commit(uint8_t count)
+{
+  if (count == 0)
+  {
+    return;
+  }
+  /* ISR must not empty buffer between check and update of head */
+  uint8_t sreg = SREG;
+  cli();
+  bool idle = TwoWirePlus_RingBufferEmpty(TwoWirePlus_txRingBuffer) && !TwoWirePlus_txSourceActive;
+  TwoWirePlus_txRingBuffer.head = (uint8_t)(TwoWirePlus_txRingBuffer.head + count) % TWOWIREPLUS_RINGBUFFER_SIZE;
+  TwoWirePlus_txRingBuffer.lastOperation = TWOWIREPLUS_LASTOPERATION_WRITE;
+  if (idle)
+  {
+    TWDR = TwoWirePlus_txRingBuffer.buffer[TwoWirePlus_txRingBuffer.tail];
+    TWCR = TWOWIREPLUS_TWCR_SEND;
+  }
+  SREG = sreg;
+}
+
+/**
+ * Write #length bytes stored in flash (PROGMEM), e.g. fonts, bitmaps or command tables. Bytes
+ * are not copied to tx ringbuffer but read by ISR directly into TWDR. Bytes written with
+ * #write afterwards are sent after the last byte from flash.
+ * @note This function is blocking until all bytes written before were sent. It returns as soon
+ * as the first byte from flash is sent. Do not call in interrupt context.
+ * @param data Address of data in PROGMEM. Data must stay valid until #endTransmission.
+ * @param length Number of bytes to write
+ * @pre #beginTransmission was called
+ */
+void TwoWirePlus::write_P(const uint8_t *data, TwoWirePlus_ByteCount_t length)
+{
+  TwoWirePlus_startSource(NULL, data, 0, length);
+}
+
+/**
+ * Write #data #count times, e.g. to clear a display framebuffer or an EEPROM page. Bytes are
+ * generated by ISR, thus, no buffer is needed and main context does no per-byte work. Bytes
+ * written with #write afterwards are sent after the last repeated byte.
+ * @note This function is blocking until all bytes written before were sent. It returns as soon
+ * as the first byte is sent. Do not call in interrupt context.
+ * @param data Byte to write
+ * @param count Number of times #data is written
+ * @pre #beginTransmission was called
+ */
+void TwoWirePlus::fill(uint8_t data, TwoWirePlus_ByteCount_t count)
+{
+  TwoWirePlus_startSource(NULL, NULL, data, count);
+}
+
+/**
+ * Write bytes produced by #generator, e.g. a protocol encoder or decompressor. ISR requests up
+ * to #TWOWIREPLUS_TXWINDOW_SIZE bytes at once whenever all bytes of the last request were sent,
+ * thus, transfers of arbitrary length run at full bus rate with constant memory. Bytes written
+ * with #write afterwards are sent after the stream ended.
+ * @note This function is blocking until all bytes written before were sent. Do not call in
+ * interrupt context.
+ * @param generator Function called in interrupt context. Stream ends when it returns zero.
+ * @pre #beginTransmission was called
+ */
+void TwoWirePlus::stream(TwoWirePlus_GeneratorCallback_t generator)
+{
+  TwoWirePlus_startSource(generator, NULL, 0, 0);
+}
+
+/**
+ * Starts sending bytes from transmit source
+ * @param generator Generator or NULL if bytes are taken from #data
+ * @param data Data in PROGMEM or NULL to repeat #fillData
+ * @param fillData Byte to repeat if #data is NULL
+ * @param length Number of bytes to send if no #generator is used
+ */
+static void TwoWirePlus_startSource(TwoWirePlus_GeneratorCallback_t generator, const uint8_t *data, uint8_t fillData, TwoWirePlus_ByteCount_t length)
+{
+  /* Source can only be started when bus is stretched waiting for the next byte */
+  TwoWirePlus_waitWhile( ! TwoWirePlus_RingBufferEmpty(TwoWirePlus_txRingBuffer) || TwoWirePlus_txSourceActive );
+  TwoWirePlus_txGenerator = generator;
+  TwoWirePlus_txWindowIndex = 0;
+  TwoWirePlus_txWindowLength = 0;
+  TwoWirePlus_txSource = data;
+  TwoWirePlus_txFillData = fillData;
+  TwoWirePlus_txSourceLength = length;
+  if (TwoWirePlus_txSourceAvailable())
+  {
+    TwoWirePlus_txSourceActive = true;
+    TWDR = TwoWirePlus_txSourceByte();
+    TWCR = TWOWIREPLUS_TWCR_SEND;
+  }
+}
+
+/**
+ * Checks whether transmit source has another byte. Generator is asked for more bytes if
+ * staging window was completely sent.
+ */
+static bool TwoWirePlus_txSourceAvailable(void)
+{
+  if (TwoWirePlus_txGenerator != NULL)
+  {
+    if (TwoWirePlus_txWindowIndex >= TwoWirePlus_txWindowLength)
+    {
+      TwoWirePlus_txWindowIndex = 0;
+      TwoWirePlus_txWindowLength = TwoWirePlus_txGenerator(TwoWirePlus_txWindow, TWOWIREPLUS_TXWINDOW_SIZE);
+    }
+    return (TwoWirePlus_txWindowLength != 0);
+  }
+  return (TwoWirePlus_txSourceLength != 0);
+}
+
+/**
+ * Next byte of transmit source
+ * @pre #TwoWirePlus_txSourceAvailable returned true
+ */
+static uint8_t TwoWirePlus_txSourceByte(void)
+{
+  if (TwoWirePlus_txGenerator != NULL)
+  {
+    return TwoWirePlus_txWindow[TwoWirePlus_txWindowIndex++];
+  }
+  TwoWirePlus_txSourceLength--;
+  return (TwoWirePlus_txSource != NULL) ? pgm_read_byte(TwoWirePlus_txSource++) : TwoWirePlus_txFillData;
+}
+
 /**
  * End two wire transmission by requesting to send a stop after buffer was completely
  * transmitted.
@@ -161,14 +617,14 @@ void TwoWirePlus::write(const uint8_t data)
 TwoWirePlus_Status_t TwoWirePlus::endTransmission()
 {
   /* block until last byte was transferred (or better ACK for last byte was received */
-  while(!TwoWirePlus_RingBufferEmpty(TwoWirePlus_txRingBuffer) ) ;
+  TwoWirePlus_waitWhile( !TwoWirePlus_RingBufferEmpty(TwoWirePlus_txRingBuffer) || TwoWirePlus_txSourceActive );
   /* Then request STOP */
   TWCR = TWOWIREPLUS_TWCR_STOP;
 
   /* Problem: TWINT is not set after a stop condition. Thus, we wait for STOP bit is cleared
    * in TWCR.
    */
-  while(TWCR & _BV(TWSTO)) ;
+  TwoWirePlus_waitWhile(TWCR & _BV(TWSTO));
 
   return TwoWirePlus_status;
 }
@@ -188,7 +644,7 @@ void TwoWirePlus::beginReception(uint8_t address)
   address = (address << 1) | TW_READ;
 
   /* wait until all previous communication (rx and tx) has finished */
-  while ( ! TwoWirePlus_RingBufferEmpty(TwoWirePlus_txRingBuffer)) ;
+  TwoWirePlus_waitWhile( ! TwoWirePlus_RingBufferEmpty(TwoWirePlus_txRingBuffer) );
   
   /* Unfortunately, we can't use write function here because TWDR register can't be pre-loaded */  
   /* Place data in buffer */
@@ -209,15 +665,25 @@ void TwoWirePlus::beginReception(uint8_t address)
  * library. In contrast to the original function, this function will always sent
  * start. 
  * @note This function is blocking. Don't call in interrupt context.
- * @return Number of bytes received
+ * @note Reception is paused as long as the rx ring buffer is full, thus, #numberOfBytes above
+ * free space of rx ring buffer, i.e. #TWOWIREPLUS_RINGBUFFER_SIZE minus bytes not read yet, is
+ * rejected. Use #beginReception, #requestBytes, #read and #endReception to stream more bytes.
+ * @return Number of bytes received, zero if #numberOfBytes exceeds free space of rx ring buffer
  */
-uint8_t TwoWirePlus::requestFrom(uint8_t address, uint8_t numberOfBytes)
+uint8_t TwoWirePlus::requestFrom(uint8_t address, TwoWirePlus_ByteCount_t numberOfBytes)
 {
+  uint8_t unread = available();
+  bool requested;
+
+  if (numberOfBytes > (TwoWirePlus_ByteCount_t)(TWOWIREPLUS_RINGBUFFER_SIZE - unread))
+  {
+    return 0;
+  }
   beginReception(address);
   /* bytesToReceive shall only be increased after call to beginReception to make sure all Tx is completed */
-  TwoWirePlus_bytesToReceive += numberOfBytes;
+  requested = requestBytes(numberOfBytes);
   endReception();
-  return available();
+  return requested ? (uint8_t)(available() - unread) : 0;
 }
 
 /**
@@ -228,11 +694,23 @@ uint8_t TwoWirePlus::requestFrom(uint8_t address, uint8_t numberOfBytes)
  * to receive a NACK will be sent for the last byte. Therfore make sure that #bytesToReceive always is
  * greater than one.
  * @param numberOfBytes Number of bytes to receive from two wire slave device
+ * @return true if bytes were requested, false if total number of bytes to receive would exceed
+ * #TWOWIREPLUS_BYTECOUNT_MAX. In this case nothing is requested.
  * @pre #beginReception must have been called first
  */
-void TwoWirePlus::requestBytes(uint8_t numberOfBytes)
+bool TwoWirePlus::requestBytes(TwoWirePlus_ByteCount_t numberOfBytes)
 {
-  TwoWirePlus_bytesToReceive += numberOfBytes;
+  bool retVal = false;
+  /* ISR decrements bytesToReceive, thus read-modify-write must not be interrupted */
+  uint8_t sreg = SREG;
+  cli();
+  if (numberOfBytes <= (TWOWIREPLUS_BYTECOUNT_MAX - TwoWirePlus_bytesToReceive))
+  {
+    TwoWirePlus_bytesToReceive += numberOfBytes;
+    retVal = true;
+  }
+  SREG = sreg;
+  return retVal;
 }
 
 /**
@@ -243,155 +721,1828 @@ uint8_t TwoWirePlus::available()
 {
   /* Head can be altered in ISR at any time. Therefore we create a local copy */
   volatile uint8_t head = TwoWirePlus_rxRingBuffer.head;
-  /* Cast to uint8_t is important here because if not compiler will chose sint8_t */
-  return (uint8_t)(head - TwoWirePlus_rxRingBuffer.tail) % TWOWIREPLUS_RINGBUFFER_SIZE;
+  uint8_t count;
+  /* A full buffer can't be distinguished from an empty one by head and tail only. This
+   * happens whenever reception was paused because buffer is full */
+  if (TwoWirePlus_RingBufferFull(TwoWirePlus_rxRingBuffer))
+  {
+    count = TWOWIREPLUS_RINGBUFFER_SIZE;
+  }
+  else
+  {
+    /* Cast to uint8_t is important here because if not compiler will chose sint8_t */
+    count = (uint8_t)(head - TwoWirePlus_rxRingBuffer.tail) % TWOWIREPLUS_RINGBUFFER_SIZE;
+  }
+  /* Receive callback only sees its own frame */
+  if (TwoWirePlus_frameActive && (count > TwoWirePlus_frameRemaining))
+  {
+    count = TwoWirePlus_frameRemaining;
+  }
+  return count;
 }
 
 /**
  * Returns one byte, if any, from rx ring buffer. If no bytes is present 0x00 will be 
  * returned. #available shall be used before calling this function to check if a byte
- * was received. 
+ * was received. If reception was paused because rx ring buffer was full, reception
+ * will be continued.
  * @return Next byte from rx ring buffer or 0x00 if no byte was in buffer
  * @pre #available was called to check if a byte is present in the buffer
  */
 uint8_t TwoWirePlus::read( )
 {
   uint8_t retVal = 0x00;
-  if(! TwoWirePlus_RingBufferEmpty(TwoWirePlus_rxRingBuffer) )
+  if(! TwoWirePlus_RingBufferEmpty(TwoWirePlus_rxRingBuffer) && ! (TwoWirePlus_frameActive && (TwoWirePlus_frameRemaining == 0)) )
   {
     retVal = TwoWirePlus_rxRingBuffer.buffer[TwoWirePlus_rxRingBuffer.tail];
-    TwoWirePlus_rxRingBuffer.lastOperation = TWOWIREPLUS_LASTOPERATION_READ;
-    TwoWirePlus_incrementIndex(TwoWirePlus_rxRingBuffer.tail);
+    consume(1);
   }
   return retVal;
 }
 
+/**
+ * Returns largest contiguous region of received bytes in rx ring buffer. Bytes can be
+ * processed in place and are released with #consume. Region ends at the end of the ring
+ * buffer, thus, call again after #consume to get bytes wrapped around.
+ * @param data Set to first received byte
+ * @return Number of bytes in region, zero if no byte was received
+ */
+uint8_t TwoWirePlus::peekSpan(const uint8_t **data)
+{
+  uint8_t count = available();
+  uint8_t length = TWOWIREPLUS_RINGBUFFER_SIZE - TwoWirePlus_rxRingBuffer.tail;
+  *data = &TwoWirePlus_rxRingBuffer.buffer[TwoWirePlus_rxRingBuffer.tail];
+  return (count < length) ? count : length;
+}
+
+/**
+ * Releases #count bytes of rx ring buffer, e.g. after processing region of #peekSpan. If
+ * reception was paused because rx ring buffer was full, reception will be continued.
+ * @param count Number of bytes to release, must not exceed #available. Receive callback
+ * can't release bytes beyond its frame.
+ */
+void TwoWirePlus::consume(uint8_t count)
+{
+  if (TwoWirePlus_frameActive)
+  {
+    if (count > TwoWirePlus_frameRemaining)
+    {
+      count = TwoWirePlus_frameRemaining;
+    }
+    TwoWirePlus_frameRemaining -= count;
+  }
+  if (count == 0)
+  {
+    return;
+  }
+  TwoWirePlus_rxRingBuffer.lastOperation = TWOWIREPLUS_LASTOPERATION_READ;
+  TwoWirePlus_rxRingBuffer.tail = (uint8_t)(TwoWirePlus_rxRingBuffer.tail + count) % TWOWIREPLUS_RINGBUFFER_SIZE;
+  /* There is space in the buffer again, thus release SCL if reception was paused. No
+   * locking needed because TWI interrupt is disabled as long as reception is paused */
+  if (TwoWirePlus_rxStalled)
+  {
+    TwoWirePlus_rxStallTime += micros() - TwoWirePlus_rxStallStart;
+    TwoWirePlus_rxStalled = false;
+    TwoWirePlus_requestNextByte();
+  }
+}
 
+/**
+ * Ends reception by requesting STOP after all requested bytes were received.
+ * @note This function is blocking. Because reception is paused while rx ring buffer is full,
+ * all bytes exceeding #TWOWIREPLUS_RINGBUFFER_SIZE must be read by application before calling
+ * this function.
+ */
 void TwoWirePlus::endReception()
 {
   /* Wait until data is completely (or NACK) received */
-  while (TwoWirePlus_bytesToReceive) ;
+  TwoWirePlus_waitWhile(TwoWirePlus_bytesToReceive);
   /* Then request STOP */
   TWCR = TWOWIREPLUS_TWCR_STOP;
   /* Problem: TWINT is not set after a stop condition. Thus, we wait for STOP bit is cleared
    * in TWCR.
    */
-  while(TWCR & _BV(TWSTO)) ;
+  TwoWirePlus_waitWhile(TWCR & _BV(TWSTO));
 }
 
 /**
- * Returns number of bytes requested to be received via two wire interface. In case of NACK received
- * return value will be 0 and two wire status must be checked in addition.
- * @return Number of bytes still requested to be received by two wire interface or zero if NACK was
- * received from two wire slave device (status equals to TwoWirePlus_MasterReceiver_NACK).
+ * Sets consumer processing bytes received as master while transfer is still running, e.g.
+ * parsing FIFO records. Consumer is called in interrupt context as soon as #watermark bytes
+ * are in rxRingBuffer or the last byte requested was received. Data is passed without copy,
+ * a wrap-around of rxRingBuffer results in two calls. Thus, use a #watermark dividing
+ * #TWOWIREPLUS_RINGBUFFER_SIZE to always get complete records in one call. Bytes passed are
+ * consumed, i.e. they are not available to #read.
+ * @param callback Consumer or NULL to keep bytes in rxRingBuffer for #read
+ * @param watermark Number of bytes consumer is called with, 1 to #TWOWIREPLUS_RINGBUFFER_SIZE
  */
-uint8_t TwoWirePlus::getBytesToReceive()
+void TwoWirePlus::setConsumer(TwoWirePlus_ConsumerCallback_t callback, uint8_t watermark)
 {
-  return TwoWirePlus_bytesToReceive;
+  uint8_t sreg = SREG;
+  cli();
+  TwoWirePlus_rxConsumer = callback;
+  TwoWirePlus_rxWatermark = watermark;
+  SREG = sreg;
 }
 
 /**
- * Provides access to last status of two wire interface
- * @return Last status of two wire interface
+ * Passes bytes in rxRingBuffer to consumer if watermark is reached or reception is complete
+ * @note Called in interrupt context after a byte was placed in rxRingBuffer
  */
-TwoWirePlus_Status_t TwoWirePlus::getStatus()
+static void TwoWirePlus_consumeRx(void)
 {
-  return TwoWirePlus_status;
+  uint8_t count = (uint8_t)(TwoWirePlus_rxRingBuffer.head - TwoWirePlus_rxRingBuffer.tail) % TWOWIREPLUS_RINGBUFFER_SIZE;
+  if (count == 0)
+  {
+    /* Head equals tail after write, thus, buffer is full */
+    count = TWOWIREPLUS_RINGBUFFER_SIZE;
+  }
+  if ((count >= TwoWirePlus_rxWatermark) || (TwoWirePlus_bytesToReceive == 0))
+  {
+    /* Contiguous part up to end of buffer first */
+    uint8_t length = TWOWIREPLUS_RINGBUFFER_SIZE - TwoWirePlus_rxRingBuffer.tail;
+    if (length > count)
+    {
+      length = count;
+    }
+    TwoWirePlus_rxConsumer(&TwoWirePlus_rxRingBuffer.buffer[TwoWirePlus_rxRingBuffer.tail], length);
+    if (length < count)
+    {
+      TwoWirePlus_rxConsumer(TwoWirePlus_rxRingBuffer.buffer, count - length);
+    }
+    TwoWirePlus_rxRingBuffer.tail = TwoWirePlus_rxRingBuffer.head;
+    TwoWirePlus_rxRingBuffer.lastOperation = TWOWIREPLUS_LASTOPERATION_READ;
+  }
 }
 
 /**
- * ISR for two wire interface TWI
- * Only exchange between ISR and the class WirePlus are the two ring buffer.
- * Initial trigger for Tx will be set in beginTransmit or write function. As long as data is
- * available in txRingBuffer it will be written to TWDR.
- * @note Writing a one to TWCR actually clears the corresponding bit
+ * Switches reception as master to double buffered mode for continuous sampling. Instead of rx
+ * ring buffer, ISR fills one buffer while application processes the other one, i.e. the one
+ * returned by #getFilledBuffer. Buffers are swapped without copy when filled. If the other
+ * buffer was not released by application yet, buffer just filled is discarded and refilled
+ * (overrun, see #getPingPongOverruns).
+ * @param bufferA First buffer of #length bytes or NULL to return to rx ring buffer
+ * @param bufferB Second buffer of #length bytes
+ * @param length Size of each buffer, e.g. one sample record
+ * @note Do not call while receiving
  */
-ISR(TWI_vect)
+void TwoWirePlus::beginPingPong(uint8_t *bufferA, uint8_t *bufferB, uint8_t length)
 {
-#ifdef TWOWIREPLUS_DEBUG
-  PORTB = TW_STATUS>>2;
-  digitalWrite(4, HIGH);
-#endif
-  /* remember current status for application */
-  TwoWirePlus_status = TW_STATUS;
-  /* See why exactly interrupt was triggered */
-  switch(TW_STATUS)
+  uint8_t sreg = SREG;
+  cli();
+  TwoWirePlus_pingPong[0] = bufferA;
+  TwoWirePlus_pingPong[1] = bufferB;
+  TwoWirePlus_pingPongLength = length;
+  TwoWirePlus_pingPongIndex = 0;
+  TwoWirePlus_pingPongFill = 0;
+  TwoWirePlus_pingPongReady = 0;
+  TwoWirePlus_pingPongOverruns = 0;
+  SREG = sreg;
+}
+
+/**
+ * Returns buffer filled completely by ISR in double buffered mode. Buffer is owned by
+ * application until handed back with #releaseBuffer.
+ * @return Filled buffer or NULL if none is ready
+ */
+uint8_t *TwoWirePlus::getFilledBuffer()
+{
+  /* At most one buffer is ready at a time */
+  uint8_t ready = TwoWirePlus_pingPongReady;
+  if (ready == 0)
   {
-    /* Slave adress is just one of the bytes which is transefered. Thus, we will just sent one
-     * byte after each other after START, RE_START, ACK from the ring buffer. */
-    case TW_MR_SLA_NACK:
-      /* In case we sent NACK to two wire slave device there is nothing more to receive */
-      TwoWirePlus_bytesToReceive = 0;
-      /* fall through */
-    case TW_MT_SLA_ACK:
-    case TW_MR_SLA_ACK:
-    case TW_MT_SLA_NACK:
-    case TW_MT_DATA_NACK:
-    case TW_MT_DATA_ACK:
-      /* If ACK/NACK was received we've sent something earlier and therefore need to move read pointer */
-      TwoWirePlus_incrementIndex(TwoWirePlus_txRingBuffer.tail);
-      TwoWirePlus_txRingBuffer.lastOperation = TWOWIREPLUS_LASTOPERATION_READ;
-      /* fall through */
-    case TW_START:
-    case TW_REP_START:
-      /* Process next byte in queue if there is one */
-      if (! TwoWirePlus_RingBufferEmpty(TwoWirePlus_txRingBuffer) )
-      {
-        TWDR = TwoWirePlus_txRingBuffer.buffer[TwoWirePlus_txRingBuffer.tail];
-        TWCR = TWOWIREPLUS_TWCR_CLEAR;
+    return NULL;
+  }
+  return TwoWirePlus_pingPong[(ready & _BV(1)) ? 1 : 0];
+}
+
+/**
+ * Hands buffer returned by #getFilledBuffer back to ISR
+ * @param buffer Buffer processed by application
+ */
+void TwoWirePlus::releaseBuffer(uint8_t *buffer)
+{
+  uint8_t sreg = SREG;
+  cli();
+  TwoWirePlus_pingPongReady &= ~_BV((buffer == TwoWirePlus_pingPong[1]) ? 1 : 0);
+  SREG = sreg;
+}
+
+/**
+ * Returns number of buffers discarded because application did not release the other buffer
+ * in time
+ * @return Number of overruns since #beginPingPong
+ */
+uint8_t TwoWirePlus::getPingPongOverruns()
+{
+  return TwoWirePlus_pingPongOverruns;
+}
+
+/**
+ * Places received byte in buffer currently filled and swaps buffers when it is full
+ * @note Only call from ISR
+ */
+static void TwoWirePlus_storePingPong(uint8_t data)
+{
+  TwoWirePlus_pingPong[TwoWirePlus_pingPongFill][TwoWirePlus_pingPongIndex++] = data;
+  if (TwoWirePlus_pingPongIndex == TwoWirePlus_pingPongLength)
+  {
+    TwoWirePlus_pingPongIndex = 0;
+    if (TwoWirePlus_pingPongReady & _BV(TwoWirePlus_pingPongFill ^ 1))
+    {
+      /* Other buffer still owned by application, refill this one */
+      TwoWirePlus_pingPongOverruns++;
+    }
+    else
+    {
+      TwoWirePlus_pingPongReady |= _BV(TwoWirePlus_pingPongFill);
+      TwoWirePlus_pingPongFill ^= 1;
+    }
+  }
+}
+
+/**
+ * Returns number of bytes requested to be received via two wire interface. In case of NACK received
+ * return value will be 0 and two wire status must be checked in addition.
+ * @return Number of bytes still requested to be received by two wire interface or zero if NACK was
+ * received from two wire slave device (status equals to TwoWirePlus_MasterReceiver_NACK).
+ */
+TwoWirePlus_ByteCount_t TwoWirePlus::getBytesToReceive()
+{
+  TwoWirePlus_ByteCount_t retVal;
+  /* Take an atomic snapshot because ISR might change the variable while reading it */
+  uint8_t sreg = SREG;
+  cli();
+  retVal = TwoWirePlus_bytesToReceive;
+  SREG = sreg;
+  return retVal;
+}
+
+/**
+ * Returns the accumulated time SCL was held low by this device because rx ring buffer
+ * was full and application did not read fast enough.
+ * @return Time in microseconds spent in clock stretching since start-up
+ */
+uint32_t TwoWirePlus::getRxStretchTime()
+{
+  uint32_t retVal;
+  uint8_t sreg = SREG;
+  cli();
+  retVal = TwoWirePlus_rxStallTime;
+  SREG = sreg;
+  return retVal;
+}
+
+/**
+ * Provides access to last status of two wire interface
+ * @return Last status of two wire interface
+ */
+TwoWirePlus_Status_t TwoWirePlus::getStatus()
+{
+  return TwoWirePlus_status;
+}
+
+/**
+ * Enables two wire slave functionality. Device will respond to #address and expose
+ * #registers to the two wire master. First byte written by master sets the register pointer,
+ * following bytes are written to the register file. Reads return register file content
+ * starting at register pointer. Register pointer is incremented after each byte. Writes
+ * beyond #size are NACKed, reads beyond #size return 0xff.
+ * ISR reads and writes #registers directly. Thus, data is never copied and no callback is
+ * called per byte.
+ * @param address 7bit slave address
+ * @param registers Register file. Must stay valid as long as slave functionality is used.
+ * Application shall disable interrupts while accessing values wider than one byte.
+ * @param size Number of bytes in register file (up to 256)
+ * @note Do not call while two wire communication is on-going
+ */
+void TwoWirePlus::beginSlave(uint8_t address, volatile uint8_t *registers, uint16_t size)
+{
+  TwoWirePlus_slaveRegisters = registers;
+  TwoWirePlus_slaveRegisterSize = size;
+  TwoWirePlus_enableSlave(address);
+}
+
+/**
+ * Enables two wire slave functionality without register file. Frames written by two wire
+ * master are received into rx ring buffer and an event is queued for each complete frame.
+ * Events are processed in application context by calling #poll which calls the callback set
+ * by #onReceive. Bytes are NACKed if rx ring buffer or event queue is full. Thus, ISR time per
+ * byte is constant and independent of frame size.
+ * When addressed as slave transmitter the reply set by #setReply is sent. Callback set by
+ * #onRequest is called right before in interrupt context to allow staging a different reply.
+ * @param address 7bit slave address
+ * @note rx ring buffer must not be used for master reception at the same time
+ * @note Do not call while two wire communication is on-going
+ */
+void TwoWirePlus::beginSlave(uint8_t address)
+{
+  TwoWirePlus_slaveRegisters = NULL;
+  TwoWirePlus_slaveRegisterSize = 0;
+  TwoWirePlus_slaveEvents.head = 0;
+  TwoWirePlus_slaveEvents.tail = 0;
+  TwoWirePlus_slaveFrameLength = 0;
+  TwoWirePlus_slaveOverruns = 0;
+  TwoWirePlus_enableSlave(address);
+}
+
+/**
+ * Sets callback called by #poll for each frame received as slave. Callback may read up to
+ * #numberOfBytes bytes using #read, #peekSpan and #consume. #available returns bytes of the frame
+ * left, reading beyond the frame returns nothing. Bytes not read by callback are discarded.
+ * @param callback Function to be called in application context or NULL to discard frames
+ */
+void TwoWirePlus::onReceive(TwoWirePlus_ReceiveCallback_t callback)
+{
+  TwoWirePlus_receiveCallback = callback;
+}
+
+/**
+ * Sets callback called in interrupt context when addressed as slave transmitter. Callback
+ * shall only stage a reply using #setReply and return as fast as possible.
+ * @param callback Function to be called or NULL
+ */
+void TwoWirePlus::onRequest(TwoWirePlus_RequestCallback_t callback)
+{
+  TwoWirePlus_requestCallback = callback;
+}
+
+/**
+ * Stages reply sent when addressed as slave transmitter. Data is sent directly from #data,
+ * thus it must stay valid until reply was sent. In case master reads more than #length bytes
+ * 0xff is sent.
+ * @param data Reply to be sent
+ * @param length Number of bytes of reply
+ */
+void TwoWirePlus::setReply(const uint8_t *data, uint8_t length)
+{
+  uint8_t sreg = SREG;
+  cli();
+  TwoWirePlus_slaveReply = data;
+  TwoWirePlus_slaveReplyLength = length;
+  SREG = sreg;
+}
+
+/**
+ * Processes all frames received as slave since last call. Callback set by #onReceive is
+ * called for each frame in application context.
+ * @return Number of frames processed
+ */
+uint8_t TwoWirePlus::poll()
+{
+  uint8_t events = 0;
+  while (! TwoWirePlus_EventQueueEmpty(TwoWirePlus_slaveEvents))
+  {
+    uint8_t length = TwoWirePlus_slaveEvents.length[TwoWirePlus_slaveEvents.tail & (TWOWIREPLUS_EVENTQUEUE_SIZE - 1)];
+    TwoWirePlus_frameRemaining = length;
+    TwoWirePlus_frameActive = true;
+    if (TwoWirePlus_receiveCallback != NULL)
+    {
+      TwoWirePlus_receiveCallback(length);
+    }
+    TwoWirePlus_frameActive = false;
+    /* Discard bytes of frame not read by callback */
+    consume(TwoWirePlus_frameRemaining);
+    /* Release event only after data was consumed */
+    TwoWirePlus_slaveEvents.tail++;
+    events++;
+  }
+  return events;
+}
+
+/**
+ * Returns number of bytes NACKed as slave because rx ring buffer or event queue was full
+ * @return Number of bytes not accepted since #beginSlave
+ */
+uint8_t TwoWirePlus::getSlaveOverruns()
+{
+  return TwoWirePlus_slaveOverruns;
+}
+
+/**
+ * Appends #transaction to the queue of master transactions. Transaction is started by ISR as
+ * soon as all previous transactions are finished and the bus is free. Own slave address stays
+ * recognized all the time. If arbitration is lost, slave transfer is served first and
+ * transaction is restarted afterwards.
+ * @param transaction Transaction to be queued. Must stay valid until it left the queue.
+ * @note Function is not blocking. Use #waitFor or check state of #transaction for completion.
+ * @note Do not use #beginTransmission or #beginReception while transactions are queued
+ */
+void TwoWirePlus::queue(TwoWirePlus_Transaction_t *transaction)
+{
+  transaction->state = TWOWIREPLUS_TRANSACTION_QUEUED;
+  uint8_t sreg = SREG;
+  cli();
+  TwoWirePlus_enqueue(transaction);
+  SREG = sreg;
+}
+
+/**
+ * Blocks until #transaction is finished and STOP was sent.
+ * @param transaction Previously queued transaction
+ * @return Final state of #transaction
+ * @note This function is blocking. Do not call in interrupt context.
+ */
+TwoWirePlus_TransactionState_t TwoWirePlus::waitFor(TwoWirePlus_Transaction_t *transaction)
+{
+  TwoWirePlus_waitWhile(transaction->state < TWOWIREPLUS_TRANSACTION_DONE);
+  /* TWINT is not set after a stop condition. Thus, we wait for STOP bit is cleared in TWCR */
+  TwoWirePlus_waitWhile(TWCR & _BV(TWSTO));
+  return transaction->state;
+}
+
+/**
+ * Queues a read-modify-write of a single register. ISR reads #reg, replaces bits in #mask by
+ * #value and writes result back within the same transfer using repeated START. Application
+ * never sees the intermediate value. If register already has the requested value, nothing is
+ * written.
+ * @param transaction Descriptor to be used. Must stay valid until transaction left the queue.
+ * After completion transaction->buffer[1] holds the new register value.
+ * @param address 7bit slave address
+ * @param reg Register address
+ * @param mask Bits to be modified
+ * @param value New value of bits in #mask
+ * @note Function is not blocking. Use #waitFor to wait for completion.
+ */
+void TwoWirePlus::updateBits(TwoWirePlus_Transaction_t *transaction, uint8_t address, uint8_t reg, uint8_t mask, uint8_t value)
+{
+  TwoWirePlus_transactionInit(transaction, address, transaction->buffer, 1, &transaction->buffer[1], 1);
+  transaction->buffer[0] = reg;
+  transaction->mask = mask;
+  transaction->value = value;
+  queue(transaction);
+}
+
+/**
+ * Queues a micro-sequencer script. Script is interpreted by ISR, thus a complete device
+ * interaction, e.g. write command, poll status register until a bit is set and read result,
+ * runs without the application. Script is read from flash, each instruction is built by one
+ * of the TWOWIREPLUS_SEQ_xxx macros and script must end with #TWOWIREPLUS_SEQ_END:
+ * @code
+ * const uint8_t convert[] PROGMEM = {
+ *   TWOWIREPLUS_SEQ_START_WRITE(0x40), TWOWIREPLUS_SEQ_WRITE(0x10),     // offset 0: start conversion
+ *   TWOWIREPLUS_SEQ_DELAY(1),                                           // offset 4: wait one tick
+ *   TWOWIREPLUS_SEQ_START_WRITE(0x40), TWOWIREPLUS_SEQ_WRITE(0x00),     // offset 6: read status
+ *   TWOWIREPLUS_SEQ_START_READ(0x40), TWOWIREPLUS_SEQ_READ(0, 1),
+ *   TWOWIREPLUS_SEQ_JUMP_IF_CLEAR(0, 0x80, 4),                          // not ready, try again
+ *   TWOWIREPLUS_SEQ_START_WRITE(0x40), TWOWIREPLUS_SEQ_WRITE(0x01),     // read result
+ *   TWOWIREPLUS_SEQ_START_READ(0x40), TWOWIREPLUS_SEQ_READ(1, 2),
+ *   TWOWIREPLUS_SEQ_END };
+ * @endcode
+ * Script is finished with #TWOWIREPLUS_TRANSACTION_NACK if any SLA or data byte is NACKed.
+ * If arbitration is lost, script is restarted from the beginning.
+ * @param transaction Descriptor to be used. Must stay valid until transaction left the queue.
+ * @param script Script in PROGMEM
+ * @param slots Slot buffer for READ and WRITE_SLOT instructions
+ * @note Function is not blocking. Use #waitFor to wait for completion.
+ * @note #TWOWIREPLUS_SEQ_DELAY requires #TwoWirePlus_tick to be called periodically
+ */
+void TwoWirePlus::run(TwoWirePlus_Transaction_t *transaction, const uint8_t *script, uint8_t *slots)
+{
+  TwoWirePlus_transactionInit(transaction, 0, NULL, 0, slots, 0);
+  transaction->script = script;
+  queue(transaction);
+}
+
+/**
+ * Queues several scripts with one call, e.g. init scripts of all devices of a board. Scripts
+ * are streamed from flash, literal data shall be written with #TWOWIREPLUS_SEQ_WRITE_BYTES.
+ * Whenever a script waits in a DELAY instruction, the bus is used by the following scripts.
+ * Thus, init sequences of independent devices overlap:
+ * @code
+ * constexpr uint8_t lcdInit[] PROGMEM = {
+ *   TWOWIREPLUS_SEQ_START_WRITE(0x27), TWOWIREPLUS_SEQ_WRITE_BYTES(2), 0x00, 0x38,
+ *   TWOWIREPLUS_SEQ_DELAY(5),
+ *   TWOWIREPLUS_SEQ_START_WRITE(0x27), TWOWIREPLUS_SEQ_WRITE_BYTES(3), 0x00, 0x0c, 0x01,
+ *   TWOWIREPLUS_SEQ_DELAY(2),
+ *   TWOWIREPLUS_SEQ_END };
+ * @endcode
+ * @param transactions One descriptor per script. Must stay valid until scripts are finished.
+ * @param scripts Scripts in PROGMEM without slots, i.e. scripts must not use READ or WRITE_SLOT
+ * @param count Number of scripts
+ * @note Function is not blocking. Use #waitFor on each descriptor to wait for completion.
+ */
+void TwoWirePlus::run(TwoWirePlus_Transaction_t *transactions, const uint8_t * const *scripts, uint8_t count)
+{
+  for (uint8_t i=0; i<count; i++)
+  {
+    run(&transactions[i], scripts[i], NULL);
+  }
+}
+
+/**
+ * Returns number of times arbitration was lost while processing queued transactions
+ * @return Number of arbitration losses since start-up
+ */
+uint8_t TwoWirePlus::getArbitrationLosses()
+{
+  return TwoWirePlus_arbitrationLosses;
+}
+
+/**
+ * Checks if device ACKed its address last time it was addressed. No bus access is needed,
+ * device table is updated by every transfer.
+ * @param address 7bit slave address
+ * @return true if device is present, false if it NACKed or was never seen
+ */
+bool TwoWirePlus::isPresent(uint8_t address)
+{
+  TwoWirePlus_Device_t *device = TwoWirePlus_findDevice(address);
+  return (device != NULL) && device->present;
+}
+
+/**
+ * Copies device table entry of #address
+ * @param address 7bit slave address
+ * @param device Entry is copied here
+ * @return false if device is not in table
+ */
+bool TwoWirePlus::getDevice(uint8_t address, TwoWirePlus_Device_t *device)
+{
+  bool found = false;
+  uint8_t sreg = SREG;
+  cli();
+  TwoWirePlus_Device_t *entry = TwoWirePlus_findDevice(address);
+  if (entry != NULL)
+  {
+    *device = *entry;
+    found = true;
+  }
+  SREG = sreg;
+  return found;
+}
+
+/**
+ * Revalidates stalest device table entry by queuing an address only transaction. Call
+ * periodically, e.g. from loop, to detect devices which were removed or plugged in again
+ * without probing devices which were addressed recently anyway.
+ * @param maxAge Entries not updated for #maxAge micros are revalidated
+ * @return true if a probe was queued, false if all entries are up to date or last probe did not
+ * finish yet
+ */
+bool TwoWirePlus::revalidate(uint32_t maxAge)
+{
+  TwoWirePlus_Device_t *stale = NULL;
+  uint32_t staleAge = maxAge;
+  uint32_t now = micros();
+
+  if (TwoWirePlus_probe.state < TWOWIREPLUS_TRANSACTION_DONE)
+  {
+    return false;
+  }
+  for (uint8_t i=0; i<TWOWIREPLUS_DEVICETABLE_SIZE; i++)
+  {
+    uint8_t sreg = SREG;
+    cli();
+    uint32_t age = now - TwoWirePlus_devices[i].lastSeen;
+    SREG = sreg;
+    if ((TwoWirePlus_devices[i].address != 0) && (age >= staleAge))
+    {
+      stale = &TwoWirePlus_devices[i];
+      staleAge = age;
+    }
+  }
+  if (stale == NULL)
+  {
+    return false;
+  }
+  TwoWirePlus_transactionInit(&TwoWirePlus_probe, stale->address, NULL, 0, NULL, 0);
+  queue(&TwoWirePlus_probe);
+  return true;
+}
+
+/**
+ * Enables merging of register writes by #writeRegisters. Writes to adjacent registers of the same
+ * device are sent as one auto-increment burst, i.e. START, SLA+W and STOP are paid only once.
+ * @param ticks Burst is queued at the latest #ticks calls of #TwoWirePlus_tick after its first
+ * write, zero disables merging
+ * @note Requires #TwoWirePlus_tick to be called periodically. Pending burst is queued, function
+ * is not blocking.
+ */
+void TwoWirePlus::setCoalescing(uint8_t ticks)
+{
+  uint8_t sreg = SREG;
+  cli();
+  TwoWirePlus_queueBurst();
+  TwoWirePlus_coalesceTicks = ticks;
+  SREG = sreg;
+}
+
+/**
+ * Writes #length bytes to registers starting at #reg. If merging is enabled, see #setCoalescing,
+ * bytes are appended to the pending burst if they continue it. Otherwise pending burst is queued
+ * and a new one is started. Without merging, the new burst is queued right away.
+ * @param address 7bit slave address
+ * @param reg First register to be written, register address is incremented by device
+ * @param data Bytes to be written, copied before function returns
+ * @param length Number of bytes to be written, up to #TWOWIREPLUS_COALESCE_SIZE
+ * @return false if #length is too large or all #TWOWIREPLUS_COALESCE_BURSTS bursts are still
+ * queued, nothing was written then
+ * @note Function is not blocking. Use #flush to wait until all bursts were sent.
+ */
+bool TwoWirePlus::writeRegisters(uint8_t address, uint8_t reg, const uint8_t *data, uint8_t length)
+{
+  TwoWirePlus_Transaction_t *burst = &TwoWirePlus_coalesce[TwoWirePlus_coalesceIndex];
+  uint8_t *buffer = TwoWirePlus_coalesceBuffer[TwoWirePlus_coalesceIndex];
+  uint8_t sreg = SREG;
+  uint8_t i;
+  cli();
+  if (TwoWirePlus_coalescePending && (burst->address == address)
+      && ((uint8_t)(buffer[0] + burst->txLength - 1) == reg)
+      && (length <= (uint8_t)(1 + TWOWIREPLUS_COALESCE_SIZE - burst->txLength)))
+  {
+    for (i=0; i<length; i++)
+    {
+      buffer[burst->txLength++] = data[i];
+    }
+    SREG = sreg;
+    return true;
+  }
+  TwoWirePlus_queueBurst();
+  /* Next burst whose transaction left the queue */
+  for (i=1; i<=TWOWIREPLUS_COALESCE_BURSTS; i++)
+  {
+    if (TwoWirePlus_coalesce[(TwoWirePlus_coalesceIndex + i) % TWOWIREPLUS_COALESCE_BURSTS].state >= TWOWIREPLUS_TRANSACTION_DONE)
+    {
+      break;
+    }
+  }
+  if ((length > TWOWIREPLUS_COALESCE_SIZE) || (i > TWOWIREPLUS_COALESCE_BURSTS))
+  {
+    SREG = sreg;
+    return false;
+  }
+  TwoWirePlus_coalesceIndex = (TwoWirePlus_coalesceIndex + i) % TWOWIREPLUS_COALESCE_BURSTS;
+  burst = &TwoWirePlus_coalesce[TwoWirePlus_coalesceIndex];
+  buffer = TwoWirePlus_coalesceBuffer[TwoWirePlus_coalesceIndex];
+  TwoWirePlus_transactionInit(burst, address, buffer, 1 + length, NULL, 0);
+  buffer[0] = reg;
+  for (i=0; i<length; i++)
+  {
+    buffer[1 + i] = data[i];
+  }
+  TwoWirePlus_coalesceDeadline = TwoWirePlus_coalesceTicks;
+  TwoWirePlus_coalescePending = true;
+  if (TwoWirePlus_coalesceTicks == 0)
+  {
+    TwoWirePlus_queueBurst();
+  }
+  SREG = sreg;
+  return true;
+}
+
+/**
+ * Queues pending burst of #writeRegisters and waits until all bursts were sent
+ */
+void TwoWirePlus::flush()
+{
+  uint8_t sreg = SREG;
+  cli();
+  TwoWirePlus_queueBurst();
+  SREG = sreg;
+  for (uint8_t i=0; i<TWOWIREPLUS_COALESCE_BURSTS; i++)
+  {
+    waitFor(&TwoWirePlus_coalesce[i]);
+  }
+}
+
+/**
+ * Probes all 7bit addresses except reserved ones, see #scan(uint8_t*, uint8_t, uint8_t)
+ * @param bitmap Presence bitmap of TWOWIREPLUS_SCAN_BITMAP_SIZE bytes
+ * @return Number of devices found
+ */
+uint8_t TwoWirePlus::scan(uint8_t *bitmap)
+{
+  return scan(bitmap, TWOWIREPLUS_SCAN_FIRST, TWOWIREPLUS_SCAN_LAST);
+}
+
+/**
+ * Probes 7bit addresses #first to #last back to back. Only SLA+W is sent, next address follows
+ * with repeated START right after ACK/NACK of previous one, thus, scan is done entirely in the
+ * ISR and takes about ten bit times per address. Scan is queued like any other transaction.
+ * @param bitmap Presence bitmap of TWOWIREPLUS_SCAN_BITMAP_SIZE bytes. Bit (address & 7) of
+ * bitmap[address >> 3] is set if address was ACKed.
+ * @param first First address to be probed
+ * @param last Last address to be probed, limited to #TWOWIREPLUS_SCAN_MAX
+ * @return Number of devices found
+ */
+uint8_t TwoWirePlus::scan(uint8_t *bitmap, uint8_t first, uint8_t last)
+{
+  TwoWirePlus_Transaction_t transaction;
+  uint8_t count = 0;
+
+  for (uint8_t i=0; i<TWOWIREPLUS_SCAN_BITMAP_SIZE; i++)
+  {
+    bitmap[i] = 0;
+  }
+  if (last > TWOWIREPLUS_SCAN_MAX)
+  {
+    last = TWOWIREPLUS_SCAN_MAX;
+  }
+  if (first > last)
+  {
+    return 0;
+  }
+  TwoWirePlus_scanLast = last;
+  TwoWirePlus_transactionInit(&transaction, first, NULL, 0, bitmap, 0);
+  transaction.flags = TWOWIREPLUS_TRANSACTION_FLAG_SCAN;
+  queue(&transaction);
+  waitFor(&transaction);
+  for (uint8_t i=0; i<TWOWIREPLUS_SCAN_BITMAP_SIZE; i++)
+  {
+    for (uint8_t data = bitmap[i]; data; data &= (uint8_t)(data - 1))
+    {
+      count++;
+    }
+  }
+  return count;
+}
+
+/**
+ * Sets wait/notify functions to be used whenever a blocking function has to wait for the two
+ * wire interface, e.g. to run other tasks of an RTOS or cooperative scheduler meanwhile.
+ * @param waiter Wait/notify functions to be used. Must stay valid as long as it is in use. If
+ * NULL is passed #TwoWirePlus_idleSleepWaiter is used.
+ * @note Do not call while two wire communication is on-going
+ */
+void TwoWirePlus::setWaiter(const TwoWirePlus_Waiter_t *waiter)
+{
+  TwoWirePlus_waiter = (waiter != NULL) ? waiter : &TwoWirePlus_idleSleepWaiter;
+}
+
+/**
+ * Sets hook called whenever a blocking function has to wait for the two wire interface. Same as
+ * #setWaiter with a waiter which is not notified by ISR(TWI_vect).
+ * @param hook Called with interrupts disabled, must enable interrupts again. If NULL is passed
+ * #TwoWirePlus_idleSleepWaiter is used.
+ * @note Do not call while two wire communication is on-going
+ */
+void TwoWirePlus::setWaitHook(TwoWirePlus_WaitHook_t hook)
+{
+  TwoWirePlus_hookWaiter.wait = hook;
+  setWaiter((hook != NULL) ? &TwoWirePlus_hookWaiter : NULL);
+}
+
+/**
+ * Wait function for busy waiting. Just enables interrupts again.
+ * @pre Interrupts are disabled
+ */
+void TwoWirePlus_spinWait(void)
+{
+  sei();
+}
+
+/**
+ * Default wait function. Puts CPU into idle sleep mode which keeps the two wire interface
+ * running. CPU is woken up again by the next interrupt, e.g. TWI interrupt.
+ * If no TWI interrupt is to be expected, i.e. TWI interrupt is disabled or STOP is pending
+ * (TWINT is not set after STOP), function returns immediately.
+ * @pre Interrupts are disabled
+ */
+void TwoWirePlus_idleSleep(void)
+{
+  if (TwoWirePlus_InterruptExpected())
+  {
+    set_sleep_mode(SLEEP_MODE_IDLE);
+    sleep_enable();
+    /* Instruction following sei is executed before any pending interrupt. Thus, no
+     * interrupt can be missed between sei and sleep */
+    sei();
+    sleep_cpu();
+    sleep_disable();
+  }
+  else
+  {
+    sei();
+  }
+}
+
+/**
+ * Wait function taking the binary semaphore given by #TwoWirePlus_semaphoreNotify. In contrast
+ * to #TwoWirePlus_idleSleep, CPU is put back to sleep if woken up by any other interrupt.
+ * Serves as reference for RTOS integration where wait and notify map to semaphore take and
+ * give from ISR.
+ * @pre Interrupts are disabled
+ */
+void TwoWirePlus_semaphoreWait(void)
+{
+  if (TwoWirePlus_InterruptExpected())
+  {
+    set_sleep_mode(SLEEP_MODE_IDLE);
+    while (!TwoWirePlus_semaphore)
+    {
+      sleep_enable();
+      sei();
+      sleep_cpu();
+      sleep_disable();
+      cli();
+    }
+  }
+  TwoWirePlus_semaphore = false;
+  sei();
+}
+
+/**
+ * Notify function giving the binary semaphore taken by #TwoWirePlus_semaphoreWait
+ * @note Called in interrupt context
+ */
+void TwoWirePlus_semaphoreNotify(void)
+{
+  TwoWirePlus_semaphore = true;
+}
+
+/**
+ * Nibble tables for CRC calculation. 16 entries instead of 256 keep flash usage small at the
+ * cost of two lookups per byte.
+ */
+static const uint8_t TwoWirePlus_crc8Table[16] PROGMEM = {
+  0x00, 0x07, 0x0e, 0x09, 0x1c, 0x1b, 0x12, 0x15, 0x38, 0x3f, 0x36, 0x31, 0x24, 0x23, 0x2a, 0x2d
+};
+static const uint8_t TwoWirePlus_crc8WordTable[16] PROGMEM = {
+  0x00, 0x31, 0x62, 0x53, 0xc4, 0xf5, 0xa6, 0x97, 0xb9, 0x88, 0xdb, 0xea, 0x7d, 0x4c, 0x1f, 0x2e
+};
+static const uint16_t TwoWirePlus_crc16Table[16] PROGMEM = {
+  0x0000, 0x1021, 0x2042, 0x3063, 0x4084, 0x50a5, 0x60c6, 0x70e7,
+  0x8108, 0x9129, 0xa14a, 0xb16b, 0xc18c, 0xd1ad, 0xe1ce, 0xf1ef
+};
+
+/**
+ * Adds one byte to CRC-8 with polynomial 0x07 (SMBus PEC)
+ * @param crc CRC calculated so far, 0 for first byte
+ * @param data Byte to add
+ * @return New CRC
+ */
+uint8_t TwoWirePlus_crc8(uint8_t crc, uint8_t data)
+{
+  crc ^= data;
+  crc = (uint8_t)(crc << 4) ^ pgm_read_byte(&TwoWirePlus_crc8Table[crc >> 4]);
+  crc = (uint8_t)(crc << 4) ^ pgm_read_byte(&TwoWirePlus_crc8Table[crc >> 4]);
+  return crc;
+}
+
+/**
+ * Adds one byte to CRC-8 with polynomial 0x31 used by sensors for each 2 byte word
+ * @param crc CRC calculated so far, 0xff for first byte of a word
+ * @param data Byte to add
+ * @return New CRC
+ */
+uint8_t TwoWirePlus_crc8Word(uint8_t crc, uint8_t data)
+{
+  crc ^= data;
+  crc = (uint8_t)(crc << 4) ^ pgm_read_byte(&TwoWirePlus_crc8WordTable[crc >> 4]);
+  crc = (uint8_t)(crc << 4) ^ pgm_read_byte(&TwoWirePlus_crc8WordTable[crc >> 4]);
+  return crc;
+}
+
+/**
+ * Adds one byte to CRC-16 with polynomial 0x1021 (CCITT)
+ * @param crc CRC calculated so far, 0xffff for first byte
+ * @param data Byte to add
+ * @return New CRC
+ */
+uint16_t TwoWirePlus_crc16(uint16_t crc, uint8_t data)
+{
+  crc ^= (uint16_t)data << 8;
+  crc = (uint16_t)(crc << 4) ^ pgm_read_word(&TwoWirePlus_crc16Table[crc >> 12]);
+  crc = (uint16_t)(crc << 4) ^ pgm_read_word(&TwoWirePlus_crc16Table[crc >> 12]);
+  return crc;
+}
+
+/**
+ * Sets up a plain write and/or read descriptor at run time, counterpart of
+ * #TWOWIREPLUS_TRANSACTION_INIT. All other fields are cleared.
+ * @param transaction Descriptor to be set up. Must not be queued.
+ * @param address 7bit slave address or TWOWIREPLUS_ADDRESS_10BIT(address)
+ * @param txData Bytes to be written
+ * @param txLength Number of bytes to be written
+ * @param rxData Buffer for bytes to be read
+ * @param rxLength Number of bytes to be read
+ */
+void TwoWirePlus_transactionInit(TwoWirePlus_Transaction_t *transaction, uint16_t address,
+    const uint8_t *txData, uint8_t txLength, uint8_t *rxData, uint8_t rxLength)
+{
+  memset((void *)transaction, 0, sizeof(*transaction));
+  transaction->address = address;
+  transaction->txData = txData;
+  transaction->txLength = txLength;
+  transaction->rxData = rxData;
+  transaction->rxLength = rxLength;
+}
+
+/**
+ * Adds byte transferred to checksum of transaction
+ * @note Only call from ISR
+ */
+static void TwoWirePlus_crcAdd(TwoWirePlus_Transaction_t *transaction, uint8_t data)
+{
+  if (transaction->crcMode == TWOWIREPLUS_CRC_PEC)
+  {
+    transaction->crc = TwoWirePlus_crc8(transaction->crc, data);
+  }
+  else if (transaction->crcMode == TWOWIREPLUS_CRC_16)
+  {
+    transaction->crc = TwoWirePlus_crc16(transaction->crc, data);
+  }
+  else if ((transaction->crcMode == TWOWIREPLUS_CRC_WORD) && (TwoWirePlus_transactionPhase == TWOWIREPLUS_PHASE_READ))
+  {
+    /* Low byte is CRC of current word, high byte keeps a mismatch of any previous word */
+    uint8_t position = (uint8_t)(transaction->index - 1) % 3;
+    uint8_t crc = TwoWirePlus_crc8Word((position == 0) ? 0xff : (uint8_t)transaction->crc, data);
+    transaction->crc = (transaction->crc & 0xff00) | crc;
+    if ((position == 2) && (crc != 0))
+    {
+      transaction->crc |= 0xff00;
+    }
+  }
+}
+
+/**
+ * Time base of micro-sequencer DELAY instruction and write merging. Continues script once the
+ * delay of current DELAY instruction elapsed and queues burst of merged writes when it's due.
+ * @note Call from a periodic timer interrupt, e.g. a timer compare match every millisecond
+ */
+void TwoWirePlus_tick(void)
+{
+  TwoWirePlus_Transaction_t **link = &TwoWirePlus_delayed;
+  if (TwoWirePlus_coalescePending && (--TwoWirePlus_coalesceDeadline == 0))
+  {
+    TwoWirePlus_queueBurst();
+  }
+  while (*link != NULL)
+  {
+    TwoWirePlus_Transaction_t *transaction = *link;
+    if (--transaction->delay == 0)
+    {
+      *link = transaction->next;
+      /* Continue with START instruction, anything else ends the script */
+      if (pgm_read_byte(&transaction->script[transaction->index]) == TWOWIREPLUS_SEQ_OP_START)
+      {
+        TwoWirePlus_enqueue(transaction);
+      }
+      else
+      {
+        transaction->state = TWOWIREPLUS_TRANSACTION_DONE;
+      }
+    }
+    else
+    {
+      link = &transaction->next;
+    }
+  }
+}
+
+/**
+ * Appends #transaction to queue of master transactions and requests START if queue was empty.
+ * Transactions behind a multiplexer which may be reordered join the last transaction queued for
+ * the same channel, as long as all transactions queued after it may be overtaken.
+ * @note Call with interrupts disabled
+ */
+static void TwoWirePlus_enqueue(TwoWirePlus_Transaction_t *transaction)
+{
+  transaction->next = NULL;
+  if ((TwoWirePlus_transaction != NULL) && (transaction->mux != 0) && (transaction->flags & TWOWIREPLUS_TRANSACTION_FLAG_REORDER))
+  {
+    TwoWirePlus_Transaction_t *after = NULL;
+    for (TwoWirePlus_Transaction_t *queued = TwoWirePlus_transaction; queued != NULL; queued = queued->next)
+    {
+      if ((queued->mux == transaction->mux) && (queued->channel == transaction->channel))
+      {
+        after = queued;
+      }
+      else if (!(queued->flags & TWOWIREPLUS_TRANSACTION_FLAG_REORDER))
+      {
+        after = NULL;
+      }
+    }
+    if ((after != NULL) && (after != TwoWirePlus_transactionTail))
+    {
+      transaction->next = after->next;
+      after->next = transaction;
+      return;
+    }
+  }
+  if (TwoWirePlus_transaction == NULL)
+  {
+    TwoWirePlus_transaction = transaction;
+    /* START is requested by ISR after slave transfer if currently addressed as slave and after
+     * the pending event if ISR did not run yet */
+    if (TwoWirePlus_eventPending())
+    {
+      TwoWirePlus_startPending = true;
+    }
+    else if (!TwoWirePlus_slaveActive)
+    {
+      /* Last STOP might still be pending */
+      TwoWirePlus_requestStart();
+    }
+  }
+  else
+  {
+    TwoWirePlus_transactionTail->next = transaction;
+  }
+  TwoWirePlus_transactionTail = transaction;
+}
+
+/**
+ * Queues burst of merged writes collected by #TwoWirePlus::writeRegisters, if any
+ * @note Call with interrupts disabled
+ */
+static void TwoWirePlus_queueBurst(void)
+{
+  if (TwoWirePlus_coalescePending)
+  {
+    TwoWirePlus_coalescePending = false;
+    TwoWirePlus_coalesce[TwoWirePlus_coalesceIndex].state = TWOWIREPLUS_TRANSACTION_QUEUED;
+    TwoWirePlus_enqueue(&TwoWirePlus_coalesce[TwoWirePlus_coalesceIndex]);
+  }
+}
+
+/**
+ * Sets slave address and enables acknowledge to recognize own address
+ * @param address 7bit slave address
+ */
+static void TwoWirePlus_enableSlave(uint8_t address)
+{
+  TwoWirePlus_slaveRegisterPointer = 0;
+  TwoWirePlus_slaveExpectPointer = false;
+  TWAR = address << 1;
+  /* Make sure TWEA is set, otherwise own address is not recognized */
+  TWCR = _BV(TWEN) | _BV(TWIE) | _BV(TWEA);
+}
+
+/**
+ * Requests next byte from two wire master in slave frame mode. ACK is only sent if
+ * byte can be stored in rx ring buffer and the frame can be recorded in event queue.
+ * @note Only call from ISR
+ */
+static inline void TwoWirePlus_acceptSlaveByte(void)
+{
+  if (TwoWirePlus_RingBufferFull(TwoWirePlus_rxRingBuffer) || TwoWirePlus_EventQueueFull(TwoWirePlus_slaveEvents))
+  {
+    TWCR = TWOWIREPLUS_TWCR_NACK;
+  }
+  else
+  {
+    TWCR = TWOWIREPLUS_TWCR_ACK;
+  }
+}
+
+/**
+ * Requests next byte from two wire slave device. ACK will be sent if more than one byte is
+ * left to be received and NACK for the very last one. In case rx ring buffer is full TWINT
+ * is not cleared and TWI interrupt is disabled. Thus, SCL is held low (clock stretching)
+ * until #TwoWirePlus::read made space in the buffer.
+ * @note Do not call with TWI interrupt enabled, i.e. only from ISR or while reception is
+ * paused.
+ */
+static void TwoWirePlus_requestNextByte(void)
+{
+  if (TwoWirePlus_bytesToReceive && TwoWirePlus_RingBufferFull(TwoWirePlus_rxRingBuffer))
+  {
+    /* No space left, keep TWINT set to stretch clock until application read some bytes */
+    TwoWirePlus_rxStalled = true;
+    TwoWirePlus_rxStallStart = micros();
+    TWCR = TWOWIREPLUS_TWCR_STRETCH;
+  }
+  else if (TwoWirePlus_bytesToReceive > 1)
+  {
+    /* More than one byte to be received left, send ACK */
+    TWCR = TWOWIREPLUS_TWCR_ACK;
+  }
+  else if (TwoWirePlus_bytesToReceive == 1)
+  {
+    /* Send NACK for last byte (and all following one) to stop reception */
+    TWCR = TWOWIREPLUS_TWCR_NACK;
+  }
+  else /* nothing else to do. Just clear interrupt and wait for more data or stop */
+  {
+    TWCR = TWOWIREPLUS_TWCR_RELEASE;
+  }
+}
+
+/**
+ * Finishes current transaction and starts next one, if any, right after STOP. TWEA is kept
+ * set to recognize own slave address.
+ * @param state Final state of transaction
+ * @note Only call from ISR
+ */
+static void TwoWirePlus_finishTransaction(TwoWirePlus_TransactionState_t state)
+{
+  TwoWirePlus_Transaction_t *transaction = TwoWirePlus_transaction;
+  TwoWirePlus_transaction = transaction->next;
+  /* Delayed scripts leave the queue but are not finished */
+  if (state == TWOWIREPLUS_TRANSACTION_BUSY)
+  {
+    transaction->next = TwoWirePlus_delayed;
+    TwoWirePlus_delayed = transaction;
+  }
+  else
+  {
+    transaction->state = state;
+  }
+  if (TwoWirePlus_transaction != NULL)
+  {
+    TWCR = TWOWIREPLUS_TWCR_STOP_START;
+  }
+  else
+  {
+    TWCR = TWOWIREPLUS_TWCR_STOP;
+  }
+}
+
+/**
+ * Executes instructions of current script until an instruction requests a bus action, i.e. a
+ * TWI interrupt or #TwoWirePlus_tick will continue the script.
+ * @note Only call from ISR or with interrupts disabled
+ */
+static void TwoWirePlus_executeScript(void)
+{
+  TwoWirePlus_Transaction_t *transaction = TwoWirePlus_transaction;
+  const uint8_t *instruction;
+  bool set;
+  for (;;)
+  {
+    instruction = &transaction->script[transaction->index];
+    switch (pgm_read_byte(instruction))
+    {
+      case TWOWIREPLUS_SEQ_OP_START:
+        /* SLA is sent once START was sent */
+        TwoWirePlus_requestStart();
+        return;
+      case TWOWIREPLUS_SEQ_OP_WRITE:
+        TWDR = pgm_read_byte(instruction + 1);
+        transaction->index += 2;
+        TWCR = TWOWIREPLUS_TWCR_SEND;
+        return;
+      case TWOWIREPLUS_SEQ_OP_WRITE_BYTES:
+        /* Bytes are streamed from flash, count keeps track of bytes already written */
+        if (TwoWirePlus_scriptCount < pgm_read_byte(instruction + 1))
+        {
+          TWDR = pgm_read_byte(instruction + 2 + TwoWirePlus_scriptCount);
+          TwoWirePlus_scriptCount++;
+          TWCR = TWOWIREPLUS_TWCR_SEND;
+          return;
+        }
+        transaction->index += 2 + TwoWirePlus_scriptCount;
+        TwoWirePlus_scriptCount = 0;
+        break;
+      case TWOWIREPLUS_SEQ_OP_WRITE_SLOT:
+        TWDR = transaction->rxData[pgm_read_byte(instruction + 1)];
+        transaction->index += 2;
+        TWCR = TWOWIREPLUS_TWCR_SEND;
+        return;
+      case TWOWIREPLUS_SEQ_OP_READ:
+        TwoWirePlus_scriptSlot = pgm_read_byte(instruction + 1);
+        TwoWirePlus_scriptCount = pgm_read_byte(instruction + 2);
+        transaction->index += 3;
+        TWCR = (TwoWirePlus_scriptCount > 1) ? TWOWIREPLUS_TWCR_ACK : TWOWIREPLUS_TWCR_NACK;
+        return;
+      case TWOWIREPLUS_SEQ_OP_JUMP_IF_SET:
+      case TWOWIREPLUS_SEQ_OP_JUMP_IF_CLEAR:
+        set = (transaction->rxData[pgm_read_byte(instruction + 1)] & pgm_read_byte(instruction + 2)) != 0;
+        if (set == (pgm_read_byte(instruction) == TWOWIREPLUS_SEQ_OP_JUMP_IF_SET))
+        {
+          transaction->index = pgm_read_byte(instruction + 3);
+        }
+        else
+        {
+          transaction->index += 4;
+        }
+        break;
+      case TWOWIREPLUS_SEQ_OP_DELAY:
+        transaction->delay = pgm_read_byte(instruction + 1);
+        transaction->index += 2;
+        if (transaction->delay == 0)
+        {
+          break;
+        }
+        /* Release bus for other transactions while waiting, TwoWirePlus_tick queues script again */
+        TwoWirePlus_finishTransaction(TWOWIREPLUS_TRANSACTION_BUSY);
+        return;
+      case TWOWIREPLUS_SEQ_OP_END:
+      default:
+        TwoWirePlus_finishTransaction(TWOWIREPLUS_TRANSACTION_DONE);
+        return;
+    }
+  }
+}
+
+/**
+ * Looks up device table entry
+ * @param address 7bit slave address
+ * @return Entry or NULL if device is not in table
+ */
+static TwoWirePlus_Device_t *TwoWirePlus_findDevice(uint8_t address)
+{
+  for (uint8_t i=0; i<TWOWIREPLUS_DEVICETABLE_SIZE; i++)
+  {
+    if ((TwoWirePlus_devices[i].address == address) && (address != 0))
+    {
+      return &TwoWirePlus_devices[i];
+    }
+  }
+  return NULL;
+}
+
+/**
+ * Records result of address phase in device table. Reserved addresses, i.e. general call and
+ * first byte of 10bit addresses, are ignored.
+ * @param address 7bit slave address
+ * @param ack true if SLA was ACKed
+ * @note Only call from ISR
+ */
+static void TwoWirePlus_updateDevice(uint8_t address, bool ack)
+{
+  TwoWirePlus_Device_t *device;
+
+  if ((address < TWOWIREPLUS_SCAN_FIRST) || (address > TWOWIREPLUS_SCAN_LAST))
+  {
+    return;
+  }
+  device = TwoWirePlus_findDevice(address);
+  if ((device == NULL) && ack)
+  {
+    /* Unused entries are never present */
+    for (uint8_t i=0; i<TWOWIREPLUS_DEVICETABLE_SIZE; i++)
+    {
+      if (!TwoWirePlus_devices[i].present)
+      {
+        device = &TwoWirePlus_devices[i];
+        device->address = address;
+        device->errors = 0;
+        break;
+      }
+    }
+  }
+  if (device == NULL)
+  {
+    return;
+  }
+  device->present = ack;
+  device->lastSeen = micros();
+  if (!ack && (device->errors < 0xff))
+  {
+    device->errors++;
+  }
+}
+
+/**
+ * Selects multiplexer channel of current transaction unless it's already selected. Channels of
+ * all other multiplexers are deselected first, i.e. exactly one channel is connected during a
+ * transaction and none if transaction's #TwoWirePlus_Transaction_t::mux is zero. Transaction
+ * stays queued until channels are set and starts with repeated START afterwards.
+ * @param status Two wire status
+ * @return false if channels are set and transaction can be started, true if status was processed
+ * @note Only call from ISR. A multiplexer which did not respond is written again ahead of next
+ * transaction, thus, transactions fail as long as it does not respond.
+ */
+static bool TwoWirePlus_selectMux(uint8_t status)
+{
+  TwoWirePlus_Transaction_t *transaction = TwoWirePlus_transaction;
+
+  switch(status)
+  {
+    case TW_START:
+    case TW_REP_START:
+      TwoWirePlus_muxIndex = 0;
+      while ((TwoWirePlus_muxIndex < TWOWIREPLUS_MUX_COUNT) && ((TwoWirePlus_muxSelected[TwoWirePlus_muxIndex] == 0) || (TWOWIREPLUS_MUX_ADDRESS(TwoWirePlus_muxIndex) == transaction->mux)))
+      {
+        TwoWirePlus_muxIndex++;
       }
-      else if (TwoWirePlus_bytesToReceive) /* Nothing more to send but something to receive */
+      TwoWirePlus_muxMask = 0;
+      if (TwoWirePlus_muxIndex == TWOWIREPLUS_MUX_COUNT)
       {
-        if (TwoWirePlus_bytesToReceive == 1) /* Just one byte to receive so we need to directly send NACK */
+        if ((transaction->mux == 0) || (TwoWirePlus_muxSelected[transaction->mux & (TWOWIREPLUS_MUX_COUNT - 1)] == _BV(transaction->channel)))
         {
-          TWCR = TWOWIREPLUS_TWCR_NACK;
+          return false;
         }
-        else 
+        TwoWirePlus_muxIndex = transaction->mux & (TWOWIREPLUS_MUX_COUNT - 1);
+        TwoWirePlus_muxMask = _BV(transaction->channel);
+      }
+      TWDR = (TWOWIREPLUS_MUX_ADDRESS(TwoWirePlus_muxIndex) << 1) | TW_WRITE;
+      TWCR = TWOWIREPLUS_TWCR_SEND;
+      break;
+    case TW_MT_SLA_ACK:
+      TWDR = TwoWirePlus_muxMask;
+      TWCR = TWOWIREPLUS_TWCR_SEND;
+      break;
+    case TW_MT_DATA_ACK:
+      TwoWirePlus_muxSelected[TwoWirePlus_muxIndex] = TwoWirePlus_muxMask;
+      TWCR = TWOWIREPLUS_TWCR_START;
+      break;
+    case TW_MT_ARB_LOST:
+      TwoWirePlus_arbitrationLosses++;
+      TWCR = TWOWIREPLUS_TWCR_START;
+      break;
+    default:
+      /* Multiplexer did not respond, selected channel is unknown now */
+      TwoWirePlus_muxSelected[TwoWirePlus_muxIndex] = 0xff;
+      TwoWirePlus_finishTransaction(TWOWIREPLUS_TRANSACTION_NACK);
+      break;
+  }
+  return true;
+}
+
+/**
+ * Processes master states of current bus scan. Each address is probed with SLA+W only, next
+ * address follows with repeated START.
+ * @param status Two wire status
+ * @note Only call from ISR
+ */
+static void TwoWirePlus_processScan(uint8_t status)
+{
+  TwoWirePlus_Transaction_t *transaction = TwoWirePlus_transaction;
+  uint8_t address = (uint8_t)transaction->address;
+
+  switch(status)
+  {
+    case TW_START:
+    case TW_REP_START:
+      transaction->state = TWOWIREPLUS_TRANSACTION_BUSY;
+      TWDR = (address << 1) | TW_WRITE;
+      TWCR = TWOWIREPLUS_TWCR_SEND;
+      break;
+    case TW_MT_SLA_ACK:
+      transaction->rxData[address >> 3] |= _BV(address & 0x07);
+      /* fall through */
+    case TW_MT_SLA_NACK:
+      if (address < TwoWirePlus_scanLast)
+      {
+        transaction->address++;
+        TWCR = TWOWIREPLUS_TWCR_START;
+      }
+      else
+      {
+        TwoWirePlus_finishTransaction(TWOWIREPLUS_TRANSACTION_DONE);
+      }
+      break;
+    case TW_MT_ARB_LOST:
+      /* Probe same address again as soon as bus is free */
+      TwoWirePlus_arbitrationLosses++;
+      TWCR = TWOWIREPLUS_TWCR_START;
+      break;
+    default:
+      TwoWirePlus_finishTransaction(TWOWIREPLUS_TRANSACTION_NACK);
+      break;
+  }
+}
+
+/**
+ * Processes master states of current micro-sequencer script.
+ * @param status Two wire status
+ * @note Only call from ISR
+ */
+static void TwoWirePlus_processScript(uint8_t status)
+{
+  TwoWirePlus_Transaction_t *transaction = TwoWirePlus_transaction;
+  switch(status)
+  {
+    case TW_START:
+    case TW_REP_START:
+      /* START is only requested by START instruction. Otherwise script was interrupted, e.g.
+       * because arbitration was lost while being addressed as slave, and is restarted */
+      if (pgm_read_byte(&transaction->script[transaction->index]) != TWOWIREPLUS_SEQ_OP_START)
+      {
+        transaction->index = 0;
+      }
+      TwoWirePlus_scriptCount = 0;
+      transaction->state = TWOWIREPLUS_TRANSACTION_BUSY;
+      TWDR = pgm_read_byte(&transaction->script[transaction->index + 1]);
+      transaction->index += 2;
+      TWCR = TWOWIREPLUS_TWCR_SEND;
+      break;
+    case TW_MR_DATA_ACK:
+    case TW_MR_DATA_NACK:
+      transaction->rxData[TwoWirePlus_scriptSlot++] = TWDR;
+      if (--TwoWirePlus_scriptCount)
+      {
+        /* NACK last byte */
+        TWCR = (TwoWirePlus_scriptCount > 1) ? TWOWIREPLUS_TWCR_ACK : TWOWIREPLUS_TWCR_NACK;
+        break;
+      }
+      /* fall through */
+    case TW_MT_SLA_ACK:
+    case TW_MT_DATA_ACK:
+    case TW_MR_SLA_ACK:
+      TwoWirePlus_executeScript();
+      break;
+    case TW_MT_ARB_LOST:
+      TwoWirePlus_arbitrationLosses++;
+      transaction->index = 0;
+      TwoWirePlus_scriptCount = 0;
+      TWCR = TWOWIREPLUS_TWCR_START;
+      break;
+    default:
+      TwoWirePlus_finishTransaction(TWOWIREPLUS_TRANSACTION_NACK);
+      break;
+  }
+}
+
+/**
+ * Processes master states of current queued transaction.
+ * @param status Two wire status
+ * @note Only call from ISR
+ */
+static void TwoWirePlus_processTransaction(uint8_t status)
+{
+  TwoWirePlus_Transaction_t *transaction = TwoWirePlus_transaction;
+  const uint8_t *txData = transaction->txData;
+  uint8_t txLength = transaction->txLength;
+  /* Timestamps first to keep latency constant. Last byte read is always NACKed. */
+  if (status == TW_MR_SLA_ACK)
+  {
+    transaction->rxStart = micros();
+  }
+  else if (status == TW_MR_DATA_NACK)
+  {
+    transaction->rxEnd = micros();
+  }
+  if (transaction->state == TWOWIREPLUS_TRANSACTION_QUEUED)
+  {
+    if (TwoWirePlus_selectMux(status))
+    {
+      return;
+    }
+    /* Channel is selected, transaction starts right away, maybe after repeated START */
+    status = TW_START;
+  }
+  if (transaction->script != NULL)
+  {
+    TwoWirePlus_processScript(status);
+    return;
+  }
+  if (transaction->flags & TWOWIREPLUS_TRANSACTION_FLAG_SCAN)
+  {
+    TwoWirePlus_processScan(status);
+    return;
+  }
+  switch(status)
+  {
+    case TW_START:
+      /* (Re-)start transaction from the beginning, e.g. after arbitration was lost. Reads
+       * from 10bit addresses always start with a write of the full address. */
+      TwoWirePlus_transactionPhase = ((transaction->txLength == 0) && (transaction->rxLength != 0) && !(transaction->address & TWOWIREPLUS_ADDRESS_10BIT_FLAG)) ? TWOWIREPLUS_PHASE_READ : TWOWIREPLUS_PHASE_WRITE;
+      transaction->state = TWOWIREPLUS_TRANSACTION_BUSY;
+      transaction->index = 0;
+      transaction->crc = (transaction->crcMode == TWOWIREPLUS_CRC_16) ? 0xffff : 0x0000;
+      TWDR = TwoWirePlus_sla(transaction->address, (TwoWirePlus_transactionPhase == TWOWIREPLUS_PHASE_READ) ? TW_READ : TW_WRITE);
+      TWCR = TWOWIREPLUS_TWCR_SEND;
+      TwoWirePlus_address10Pending = (transaction->address & TWOWIREPLUS_ADDRESS_10BIT_FLAG) && !(TWDR & TW_READ);
+      /* PEC covers address bytes as well */
+      if (transaction->crcMode == TWOWIREPLUS_CRC_PEC)
+      {
+        TwoWirePlus_crcAdd(transaction, TWDR);
+      }
+      break;
+    case TW_REP_START:
+      /* Repeated START switches from write to read part and from read part to write back */
+      TwoWirePlus_transactionPhase = (TwoWirePlus_transactionPhase == TWOWIREPLUS_PHASE_WRITE) ? TWOWIREPLUS_PHASE_READ : TWOWIREPLUS_PHASE_WRITEBACK;
+      transaction->index = 0;
+      TWDR = TwoWirePlus_sla(transaction->address, (TwoWirePlus_transactionPhase == TWOWIREPLUS_PHASE_READ) ? TW_READ : TW_WRITE);
+      TWCR = TWOWIREPLUS_TWCR_SEND;
+      TwoWirePlus_address10Pending = (transaction->address & TWOWIREPLUS_ADDRESS_10BIT_FLAG) && !(TWDR & TW_READ);
+      if (transaction->crcMode == TWOWIREPLUS_CRC_PEC)
+      {
+        TwoWirePlus_crcAdd(transaction, TWDR);
+      }
+      else if (transaction->crcMode == TWOWIREPLUS_CRC_16)
+      {
+        /* CRC-16 covers data read only, e.g. not the register address written before */
+        transaction->crc = 0xffff;
+      }
+      break;
+    case TW_MT_SLA_ACK:
+    case TW_MT_DATA_ACK:
+      if (TwoWirePlus_address10Pending)
+      {
+        /* Second address byte of 10bit address is acknowledged like data */
+        TwoWirePlus_address10Pending = false;
+        TWDR = (uint8_t)transaction->address;
+        TWCR = TWOWIREPLUS_TWCR_SEND;
+        if (transaction->crcMode == TWOWIREPLUS_CRC_PEC)
         {
-          TWCR = TWOWIREPLUS_TWCR_CLEAR;
+          TwoWirePlus_crcAdd(transaction, TWDR);
         }
+        break;
+      }
+      /* Write back first byte written and modified byte */
+      if (TwoWirePlus_transactionPhase == TWOWIREPLUS_PHASE_WRITEBACK)
+      {
+        txData = transaction->buffer;
+        txLength = 2;
+      }
+      if (transaction->index < txLength)
+      {
+        TWDR = txData[transaction->index++];
+        TWCR = TWOWIREPLUS_TWCR_SEND;
+        TwoWirePlus_crcAdd(transaction, TWDR);
+      }
+      else if ((TwoWirePlus_transactionPhase == TWOWIREPLUS_PHASE_WRITE) && transaction->rxLength)
+      {
+        TWCR = TWOWIREPLUS_TWCR_START;
+      }
+      else if (transaction->index < (txLength + TwoWirePlus_crcLength(transaction->crcMode)))
+      {
+        /* Append checksum, most significant byte first */
+        TWDR = (transaction->index++ == txLength) ? (uint8_t)(transaction->crc >> ((transaction->crcMode == TWOWIREPLUS_CRC_16) ? 8 : 0)) : (uint8_t)transaction->crc;
+        TWCR = TWOWIREPLUS_TWCR_SEND;
       }
-      else /* nothing else to do. Just clear interrupt and wait for more data or stop */
+      else
       {
-        TWCR = TWOWIREPLUS_TWCR_RELEASE;
+        TwoWirePlus_finishTransaction(TWOWIREPLUS_TRANSACTION_DONE);
       }
       break;
-    case TW_MR_DATA_NACK:
-      /* No need to change bytesToReceive here because we are the one who are sending this NACK */
     case TW_MR_DATA_ACK:
-      /* No check for buffer override done here because this would block the complete system */
-      if (TwoWirePlus_bytesToReceive)
+      transaction->rxData[transaction->index++] = TWDR;
+      TwoWirePlus_crcAdd(transaction, TWDR);
+      if ((transaction->index == 1) && (transaction->flags & TWOWIREPLUS_TRANSACTION_FLAG_BLOCK))
       {
-        /* Place data in buffer */
-        TwoWirePlus_rxRingBuffer.buffer[TwoWirePlus_rxRingBuffer.head] = TWDR;
-        TwoWirePlus_incrementIndex(TwoWirePlus_rxRingBuffer.head);
-        TwoWirePlus_rxRingBuffer.lastOperation = TWOWIREPLUS_LASTOPERATION_WRITE;
-        TwoWirePlus_bytesToReceive--;
+        /* Block read: Count byte decides on remaining bytes. First byte was ACKed, thus, at
+         * least one more byte is read. */
+        uint16_t length = (uint16_t)TWDR + 1 + TwoWirePlus_crcLength(transaction->crcMode);
+        if (length < 2)
+        {
+          length = 2;
+        }
+        if (length < transaction->rxLength)
+        {
+          transaction->rxLength = length;
+        }
       }
-      /* Is there more than one byte to be received left after this one */
-      if (TwoWirePlus_bytesToReceive > 1)
+      /* fall through */
+    case TW_MR_SLA_ACK:
+      /* NACK last byte */
+      if (transaction->index < (transaction->rxLength - 1))
       {
-        /* If yes, send ACK */
         TWCR = TWOWIREPLUS_TWCR_ACK;
       }
-      else if (TwoWirePlus_bytesToReceive == 1)
+      else
       {
-        /* Send NACK for last byte (and all following one) to stop reception */
         TWCR = TWOWIREPLUS_TWCR_NACK;
       }
-      else /* nothing else to do. Just clear interrupt and wait for more data or stop */
+      break;
+    case TW_MR_DATA_NACK:
+      transaction->rxData[transaction->index++] = TWDR;
+      TwoWirePlus_crcAdd(transaction, TWDR);
+      /* Checksum over data and received checksum is zero for both CRCs if data is valid */
+      if (transaction->crc != 0)
+      {
+        TwoWirePlus_finishTransaction(TWOWIREPLUS_TRANSACTION_CRC_ERROR);
+        break;
+      }
+      if (transaction->mask)
       {
-        TWCR = TWOWIREPLUS_TWCR_RELEASE;
+        /* Read-modify-write: Modify last byte read and write it back only if it changed */
+        uint8_t value = (TWDR & ~transaction->mask) | (transaction->value & transaction->mask);
+        if (value != TWDR)
+        {
+          transaction->buffer[0] = transaction->txData[0];
+          transaction->buffer[1] = value;
+          TWCR = TWOWIREPLUS_TWCR_START;
+          break;
+        }
       }
+      TwoWirePlus_finishTransaction(TWOWIREPLUS_TRANSACTION_DONE);
       break;
+    case TW_MT_ARB_LOST:
+      /* Another master won but did not address us. Retry as soon as bus is free */
+      TwoWirePlus_arbitrationLosses++;
+      TWCR = TWOWIREPLUS_TWCR_START;
+      break;
+    case TW_MT_SLA_NACK:
+    case TW_MT_DATA_NACK:
+    case TW_MR_SLA_NACK:
     default:
-      /* If something is not handled above clear at least INT and go on */
-      TWCR = TWOWIREPLUS_TWCR_CLEAR;
-    break;
+      TwoWirePlus_finishTransaction(TWOWIREPLUS_TRANSACTION_NACK);
+      break;
+  }
+}
+
+/**
+ * ISR for two wire interface TWI
+ * Only exchange between ISR and the class WirePlus are the two ring buffer.
+ * Initial trigger for Tx will be set in beginTransmit or write function. As long as data is
+ * available in txRingBuffer it will be written to TWDR.
+ * @note Writing a one to TWCR actually clears the corresponding bit
+ */
+ISR(TWI_vect)
+{
+#ifdef TWOWIREPLUS_DEBUG
+  PORTB = TW_STATUS>>2;
+  digitalWrite(4, HIGH);
+#endif
+  /* remember current status for application */
+  TwoWirePlus_status = TW_STATUS;
+  /* Address phase of any master transfer updates device table. TWDR still holds SLA sent. */
+  if ((TW_STATUS == TW_MT_SLA_ACK) || (TW_STATUS == TW_MR_SLA_ACK) || (TW_STATUS == TW_MT_SLA_NACK) || (TW_STATUS == TW_MR_SLA_NACK))
+  {
+    TwoWirePlus_updateDevice(TWDR >> 1, (TW_STATUS == TW_MT_SLA_ACK) || (TW_STATUS == TW_MR_SLA_ACK));
+  }
+  /* Master states of queued transactions are processed separately. Transaction waiting for
+   * START did not cause current event. */
+  if ((TwoWirePlus_transaction != NULL) && !TwoWirePlus_startPending && (TW_STATUS < TW_SR_SLA_ACK))
+  {
+    TwoWirePlus_processTransaction(TW_STATUS);
+  }
+  else
+  {
+    /* See why exactly interrupt was triggered */
+    switch(TW_STATUS)
+    {
+      /* Slave adress is just one of the bytes which is transefered. Thus, we will just sent one
+       * byte after each other after START, RE_START, ACK from the ring buffer. */
+      case TW_MR_SLA_NACK:
+        /* In case we sent NACK to two wire slave device there is nothing more to receive */
+        TwoWirePlus_bytesToReceive = 0;
+        /* fall through */
+      case TW_MT_SLA_ACK:
+      case TW_MR_SLA_ACK:
+      case TW_MT_SLA_NACK:
+      case TW_MT_DATA_NACK:
+      case TW_MT_DATA_ACK:
+        /* If ACK/NACK was received we've sent something earlier and therefore need to move read pointer */
+        if (TwoWirePlus_txSourceActive)
+        {
+          /* Byte was generated by transmit source, not taken from buffer */
+          TwoWirePlus_txSourceActive = TwoWirePlus_txSourceAvailable();
+        }
+        else
+        {
+          TwoWirePlus_incrementIndex(TwoWirePlus_txRingBuffer.tail);
+          TwoWirePlus_txRingBuffer.lastOperation = TWOWIREPLUS_LASTOPERATION_READ;
+        }
+        /* fall through */
+      case TW_START:
+      case TW_REP_START:
+        /* Process next byte in queue if there is one. Bytes from transmit source go first. */
+        if (TwoWirePlus_txSourceActive)
+        {
+          TWDR = TwoWirePlus_txSourceByte();
+          TWCR = TWOWIREPLUS_TWCR_CLEAR;
+        }
+        else if (! TwoWirePlus_RingBufferEmpty(TwoWirePlus_txRingBuffer) )
+        {
+          TWDR = TwoWirePlus_txRingBuffer.buffer[TwoWirePlus_txRingBuffer.tail];
+          TWCR = TWOWIREPLUS_TWCR_CLEAR;
+        }
+        else /* Nothing more to send but maybe something to receive */
+        {
+          TwoWirePlus_requestNextByte();
+        }
+        break;
+      case TW_MR_DATA_NACK:
+        /* No need to change bytesToReceive here because we are the one who are sending this NACK */
+      case TW_MR_DATA_ACK:
+        /* No check for buffer override needed here because reception is paused in
+         * TwoWirePlus_requestNextByte as long as buffer is full */
+        if (TwoWirePlus_bytesToReceive && (TwoWirePlus_pingPong[0] != NULL))
+        {
+          TwoWirePlus_storePingPong(TWDR);
+          TwoWirePlus_bytesToReceive--;
+        }
+        else if (TwoWirePlus_bytesToReceive)
+        {
+          /* Place data in buffer */
+          TwoWirePlus_rxRingBuffer.buffer[TwoWirePlus_rxRingBuffer.head] = TWDR;
+          TwoWirePlus_incrementIndex(TwoWirePlus_rxRingBuffer.head);
+          TwoWirePlus_rxRingBuffer.lastOperation = TWOWIREPLUS_LASTOPERATION_WRITE;
+          TwoWirePlus_bytesToReceive--;
+          if (TwoWirePlus_rxConsumer != NULL)
+          {
+            TwoWirePlus_consumeRx();
+          }
+        }
+        TwoWirePlus_requestNextByte();
+        break;
+      /* Slave receiver. For register file first byte is register pointer, then data follows.
+       * Without register file, frame is received into rx ring buffer */
+      case TW_SR_ARB_LOST_SLA_ACK:
+        /* Master transaction, if any, is restarted after slave transfer */
+        TwoWirePlus_arbitrationLosses++;
+        /* fall through */
+      case TW_SR_SLA_ACK:
+        TwoWirePlus_slaveActive = true;
+        if (TwoWirePlus_slaveRegisters != NULL)
+        {
+          TwoWirePlus_slaveExpectPointer = true;
+          TWCR = TWOWIREPLUS_TWCR_ACK;
+        }
+        else
+        {
+          TwoWirePlus_slaveFrameLength = 0;
+          TwoWirePlus_acceptSlaveByte();
+        }
+        break;
+      case TW_SR_DATA_ACK:
+        if (TwoWirePlus_slaveRegisters == NULL)
+        {
+          TwoWirePlus_rxRingBuffer.buffer[TwoWirePlus_rxRingBuffer.head] = TWDR;
+          TwoWirePlus_incrementIndex(TwoWirePlus_rxRingBuffer.head);
+          TwoWirePlus_rxRingBuffer.lastOperation = TWOWIREPLUS_LASTOPERATION_WRITE;
+          TwoWirePlus_slaveFrameLength++;
+          TwoWirePlus_acceptSlaveByte();
+          break;
+        }
+        if (TwoWirePlus_slaveExpectPointer)
+        {
+          TwoWirePlus_slaveRegisterPointer = TWDR;
+          TwoWirePlus_slaveExpectPointer = false;
+        }
+        else if (TwoWirePlus_slaveRegisterPointer < TwoWirePlus_slaveRegisterSize)
+        {
+          TwoWirePlus_slaveRegisters[TwoWirePlus_slaveRegisterPointer++] = TWDR;
+        }
+        /* NACK next byte if it would be written beyond register file */
+        if (TwoWirePlus_slaveRegisterPointer < TwoWirePlus_slaveRegisterSize)
+        {
+          TWCR = TWOWIREPLUS_TWCR_ACK;
+        }
+        else
+        {
+          TWCR = TWOWIREPLUS_TWCR_NACK;
+        }
+        break;
+      /* Slave transmitter. Data is sent directly from register file or pre-staged reply */
+      case TW_ST_ARB_LOST_SLA_ACK:
+        TwoWirePlus_arbitrationLosses++;
+        /* fall through */
+      case TW_ST_SLA_ACK:
+        TwoWirePlus_slaveActive = true;
+        if (TwoWirePlus_slaveRegisters == NULL)
+        {
+          /* Give application the chance to stage a reply, reply is sent from beginning */
+          if (TwoWirePlus_requestCallback != NULL)
+          {
+            TwoWirePlus_requestCallback();
+          }
+          TwoWirePlus_slaveRegisterPointer = 0;
+        }
+        /* fall through */
+      case TW_ST_DATA_ACK:
+        if (TwoWirePlus_slaveRegisters == NULL)
+        {
+          TWDR = (TwoWirePlus_slaveRegisterPointer < TwoWirePlus_slaveReplyLength) ? TwoWirePlus_slaveReply[TwoWirePlus_slaveRegisterPointer++] : 0xff;
+        }
+        else if (TwoWirePlus_slaveRegisterPointer < TwoWirePlus_slaveRegisterSize)
+        {
+          TWDR = TwoWirePlus_slaveRegisters[TwoWirePlus_slaveRegisterPointer++];
+        }
+        else
+        {
+          TWDR = 0xff;
+        }
+        TWCR = TWOWIREPLUS_TWCR_ACK;
+        break;
+      /* Slave transfer finished. Switch to not addressed slave mode but keep TWEA set to
+       * recognize own address again */
+      case TW_SR_DATA_NACK:
+        /* Byte was not accepted. STOP will not be reported anymore, thus frame ends here */
+        TwoWirePlus_slaveOverruns++;
+        /* fall through */
+      case TW_SR_STOP:
+        /* Record complete frame, there is always space because bytes are NACKed otherwise */
+        if ((TwoWirePlus_slaveRegisters == NULL) && TwoWirePlus_slaveFrameLength)
+        {
+          TwoWirePlus_slaveEvents.length[TwoWirePlus_slaveEvents.head & (TWOWIREPLUS_EVENTQUEUE_SIZE - 1)] = TwoWirePlus_slaveFrameLength;
+          TwoWirePlus_slaveEvents.head++;
+          TwoWirePlus_slaveFrameLength = 0;
+        }
+        /* fall through */
+      case TW_ST_DATA_NACK:
+      case TW_ST_LAST_DATA:
+        TwoWirePlus_slaveActive = false;
+        /* Start pending master transaction as soon as bus is free */
+        if (TwoWirePlus_transaction != NULL)
+        {
+          TWCR = TWOWIREPLUS_TWCR_START;
+        }
+        else
+        {
+          TWCR = TWOWIREPLUS_TWCR_ACK;
+        }
+        break;
+      default:
+        /* If something is not handled above clear at least INT and go on */
+        TWCR = TWOWIREPLUS_TWCR_CLEAR;
+      break;
+    }
+  }
+  /* START deferred by TwoWirePlus_enqueue, within slave transfer it's requested at its end */
+  if (TwoWirePlus_startPending)
+  {
+    TwoWirePlus_startPending = false;
+    if (!TwoWirePlus_slaveActive)
+    {
+      TwoWirePlus_requestStart();
+    }
   }
 #ifdef TWOWIREPLUS_DEBUG
   digitalWrite(4, LOW);
 #endif
+  /* Wake up waiting task */
+  if (TwoWirePlus_waiter->notify != NULL)
+  {
+    TwoWirePlus_waiter->notify();
+  }
 }
 
 /**
@@ -25,6 +25,21 @@
 #define TWOWIREPLUS_RINGBUFFER_SIZE      (uint8_t)32
 #endif
 
+#ifndef TWOWIREPLUS_EVENTQUEUE_SIZE
+/**
+ * Number of received slave frames which can be queued until application calls
+ * #TwoWirePlus::poll. Must be a power of two.
+ */
+#define TWOWIREPLUS_EVENTQUEUE_SIZE      (uint8_t)4
+#endif
+
+#ifndef TWOWIREPLUS_TXWINDOW_SIZE
+/**
+ * Number of bytes requested from generator of #TwoWirePlus::stream at once
+ */
+#define TWOWIREPLUS_TXWINDOW_SIZE        (uint8_t)8
+#endif
+
 #define TWOWIREPLUS_TWSR_TWPS_MASK       (_BV(TWPS1)|_BV(TWPS0))
 #define TWOWIREPLUS_TWSR_TWPS_1          0x00
 #define TWOWIREPLUS_TWSR_TWPS_4          0x01
@@ -44,9 +59,50 @@
 #define TWOWIREPLUS_TWCR_CLEAR           _BV(TWINT) | _BV(TWEA) | _BV(TWEN) | _BV(TWIE)
 #define TWOWIREPLUS_TWCR_SEND            _BV(TWINT) | _BV(TWEA) | _BV(TWEN) | _BV(TWIE)
 #define TWOWIREPLUS_TWCR_STOP            _BV(TWINT) | _BV(TWEA) | _BV(TWEN) | _BV(TWIE) | _BV(TWSTO);
+/* STOP followed by START as soon as the bus is free */
+#define TWOWIREPLUS_TWCR_STOP_START      _BV(TWINT) | _BV(TWEA) | _BV(TWEN) | _BV(TWIE) | _BV(TWSTO) | _BV(TWSTA)
 #define TWOWIREPLUS_TWCR_ACK             _BV(TWINT) | _BV(TWEA) | _BV(TWEN) | _BV(TWIE)
 #define TWOWIREPLUS_TWCR_NACK            _BV(TWINT) | _BV(TWEN) | _BV(TWIE)
 #define TWOWIREPLUS_TWCR_RELEASE         _BV(TWEA) | _BV(TWEN)
+/* TWINT is not cleared and interrupt disabled, SCL is held low until TWINT is cleared */
+#define TWOWIREPLUS_TWCR_STRETCH         _BV(TWEN)
+
+/*
+ * Micro-sequencer instructions, see #TwoWirePlus::run. Scripts are byte arrays, usually stored
+ * in PROGMEM, built with the TWOWIREPLUS_SEQ_xxx macros. Jump targets are absolute offsets in
+ * the script. Slots are bytes of the slot buffer passed to #TwoWirePlus::run.
+ */
+#define TWOWIREPLUS_SEQ_OP_END           0x00
+#define TWOWIREPLUS_SEQ_OP_START         0x01
+#define TWOWIREPLUS_SEQ_OP_WRITE         0x02
+#define TWOWIREPLUS_SEQ_OP_WRITE_SLOT    0x03
+#define TWOWIREPLUS_SEQ_OP_READ          0x04
+#define TWOWIREPLUS_SEQ_OP_JUMP_IF_SET   0x05
+#define TWOWIREPLUS_SEQ_OP_JUMP_IF_CLEAR 0x06
+#define TWOWIREPLUS_SEQ_OP_DELAY         0x07
+#define TWOWIREPLUS_SEQ_OP_WRITE_BYTES   0x08
+
+/* (Repeated) START followed by SLA+W, 2 bytes */
+#define TWOWIREPLUS_SEQ_START_WRITE(address)           TWOWIREPLUS_SEQ_OP_START, (uint8_t)((address) << 1)
+/* (Repeated) START followed by SLA+R, 2 bytes */
+#define TWOWIREPLUS_SEQ_START_READ(address)            TWOWIREPLUS_SEQ_OP_START, (uint8_t)(((address) << 1) | 0x01)
+/* Write literal byte, 2 bytes */
+#define TWOWIREPLUS_SEQ_WRITE(data)                    TWOWIREPLUS_SEQ_OP_WRITE, (uint8_t)(data)
+/* Write #count literal bytes following the instruction, 2 + #count bytes */
+#define TWOWIREPLUS_SEQ_WRITE_BYTES(count)             TWOWIREPLUS_SEQ_OP_WRITE_BYTES, (uint8_t)(count)
+/* Write content of slot, 2 bytes */
+#define TWOWIREPLUS_SEQ_WRITE_SLOT(slot)               TWOWIREPLUS_SEQ_OP_WRITE_SLOT, (uint8_t)(slot)
+/* Read #count (at least one) bytes into slots starting at #slot, last byte is NACKed, 3 bytes */
+#define TWOWIREPLUS_SEQ_READ(slot, count)              TWOWIREPLUS_SEQ_OP_READ, (uint8_t)(slot), (uint8_t)(count)
+/* Jump to #target if any bit of #mask is set in slot, 4 bytes */
+#define TWOWIREPLUS_SEQ_JUMP_IF_SET(slot, mask, target)   TWOWIREPLUS_SEQ_OP_JUMP_IF_SET, (uint8_t)(slot), (uint8_t)(mask), (uint8_t)(target)
+/* Jump to #target if all bits of #mask are clear in slot, 4 bytes */
+#define TWOWIREPLUS_SEQ_JUMP_IF_CLEAR(slot, mask, target) TWOWIREPLUS_SEQ_OP_JUMP_IF_CLEAR, (uint8_t)(slot), (uint8_t)(mask), (uint8_t)(target)
+/* Send STOP and continue after #ticks calls of #TwoWirePlus_tick, 2 bytes. Bus is used by other
+ * queued transactions meanwhile. Must be followed by a START or END instruction. */
+#define TWOWIREPLUS_SEQ_DELAY(ticks)                   TWOWIREPLUS_SEQ_OP_DELAY, (uint8_t)(ticks)
+/* Send STOP and finish script, 1 byte */
+#define TWOWIREPLUS_SEQ_END                            TWOWIREPLUS_SEQ_OP_END
 /*******************| Type definitions |*******************************/
 
 /**
@@ -81,6 +137,234 @@ typedef struct
 #define TwoWirePlus_RingBufferFull(x)          (x.lastOperation == TWOWIREPLUS_LASTOPERATION_WRITE && (x.head == x.tail))
 #define TwoWirePlus_RingBufferEmpty(x)         (x.lastOperation == TWOWIREPLUS_LASTOPERATION_READ && (x.head == x.tail))
 
+/**
+ * Number of bytes of one transfer. 16 bit wide to allow to stream more than 255 bytes
+ * with a single START/SLA+R.
+ */
+typedef uint16_t TwoWirePlus_ByteCount_t;
+#define TWOWIREPLUS_BYTECOUNT_MAX              (TwoWirePlus_ByteCount_t)0xffff
+
+/**
+ * Function called by blocking functions while waiting for two wire interface. Function is
+ * called with interrupts disabled and must enable them again before returning.
+ */
+typedef void (*TwoWirePlus_WaitHook_t)(void);
+
+/**
+ * Function called from ISR(TWI_vect) after each two wire event to wake up a waiting task
+ */
+typedef void (*TwoWirePlus_NotifyHook_t)(void);
+
+/**
+ * Wait/notify pair used whenever the driver would block. Wait function shall return latest
+ * after notify was called. As no TWI interrupt follows a STOP, wait function must not block
+ * on notify if #TwoWirePlus_InterruptExpected is false.
+ */
+typedef struct
+{
+  TwoWirePlus_WaitHook_t wait;           /*!< Called with interrupts disabled while driver blocks. Must enable interrupts again */
+  TwoWirePlus_NotifyHook_t notify;       /*!< Called from ISR(TWI_vect) after each two wire event. May be NULL */
+} TwoWirePlus_Waiter_t;
+
+/* True if a TWI interrupt will follow, i.e. TWI interrupt is enabled and no STOP is pending */
+#define TwoWirePlus_InterruptExpected()        ((TWCR & (_BV(TWIE) | _BV(TWSTO))) == _BV(TWIE))
+
+/**
+ * Queue of events for frames received as slave. Data of frames is stored in rx ring buffer,
+ * queue only keeps the length of each frame. Head is only written by ISR, tail only by
+ * application. Both are free running, thus, queue is full if they differ by
+ * #TWOWIREPLUS_EVENTQUEUE_SIZE.
+ */
+typedef struct
+{
+  uint8_t length[TWOWIREPLUS_EVENTQUEUE_SIZE];           /*!< Number of bytes of each received frame */
+  volatile uint8_t head;                                 /*!< Index of next event to be recorded */
+  volatile uint8_t tail;                                 /*!< Index of next event to be processed */
+} TwoWirePlus_EventQueue_t;
+
+#define TwoWirePlus_EventQueueFull(x)          ((uint8_t)(x.head - x.tail) == TWOWIREPLUS_EVENTQUEUE_SIZE)
+#define TwoWirePlus_EventQueueEmpty(x)         (x.head == x.tail)
+
+/**
+ * Function called by #TwoWirePlus::poll for each frame received as slave
+ */
+typedef void (*TwoWirePlus_ReceiveCallback_t)(uint8_t numberOfBytes);
+
+/**
+ * Function called in interrupt context when addressed as slave transmitter
+ */
+typedef void (*TwoWirePlus_RequestCallback_t)(void);
+
+/**
+ * Function called in interrupt context to generate bytes for #TwoWirePlus::stream.
+ * @param buffer Buffer to fill
+ * @param size Maximum number of bytes to place in #buffer
+ * @return Number of bytes placed in #buffer, zero ends the stream
+ */
+typedef uint8_t (*TwoWirePlus_GeneratorCallback_t)(uint8_t *buffer, uint8_t size);
+
+/**
+ * Function called in interrupt context with bytes received as master, see #TwoWirePlus::setConsumer.
+ * Bytes are consumed on return.
+ */
+typedef void (*TwoWirePlus_ConsumerCallback_t)(const uint8_t *data, uint8_t length);
+
+/**
+ * State of a queued master transaction. TWOWIREPLUS_TRANSACTION_INVALID is returned by helpers
+ * which refuse a request before queuing it, e.g. because it exceeds their buffer.
+ */
+typedef uint8_t TwoWirePlus_TransactionState_t;
+#define TWOWIREPLUS_TRANSACTION_QUEUED         0x00
+#define TWOWIREPLUS_TRANSACTION_BUSY           0x01
+#define TWOWIREPLUS_TRANSACTION_DONE           0x02
+#define TWOWIREPLUS_TRANSACTION_NACK           0x03
+#define TWOWIREPLUS_TRANSACTION_CRC_ERROR      0x04
+#define TWOWIREPLUS_TRANSACTION_INVALID        0x05
+
+/**
+ * Checksum calculated by ISR on bytes of a queued master transaction
+ * TWOWIREPLUS_CRC_PEC: SMBus packet error code, CRC-8 (polynomial 0x07) over all bytes including
+ *   address bytes
+ * TWOWIREPLUS_CRC_16: CRC-16/CCITT (polynomial 0x1021, initial value 0xffff) over data bytes
+ *   read or, without read part, written. Checksum is transferred most significant byte first.
+ * Checksum is appended to transactions without read part and checked on last byte(s) read
+ * otherwise. Thus, #rxLength includes checksum.
+ * TWOWIREPLUS_CRC_WORD: CRC-8 (polynomial 0x31, initial value 0xff) following each 2 byte word
+ *   read, e.g. Sensirion SHT3x/SCD30 sensors. All checksums are checked by ISR and stay in
+ *   #rxData, thus, #rxLength is a multiple of 3. Bytes written are sent unchanged, checksums of
+ *   command arguments are calculated with #TwoWirePlus_crc8Word.
+ */
+#define TWOWIREPLUS_CRC_NONE                   0x00
+#define TWOWIREPLUS_CRC_PEC                    0x01
+#define TWOWIREPLUS_CRC_16                     0x02
+#define TWOWIREPLUS_CRC_WORD                   0x03
+
+/**
+ * Options of a queued master transaction
+ * TWOWIREPLUS_TRANSACTION_FLAG_BLOCK: First byte read is number of bytes following (SMBus block
+ *   read). ISR reduces #rxLength accordingly, i.e. #rxLength is size of #rxData when queued and
+ *   number of bytes read when finished.
+ */
+#define TWOWIREPLUS_TRANSACTION_FLAG_BLOCK     0x01
+/**
+ * TWOWIREPLUS_TRANSACTION_FLAG_SCAN: Bus scan, see #TwoWirePlus::scan. Only address phase is
+ *   sent for #address up to last address passed to scan, presence is set in bitmap #rxData.
+ */
+#define TWOWIREPLUS_TRANSACTION_FLAG_SCAN      0x02
+/**
+ * TWOWIREPLUS_TRANSACTION_FLAG_REORDER: Transaction may overtake queued transactions and may be
+ *   overtaken itself to join transactions on the same multiplexer channel, see #mux.
+ */
+#define TWOWIREPLUS_TRANSACTION_FLAG_REORDER   0x04
+
+/**
+ * I2C multiplexers of TCA9548A/PCA9548 type, i.e. channels are selected by writing a bit mask of
+ * channels to the multiplexer. Up to eight multiplexers can be addressed at 0x70..0x77. All
+ * channels are assumed deselected at startup, i.e. reset multiplexers together with the MCU.
+ */
+#define TWOWIREPLUS_MUX_ADDRESS(index)         (uint8_t)(0x70 | (index))
+#define TWOWIREPLUS_MUX_COUNT                  8
+
+/**
+ * First and last 7bit address probed by #TwoWirePlus::scan by default, i.e. without reserved addresses
+ */
+#define TWOWIREPLUS_SCAN_FIRST                 0x08
+#define TWOWIREPLUS_SCAN_LAST                  0x77
+/**
+ * Highest 7bit address, #TwoWirePlus::scan doesn't probe beyond it
+ */
+#define TWOWIREPLUS_SCAN_MAX                   0x7f
+/**
+ * Size of presence bitmap, one bit for each 7bit address
+ */
+#define TWOWIREPLUS_SCAN_BITMAP_SIZE           16
+
+#ifndef TWOWIREPLUS_COALESCE_SIZE
+/**
+ * Maximum number of register bytes merged into one burst by #TwoWirePlus::writeRegisters
+ */
+#define TWOWIREPLUS_COALESCE_SIZE              16
+#endif
+
+#ifndef TWOWIREPLUS_COALESCE_BURSTS
+/**
+ * Number of bursts of #TwoWirePlus::writeRegisters which can be queued at the same time
+ */
+#define TWOWIREPLUS_COALESCE_BURSTS            2
+#endif
+
+#ifndef TWOWIREPLUS_DEVICETABLE_SIZE
+/**
+ * Number of devices whose presence is tracked by the driver, see #TwoWirePlus::isPresent
+ */
+#define TWOWIREPLUS_DEVICETABLE_SIZE           8
+#endif
+
+/**
+ * Addresses of queued master transactions. 10bit addresses are sent as 11110 A9 A8 R/W
+ * followed by A7..A0. Read part is addressed by repeated START and 11110 A9 A8 R only.
+ * General call addresses all devices accepting it, thus, it's only valid for writes.
+ */
+#define TWOWIREPLUS_ADDRESS_10BIT_FLAG         0x8000
+#define TWOWIREPLUS_ADDRESS_10BIT(address)     (uint16_t)(TWOWIREPLUS_ADDRESS_10BIT_FLAG | (address))
+#define TWOWIREPLUS_ADDRESS_GENERALCALL        0x00
+
+/**
+ * Master transaction descriptor. Transaction writes #txLength bytes after SLA+W and then, after
+ * a repeated START, reads #rxLength bytes after SLA+R. Either part can be empty. If #mask is not
+ * zero, bits in #mask of the last byte read are replaced by #value and, after another repeated
+ * START, first byte written and modified byte are written back (read-modify-write, see
+ * #TwoWirePlus::updateBits). Time of reception is captured by ISR in #rxStart and #rxEnd, thus,
+ * samples are timed independent of main loop latency. Descriptor is owned by application and
+ * must stay valid until transaction left the queue, i.e. state is #TWOWIREPLUS_TRANSACTION_DONE or
+ * any error state following it.
+ * If #mux is set, channel of multiplexer is selected ahead of transaction unless it's already
+ * selected. Channels of other multiplexers are deselected ahead of transaction, also if #mux is
+ * zero, thus, devices behind different multiplexers may share an address.
+ * Declare descriptors with #TWOWIREPLUS_TRANSACTION_INIT or set them up with
+ * #TwoWirePlus_transactionInit, thus, optional fields don't contain stale values.
+ */
+typedef struct TwoWirePlus_Transaction
+{
+  uint16_t address;                                      /*!< 7bit slave address or TWOWIREPLUS_ADDRESS_10BIT(address) */
+  const uint8_t *txData;                                 /*!< Bytes to be written */
+  uint8_t txLength;                                      /*!< Number of bytes to be written */
+  uint8_t *rxData;                                       /*!< Buffer for bytes to be read */
+  uint8_t rxLength;                                      /*!< Number of bytes to be read */
+  volatile TwoWirePlus_TransactionState_t state;         /*!< Set by driver, see TWOWIREPLUS_TRANSACTION_xxx */
+  uint8_t index;                                         /*!< Driver internal: Index of next byte to be written or read */
+  struct TwoWirePlus_Transaction *next;                  /*!< Driver internal: Next transaction in queue */
+  uint8_t mask;                                          /*!< Bits to be modified, zero if no write back is needed */
+  uint8_t value;                                         /*!< New value of bits in #mask */
+  uint8_t buffer[2];                                     /*!< Register and register value for #TwoWirePlus::updateBits */
+  const uint8_t *script;                                 /*!< Micro-sequencer script in PROGMEM, NULL for plain transaction */
+  uint8_t delay;                                         /*!< Driver internal: Ticks left of current DELAY instruction */
+  uint32_t rxStart;                                      /*!< Time (micros) SLA+R was acknowledged, captured by ISR */
+  uint32_t rxEnd;                                        /*!< Time (micros) last byte was received, captured by ISR */
+  uint8_t crcMode;                                       /*!< Checksum, see TWOWIREPLUS_CRC_xxx. Not used by scripts. */
+  uint16_t crc;                                          /*!< Driver internal: Checksum calculated so far */
+  uint8_t flags;                                         /*!< Options, see TWOWIREPLUS_TRANSACTION_FLAG_xxx */
+  uint8_t mux;                                           /*!< Multiplexer in front of device, TWOWIREPLUS_MUX_ADDRESS(index) or zero if directly connected. Scripts and scans always run with all channels deselected. */
+  uint8_t channel;                                       /*!< Multiplexer channel device is connected to */
+} TwoWirePlus_Transaction_t;
+
+/* Initializer of a plain write and/or read descriptor, optional fields are zero */
+#define TWOWIREPLUS_TRANSACTION_INIT(address, txData, txLength, rxData, rxLength) \
+  { (address), (txData), (uint8_t)(txLength), (rxData), (uint8_t)(rxLength) }
+
+/**
+ * Entry of device table. Updated by ISR from the address phase of every master transfer, i.e.
+ * presence is known without extra bus traffic. Devices are added when they ACK their address
+ * and replace entries of devices which are not present anymore if table is full.
+ */
+typedef struct
+{
+  uint8_t address;                                       /*!< 7bit slave address, zero if entry is unused */
+  bool present;                                          /*!< Last SLA was ACKed */
+  uint8_t errors;                                        /*!< Number of SLA NACKs, saturating */
+  uint32_t lastSeen;                                     /*!< Time (micros) of last SLA ACK or NACK, captured by ISR */
+} TwoWirePlus_Device_t;
+
 /**
  * Last status of two wire bus. This variable will reflect the content of TWSR and therefore
  */
@@ -88,10 +372,23 @@ typedef uint8_t TwoWirePlus_Status_t;
 
 
 /*******************| Global variables |*******************************/
+extern const TwoWirePlus_Waiter_t TwoWirePlus_spinWaiter;
+extern const TwoWirePlus_Waiter_t TwoWirePlus_idleSleepWaiter;
+extern const TwoWirePlus_Waiter_t TwoWirePlus_semaphoreWaiter;
 
 /*******************| Function prototypes |****************************/
 
 void printStatus();
+void TwoWirePlus_spinWait(void);
+void TwoWirePlus_idleSleep(void);
+void TwoWirePlus_semaphoreWait(void);
+void TwoWirePlus_semaphoreNotify(void);
+void TwoWirePlus_tick(void);
+uint8_t TwoWirePlus_crc8(uint8_t crc, uint8_t data);
+uint16_t TwoWirePlus_crc16(uint16_t crc, uint8_t data);
+uint8_t TwoWirePlus_crc8Word(uint8_t crc, uint8_t data);
+void TwoWirePlus_transactionInit(TwoWirePlus_Transaction_t *transaction, uint16_t address,
+    const uint8_t *txData, uint8_t txLength, uint8_t *rxData, uint8_t rxLength);
 
 class TwoWirePlus
 {
@@ -102,14 +399,50 @@ public:
   void begin();
   void beginTransmission(uint8_t address);
   void write(uint8_t data);
+  void write_P(const uint8_t *data, TwoWirePlus_ByteCount_t length);
+  void fill(uint8_t data, TwoWirePlus_ByteCount_t count);
+  void stream(TwoWirePlus_GeneratorCallback_t generator);
+  uint8_t reserveSpan(uint8_t **data);
+  void commit(uint8_t count);
   TwoWirePlus_Status_t endTransmission();
   void beginReception(uint8_t address);
-  uint8_t requestFrom(uint8_t address, uint8_t numberOfBytes);
-  void requestBytes(uint8_t numberOfBytes);
+  uint8_t requestFrom(uint8_t address, TwoWirePlus_ByteCount_t numberOfBytes);
+  bool requestBytes(TwoWirePlus_ByteCount_t numberOfBytes);
   uint8_t available();
   uint8_t read();
-  uint8_t getBytesToReceive();
+  uint8_t peekSpan(const uint8_t **data);
+  void consume(uint8_t count);
+  TwoWirePlus_ByteCount_t getBytesToReceive();
   void endReception();
+  void setConsumer(TwoWirePlus_ConsumerCallback_t callback, uint8_t watermark);
+  void beginPingPong(uint8_t *bufferA, uint8_t *bufferB, uint8_t length);
+  uint8_t *getFilledBuffer();
+  void releaseBuffer(uint8_t *buffer);
+  uint8_t getPingPongOverruns();
+  uint32_t getRxStretchTime();
+  void setWaiter(const TwoWirePlus_Waiter_t *waiter);
+  void setWaitHook(TwoWirePlus_WaitHook_t hook);
+  void beginSlave(uint8_t address, volatile uint8_t *registers, uint16_t size);
+  void beginSlave(uint8_t address);
+  void onReceive(TwoWirePlus_ReceiveCallback_t callback);
+  void onRequest(TwoWirePlus_RequestCallback_t callback);
+  void setReply(const uint8_t *data, uint8_t length);
+  uint8_t poll();
+  uint8_t getSlaveOverruns();
+  void queue(TwoWirePlus_Transaction_t *transaction);
+  TwoWirePlus_TransactionState_t waitFor(TwoWirePlus_Transaction_t *transaction);
+  uint8_t getArbitrationLosses();
+  uint8_t scan(uint8_t *bitmap);
+  uint8_t scan(uint8_t *bitmap, uint8_t first, uint8_t last);
+  bool isPresent(uint8_t address);
+  bool getDevice(uint8_t address, TwoWirePlus_Device_t *device);
+  bool revalidate(uint32_t maxAge);
+  void setCoalescing(uint8_t ticks);
+  bool writeRegisters(uint8_t address, uint8_t reg, const uint8_t *data, uint8_t length);
+  void flush();
+  void updateBits(TwoWirePlus_Transaction_t *transaction, uint8_t address, uint8_t reg, uint8_t mask, uint8_t value);
+  void run(TwoWirePlus_Transaction_t *transaction, const uint8_t *script, uint8_t *slots);
+  void run(TwoWirePlus_Transaction_t *transactions, const uint8_t * const *scripts, uint8_t count);
   TwoWirePlus_Status_t getStatus();
 };
 
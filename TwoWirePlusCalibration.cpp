@@ -0,0 +1,118 @@
+/** @ingroup TwoWirePlus
+ * @{
+ *
+ * @brief Read-only device blocks cached in internal EEPROM
+ *
+ * Calibration data of sensors like BMP280/BME280 never changes but is needed at every boot.
+ * Block is stored in internal EEPROM together with device address, chip ID, register and
+ * length. At next boot only the chip ID is read from the device:
+ *
+ *   Cache hit:  SLA+W | id register | SLA+R | chip ID | STOP, block from EEPROM
+ *   Cache miss: as above, then SLA+W | reg | SLA+R | block | STOP, block stored in EEPROM
+ *
+ * A record is only used if all keys match and the CRC-8 of the data is correct. Before a record
+ * is rewritten, its length is invalidated and the valid length is written last, i.e. it commits
+ * the record. Thus, a record torn by a reset or power loss is rejected regardless of its data.
+ * CRC-8 only detects corrupted cells with high probability, e.g. one of 256 random corruptions
+ * passes. Chip ID identifies the device model only, i.e. a device replaced by another unit of the
+ * same model hits the cache and gets the calibration of the old unit. Clear the record, e.g. by writing 0xff to its header, after replacing a device.
+ * EEPROM is written with eeprom_update_block, i.e. unchanged cells are not worn.
+ */
+
+/*******************| Inclusions |*************************************/
+#include "TwoWirePlusCalibration.h"
+#include <Arduino.h>
+#include <avr/eeprom.h>
+
+/*******************| Macros |*****************************************/
+
+/*******************| Type definitions |*******************************/
+
+/*******************| Global variables |*******************************/
+
+/*******************| Function prototypes |****************************/
+static uint8_t TwoWirePlusCalibration_crc(const uint8_t *data, uint8_t length);
+
+/*******************| Function Definition |****************************/
+
+/**
+ * Creates calibration cache
+ */
+TwoWirePlusCalibration::TwoWirePlusCalibration()
+{
+}
+
+/**
+ * Reads read-only block of device, from EEPROM if cached record is valid for the device found
+ * @param address 7bit slave address
+ * @param idRegister Register holding chip ID
+ * @param reg First register of block
+ * @param data Buffer for block
+ * @param length Number of bytes of block
+ * @param eeprom EEPROM address of record, #TWOWIREPLUSCALIBRATION_RECORD_SIZE(length) bytes
+ * @return #TWOWIREPLUS_TRANSACTION_DONE on success, state of failed transaction otherwise
+ */
+TwoWirePlus_TransactionState_t TwoWirePlusCalibration::read(uint8_t address, uint8_t idRegister, uint8_t reg, uint8_t *data, uint8_t length, uint16_t eeprom)
+{
+  uint8_t header[TWOWIREPLUSCALIBRATION_HEADER_SIZE];
+  uint8_t id;
+  TwoWirePlus_Transaction_t transaction = TWOWIREPLUS_TRANSACTION_INIT(address, &idRegister, 1, &id, 1);
+  TwoWirePlus_TransactionState_t state;
+
+  Wire.queue(&transaction);
+  state = Wire.waitFor(&transaction);
+  if (state != TWOWIREPLUS_TRANSACTION_DONE)
+  {
+    return state;
+  }
+  eeprom_read_block(header, (const void *)(uintptr_t)eeprom, sizeof(header));
+  if ((header[0] == address) && (header[1] == id) && (header[2] == reg) && (header[3] == length))
+  {
+    eeprom_read_block(data, (const void *)(uintptr_t)(eeprom + sizeof(header)), length);
+    if (TwoWirePlusCalibration_crc(data, length) == header[4])
+    {
+      return TWOWIREPLUS_TRANSACTION_DONE;
+    }
+  }
+
+  transaction.txData = &reg;
+  transaction.rxData = data;
+  transaction.rxLength = length;
+  Wire.queue(&transaction);
+  state = Wire.waitFor(&transaction);
+  if (state == TWOWIREPLUS_TRANSACTION_DONE)
+  {
+    /* Invalid length first, valid length last, a record interrupted while writing never matches */
+    if (header[3] == length)
+    {
+      eeprom_update_byte((uint8_t *)(uintptr_t)(eeprom + 3), (uint8_t)~length);
+    }
+    header[0] = address;
+    header[1] = id;
+    header[2] = reg;
+    header[4] = TwoWirePlusCalibration_crc(data, length);
+    eeprom_update_block(data, (void *)(uintptr_t)(eeprom + sizeof(header)), length);
+    eeprom_update_block(header, (void *)(uintptr_t)eeprom, 3);
+    eeprom_update_byte((uint8_t *)(uintptr_t)(eeprom + 4), header[4]);
+    eeprom_update_byte((uint8_t *)(uintptr_t)(eeprom + 3), length);
+  }
+  return state;
+}
+
+/**
+ * CRC-8 of record data
+ */
+static uint8_t TwoWirePlusCalibration_crc(const uint8_t *data, uint8_t length)
+{
+  uint8_t crc = 0;
+  for (uint8_t i=0; i<length; i++)
+  {
+    crc = TwoWirePlus_crc8(crc, data[i]);
+  }
+  return crc;
+}
+
+/*******************| Preinstantiate Objects |*************************/
+TwoWirePlusCalibration Calibration = TwoWirePlusCalibration();
+
+/** @}*/
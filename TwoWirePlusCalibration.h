@@ -0,0 +1,43 @@
+/** @ingroup TwoWirePlus
+ * @{
+ */
+#ifndef  TWOWIREPLUSCALIBRATION_H
+#define  TWOWIREPLUSCALIBRATION_H
+
+/*******************| Inclusions |*************************************/
+#include <stdint.h>
+#include "TwoWirePlus.h"
+
+/*******************| Macros |*****************************************/
+/**
+ * Record header in EEPROM: address, chip ID, register, length and CRC of data
+ */
+#define TWOWIREPLUSCALIBRATION_HEADER_SIZE          5
+
+/**
+ * EEPROM bytes used by a record of #length data bytes. Records of different blocks must not
+ * overlap.
+ */
+#define TWOWIREPLUSCALIBRATION_RECORD_SIZE(length)  (TWOWIREPLUSCALIBRATION_HEADER_SIZE + (length))
+
+/*******************| Type definitions |*******************************/
+
+/*******************| Global variables |*******************************/
+
+/*******************| Function prototypes |****************************/
+
+class TwoWirePlusCalibration
+{
+private:
+
+public:
+  TwoWirePlusCalibration();
+  TwoWirePlus_TransactionState_t read(uint8_t address, uint8_t idRegister, uint8_t reg, uint8_t *data, uint8_t length, uint16_t eeprom);
+};
+
+/*******************| Preinstantiate Objects |*************************/
+extern TwoWirePlusCalibration Calibration;
+
+#endif
+
+/** @}*/
@@ -0,0 +1,363 @@
+/** @ingroup TwoWirePlus
+ * @{
+ *
+ * @brief Streaming link layer on top of TwoWirePlus
+ *
+ * Moves frames from one MCU (sender, two wire master) to another one (receiver, two wire
+ * slave). Each frame is written with a single two wire transfer:
+ *
+ *   SLA+W | length | sequence | payload (length bytes) | CRC-8 | STOP
+ *
+ * CRC-8 (polynomial 0x07) covers length, sequence and payload. Receiver accepts every frame
+ * with valid length and CRC, gaps in the sequence numbers are counted as lost frames.
+ *
+ * Flow control is credit based. Sender reads a status from receiver:
+ *
+ *   SLA+R | expected sequence | credit limit | CRC-8 | STOP
+ *
+ * Sender may send frames as long as its sequence number has not reached the credit limit.
+ * Receiver moves the credit limit whenever frames were processed by application. Thus,
+ * status is only read if sender ran out of credits. Receiver grants #TWOWIREPLUSLINK_WINDOW
+ * frames, all of them fit into its rx ring buffer until they are polled.
+ *
+ * Sender streams payload through the tx ring buffer of #TwoWirePlus, i.e. transfer starts
+ * while application is still providing payload. Receiver copies payload from rx ring buffer
+ * directly to the buffer handed to the frame callback. No other copies are made.
+ *
+ * @note Frames are not retransmitted. Frames NACKed by receiver are reported to sender, frames
+ * dropped by receiver are counted (see #TwoWirePlusLink::getErrors and
+ * #TwoWirePlusLink::getLostFrames).
+ */
+
+/*******************| Inclusions |*************************************/
+#include "TwoWirePlusLink.h"
+#include <Arduino.h>
+#include <compat/twi.h>
+
+/*******************| Macros |*****************************************/
+static_assert(TWOWIREPLUSLINK_WINDOW * (TWOWIREPLUSLINK_MAXPAYLOAD + TWOWIREPLUSLINK_OVERHEAD) <= TWOWIREPLUS_RINGBUFFER_SIZE,
+    "Frames of window don't fit into rx ring buffer");
+static_assert(TWOWIREPLUSLINK_WINDOW <= TWOWIREPLUS_EVENTQUEUE_SIZE, "Frames of window don't fit into slave event queue");
+
+/*******************| Type definitions |*******************************/
+
+/*******************| Global variables |*******************************/
+/**
+ * Address of receiver frames are sent to
+ */
+static uint8_t TwoWirePlusLink_peer = 0;
+
+/**
+ * Sequence number of next frame to be sent
+ */
+static uint8_t TwoWirePlusLink_sequence = 0;
+
+/**
+ * First sequence number not granted by receiver
+ */
+static uint8_t TwoWirePlusLink_creditLimit = 0;
+
+/**
+ * Receiver state if this device acts as receiver
+ */
+static TwoWirePlusLink_Receiver_t TwoWirePlusLink_receiver;
+
+/**
+ * Callback for each valid frame received
+ */
+static TwoWirePlusLink_FrameCallback_t TwoWirePlusLink_callback = NULL;
+
+/**
+ * Status replied to sender. Two buffers are used because ISR might be sending the current one
+ * while application updates the status.
+ */
+static uint8_t TwoWirePlusLink_status[2][TWOWIREPLUSLINK_STATUS_SIZE];
+static uint8_t TwoWirePlusLink_statusIndex = 0;
+
+/*******************| Function prototypes |****************************/
+static void TwoWirePlusLink_onReceive(uint8_t numberOfBytes);
+static void TwoWirePlusLink_updateStatus(void);
+static bool TwoWirePlusLink_readStatus(uint8_t *status);
+
+/*******************| Function Definition |****************************/
+
+/**
+ * Initializes link module
+ */
+TwoWirePlusLink::TwoWirePlusLink(void)
+{
+}
+
+/**
+ * Starts receiving frames as two wire slave. Payload of each valid frame is passed to
+ * #callback when application calls #poll.
+ * @param address Own 7bit slave address
+ * @param buffer Buffer for payload, at least #TWOWIREPLUSLINK_MAXPAYLOAD bytes
+ * @param callback Function called for each valid frame
+ * @note Uses #TwoWirePlus::onReceive and #TwoWirePlus::setReply
+ */
+void TwoWirePlusLink::begin(uint8_t address, uint8_t *buffer, TwoWirePlusLink_FrameCallback_t callback)
+{
+  TwoWirePlusLink_receiverReset(&TwoWirePlusLink_receiver, buffer, TWOWIREPLUSLINK_WINDOW);
+  TwoWirePlusLink_callback = callback;
+  Wire.beginSlave(address);
+  Wire.onReceive(TwoWirePlusLink_onReceive);
+  TwoWirePlusLink_updateStatus();
+}
+
+/**
+ * Selects receiver frames are sent to and synchronizes sequence number and credits with it.
+ * @param peer 7bit slave address of receiver
+ * @return true if status of receiver could be read
+ * @note This function is blocking. Do not call in interrupt context.
+ */
+bool TwoWirePlusLink::connect(uint8_t peer)
+{
+  uint8_t status[TWOWIREPLUSLINK_STATUS_SIZE];
+  TwoWirePlusLink_peer = peer;
+  if (!TwoWirePlusLink_readStatus(status))
+  {
+    /* No credits until status could be read */
+    TwoWirePlusLink_creditLimit = TwoWirePlusLink_sequence;
+    return false;
+  }
+  TwoWirePlusLink_sequence = status[0];
+  TwoWirePlusLink_creditLimit = status[1];
+  return true;
+}
+
+/**
+ * Sends one frame to receiver selected by #connect. If no credits are left, status of receiver
+ * is read first.
+ * @param payload Payload to be sent
+ * @param length Number of payload bytes, up to #TWOWIREPLUSLINK_MAXPAYLOAD
+ * @return true if frame was sent, false if payload is too long, receiver did not grant credits
+ * or frame was NACKed. Frame can be sent again in this case.
+ * @note This function is blocking. Do not call in interrupt context.
+ */
+bool TwoWirePlusLink::send(const uint8_t *payload, uint8_t length)
+{
+  uint8_t status[TWOWIREPLUSLINK_STATUS_SIZE];
+  uint8_t crc;
+  if (length > TWOWIREPLUSLINK_MAXPAYLOAD)
+  {
+    return false;
+  }
+  /* Read status of receiver only if all credits are used */
+  if (TwoWirePlusLink_sequence == TwoWirePlusLink_creditLimit)
+  {
+    if (!TwoWirePlusLink_readStatus(status) || (status[1] == TwoWirePlusLink_sequence))
+    {
+      return false;
+    }
+    TwoWirePlusLink_creditLimit = status[1];
+  }
+  Wire.beginTransmission(TwoWirePlusLink_peer);
+  Wire.write(length);
+  crc = TwoWirePlusLink_crc8(0, length);
+  Wire.write(TwoWirePlusLink_sequence);
+  crc = TwoWirePlusLink_crc8(crc, TwoWirePlusLink_sequence);
+  /* Payload is sent by ISR while CRC is calculated */
+  for (uint8_t i=0; i<length; i++)
+  {
+    Wire.write(payload[i]);
+    crc = TwoWirePlusLink_crc8(crc, payload[i]);
+  }
+  Wire.write(crc);
+  if (Wire.endTransmission() != TW_MT_DATA_ACK)
+  {
+    return false;
+  }
+  TwoWirePlusLink_sequence++;
+  return true;
+}
+
+/**
+ * Returns number of frames which can be sent without reading status of receiver
+ * @return Number of credits left
+ */
+uint8_t TwoWirePlusLink::getCredits()
+{
+  return (uint8_t)(TwoWirePlusLink_creditLimit - TwoWirePlusLink_sequence);
+}
+
+/**
+ * Processes all frames received since last call and grants new credits to sender
+ * @return Number of frames processed
+ */
+uint8_t TwoWirePlusLink::poll()
+{
+  uint8_t frames = Wire.poll();
+  if (frames)
+  {
+    TwoWirePlusLink_updateStatus();
+  }
+  return frames;
+}
+
+/**
+ * Returns number of frames missing in sequence of received frames
+ * @return Number of lost frames since #begin
+ */
+uint8_t TwoWirePlusLink::getLostFrames()
+{
+  return TwoWirePlusLink_receiver.lost;
+}
+
+/**
+ * Returns number of received frames dropped because of length or CRC error
+ * @return Number of errors since #begin
+ */
+uint8_t TwoWirePlusLink::getErrors()
+{
+  return TwoWirePlusLink_receiver.errors;
+}
+
+/**
+ * Updates CRC-8 (polynomial 0x07, initial value 0x00) by one byte. CRC over data followed by
+ * its CRC is zero.
+ * @param crc CRC so far
+ * @param data Next byte
+ * @return Updated CRC
+ */
+uint8_t TwoWirePlusLink_crc8(uint8_t crc, uint8_t data)
+{
+  return TwoWirePlus_crc8(crc, data);
+}
+
+/**
+ * Resets receiver state
+ * @param receiver Receiver to be reset
+ * @param buffer Buffer for payload, at least #TWOWIREPLUSLINK_MAXPAYLOAD bytes
+ * @param window Number of frames granted to sender
+ */
+void TwoWirePlusLink_receiverReset(TwoWirePlusLink_Receiver_t *receiver, uint8_t *buffer, uint8_t window)
+{
+  receiver->buffer = buffer;
+  receiver->index = 0;
+  receiver->length = 0;
+  receiver->sequence = 0;
+  receiver->crc = 0;
+  receiver->expected = 0;
+  receiver->window = window;
+  receiver->lost = 0;
+  receiver->errors = 0;
+}
+
+/**
+ * Passes next byte of current frame to receiver
+ * @param receiver Receiver
+ * @param data Next byte of frame
+ */
+void TwoWirePlusLink_receiverPut(TwoWirePlusLink_Receiver_t *receiver, uint8_t data)
+{
+  uint8_t index = receiver->index;
+  /* CRC is included, thus, CRC of valid frame is zero */
+  receiver->crc = TwoWirePlusLink_crc8(receiver->crc, data);
+  if (index == 0)
+  {
+    receiver->length = data;
+  }
+  else if (index == 1)
+  {
+    receiver->sequence = data;
+  }
+  else if (((uint8_t)(index - 2) < receiver->length) && ((uint8_t)(index - 2) < TWOWIREPLUSLINK_MAXPAYLOAD))
+  {
+    receiver->buffer[index - 2] = data;
+  }
+  if (index < 0xff)
+  {
+    receiver->index = index + 1;
+  }
+}
+
+/**
+ * Ends current frame and checks it
+ * @param receiver Receiver
+ * @return true if frame is valid. Payload is in buffer of #receiver in this case.
+ */
+bool TwoWirePlusLink_receiverEnd(TwoWirePlusLink_Receiver_t *receiver)
+{
+  bool valid = (receiver->length <= TWOWIREPLUSLINK_MAXPAYLOAD) &&
+               (receiver->index == (receiver->length + TWOWIREPLUSLINK_OVERHEAD)) &&
+               (receiver->crc == 0);
+  if (valid)
+  {
+    receiver->lost += (uint8_t)(receiver->sequence - receiver->expected);
+    receiver->expected = receiver->sequence + 1;
+  }
+  else if (receiver->index)
+  {
+    receiver->errors++;
+  }
+  receiver->index = 0;
+  receiver->crc = 0;
+  return valid;
+}
+
+/**
+ * Builds status to be read by sender
+ * @param receiver Receiver
+ * @param status Buffer for #TWOWIREPLUSLINK_STATUS_SIZE bytes
+ */
+void TwoWirePlusLink_receiverStatus(const TwoWirePlusLink_Receiver_t *receiver, uint8_t *status)
+{
+  status[0] = receiver->expected;
+  status[1] = receiver->expected + receiver->window;
+  status[2] = TwoWirePlusLink_crc8(TwoWirePlusLink_crc8(0, status[0]), status[1]);
+}
+
+/**
+ * Feeds frame received as slave into receiver. Called by #TwoWirePlus::poll.
+ * @param numberOfBytes Number of bytes of frame
+ */
+static void TwoWirePlusLink_onReceive(uint8_t numberOfBytes)
+{
+  while (numberOfBytes--)
+  {
+    TwoWirePlusLink_receiverPut(&TwoWirePlusLink_receiver, Wire.read());
+  }
+  if (TwoWirePlusLink_receiverEnd(&TwoWirePlusLink_receiver) && (TwoWirePlusLink_callback != NULL))
+  {
+    TwoWirePlusLink_callback(TwoWirePlusLink_receiver.buffer, TwoWirePlusLink_receiver.length);
+  }
+}
+
+/**
+ * Stages current receiver status as slave reply
+ */
+static void TwoWirePlusLink_updateStatus(void)
+{
+  TwoWirePlusLink_statusIndex ^= 1;
+  TwoWirePlusLink_receiverStatus(&TwoWirePlusLink_receiver, TwoWirePlusLink_status[TwoWirePlusLink_statusIndex]);
+  Wire.setReply(TwoWirePlusLink_status[TwoWirePlusLink_statusIndex], TWOWIREPLUSLINK_STATUS_SIZE);
+}
+
+/**
+ * Reads status of receiver. Status is read by a queued transaction, thus, rx ring buffer is
+ * not touched and might still hold frames received as slave.
+ * @param status Buffer for #TWOWIREPLUSLINK_STATUS_SIZE bytes
+ * @return true if status is valid
+ */
+static bool TwoWirePlusLink_readStatus(uint8_t *status)
+{
+  TwoWirePlus_Transaction_t transaction = TWOWIREPLUS_TRANSACTION_INIT(TwoWirePlusLink_peer, NULL, 0, status, TWOWIREPLUSLINK_STATUS_SIZE);
+  uint8_t crc = 0;
+
+  Wire.queue(&transaction);
+  if (Wire.waitFor(&transaction) != TWOWIREPLUS_TRANSACTION_DONE)
+  {
+    return false;
+  }
+  for (uint8_t i=0; i<TWOWIREPLUSLINK_STATUS_SIZE; i++)
+  {
+    crc = TwoWirePlusLink_crc8(crc, status[i]);
+  }
+  return (crc == 0);
+}
+
+/*******************| Preinstantiate Objects |*************************/
+TwoWirePlusLink Link = TwoWirePlusLink();
+
+/** @}*/
@@ -0,0 +1,93 @@
+/** @ingroup TwoWirePlus
+ * @{
+ */
+#ifndef  TWOWIREPLUSLINK_H
+#define  TWOWIREPLUSLINK_H
+
+/*******************| Inclusions |*************************************/
+#include <stdint.h>
+#include "TwoWirePlus.h"
+
+/*******************| Macros |*****************************************/
+/**
+ * Link frame overhead: length, sequence number and CRC
+ */
+#define TWOWIREPLUSLINK_OVERHEAD         3
+
+#ifndef TWOWIREPLUSLINK_WINDOW
+/**
+ * Number of frames a receiving #TwoWirePlusLink grants to the sender until frames were
+ * processed by #TwoWirePlusLink::poll, i.e. sender streams this many frames without waiting
+ * for the receiver. At most #TWOWIREPLUS_EVENTQUEUE_SIZE.
+ */
+#define TWOWIREPLUSLINK_WINDOW           2
+#endif
+
+#ifndef TWOWIREPLUSLINK_MAXPAYLOAD
+/**
+ * Maximum number of payload bytes of one frame. Receiver keeps all frames of the window in the
+ * rx ring buffer of #TwoWirePlus until they are polled, thus, default splits the ring buffer
+ * into #TWOWIREPLUSLINK_WINDOW frames. Increase TWOWIREPLUS_RINGBUFFER_SIZE for larger frames.
+ */
+#define TWOWIREPLUSLINK_MAXPAYLOAD       (uint8_t)(TWOWIREPLUS_RINGBUFFER_SIZE / TWOWIREPLUSLINK_WINDOW - TWOWIREPLUSLINK_OVERHEAD)
+#endif
+
+/**
+ * Size of status read by sender from receiver: expected sequence number, credit limit and CRC
+ */
+#define TWOWIREPLUSLINK_STATUS_SIZE      3
+
+/*******************| Type definitions |*******************************/
+
+/**
+ * Function called by #TwoWirePlusLink::poll for each valid frame received
+ */
+typedef void (*TwoWirePlusLink_FrameCallback_t)(const uint8_t *payload, uint8_t length);
+
+/**
+ * Receiver state of a link endpoint. Frames are passed byte by byte, thus, payload is copied
+ * only once from wherever it was received to #buffer.
+ */
+typedef struct
+{
+  uint8_t *buffer;               /*!< Payload of current frame, #TWOWIREPLUSLINK_MAXPAYLOAD bytes */
+  uint8_t index;                 /*!< Number of bytes of current frame received so far */
+  uint8_t length;                /*!< Payload length of current frame */
+  uint8_t sequence;              /*!< Sequence number of current frame */
+  uint8_t crc;                   /*!< CRC over all bytes of current frame received so far */
+  uint8_t expected;              /*!< Sequence number of next frame expected */
+  uint8_t window;                /*!< Number of frames granted beyond #expected */
+  uint8_t lost;                  /*!< Number of frames missing in sequence */
+  uint8_t errors;                /*!< Number of frames dropped because of length or CRC errors */
+} TwoWirePlusLink_Receiver_t;
+
+/*******************| Global variables |*******************************/
+
+/*******************| Function prototypes |****************************/
+uint8_t TwoWirePlusLink_crc8(uint8_t crc, uint8_t data);
+void TwoWirePlusLink_receiverReset(TwoWirePlusLink_Receiver_t *receiver, uint8_t *buffer, uint8_t window);
+void TwoWirePlusLink_receiverPut(TwoWirePlusLink_Receiver_t *receiver, uint8_t data);
+bool TwoWirePlusLink_receiverEnd(TwoWirePlusLink_Receiver_t *receiver);
+void TwoWirePlusLink_receiverStatus(const TwoWirePlusLink_Receiver_t *receiver, uint8_t *status);
+
+class TwoWirePlusLink
+{
+private:
+
+public:
+  TwoWirePlusLink();
+  void begin(uint8_t address, uint8_t *buffer, TwoWirePlusLink_FrameCallback_t callback);
+  bool connect(uint8_t peer);
+  bool send(const uint8_t *payload, uint8_t length);
+  uint8_t getCredits();
+  uint8_t poll();
+  uint8_t getLostFrames();
+  uint8_t getErrors();
+};
+
+/*******************| Preinstantiate Objects |*************************/
+extern TwoWirePlusLink Link;
+
+#endif
+
+/** @}*/
@@ -0,0 +1,177 @@
+/** @ingroup TwoWirePlus
+ * @{
+ *
+ * @brief SMBus protocols on top of TwoWirePlus
+ *
+ * Each protocol is a single queued master transaction of #TwoWirePlus, thus, it can be used
+ * while acting as slave and does not touch the ring buffers:
+ *
+ *   Quick command:  SLA+W/R | STOP
+ *   Block write:    SLA+W | command | count | data (count bytes) | [PEC] | STOP
+ *   Block read:     SLA+W | command | SLA+R | count | data (count bytes) | [PEC] | STOP
+ *   Process call:   SLA+W | command | low | high | SLA+R | low | high | [PEC] | STOP
+ *   Alert response: SLA+R (0x0c) | device address | [PEC] | STOP
+ *
+ * Count byte of a block read is evaluated by ISR, i.e. reception length is adjusted while
+ * the transfer is running. Packet error code (PEC) is appended and checked by ISR if enabled
+ * with #TwoWirePlusSMBus::setPec.
+ */
+
+/*******************| Inclusions |*************************************/
+#include "TwoWirePlusSMBus.h"
+#include <Arduino.h>
+#include <string.h>
+
+/*******************| Macros |*****************************************/
+
+/*******************| Type definitions |*******************************/
+
+/*******************| Global variables |*******************************/
+/**
+ * True if packet error code is used
+ */
+static bool TwoWirePlusSMBus_pec = false;
+
+/**
+ * Transfer buffer: command, count and block data or count, block data and PEC
+ */
+static uint8_t TwoWirePlusSMBus_buffer[TWOWIREPLUSSMBUS_BLOCK_MAX + 2];
+
+/*******************| Function prototypes |****************************/
+static TwoWirePlus_TransactionState_t TwoWirePlusSMBus_transfer(TwoWirePlus_Transaction_t *transaction);
+
+/*******************| Function Definition |****************************/
+
+/**
+ * Creates SMBus layer
+ */
+TwoWirePlusSMBus::TwoWirePlusSMBus()
+{
+}
+
+/**
+ * Enables or disables packet error code for all following protocols except quick command
+ * @param enable true to append and check PEC
+ */
+void TwoWirePlusSMBus::setPec(bool enable)
+{
+  TwoWirePlusSMBus_pec = enable;
+}
+
+/**
+ * Sends quick command, i.e. the read/write bit of the address byte is the only data.
+ * @param address 7bit slave address
+ * @param bit 0 for SLA+W, 1 for SLA+R
+ * @return #TWOWIREPLUS_TRANSACTION_DONE if device acknowledged its address
+ * @note Two wire module can't send STOP directly after SLA+R was acknowledged. Thus, one byte
+ * is read and NACKed, which releases the bus as well.
+ */
+TwoWirePlus_TransactionState_t TwoWirePlusSMBus::quickCommand(uint8_t address, uint8_t bit)
+{
+  uint8_t dummy;
+  TwoWirePlus_Transaction_t transaction = TWOWIREPLUS_TRANSACTION_INIT(address, NULL, 0, &dummy, bit ? 1 : 0);
+  Wire.queue(&transaction);
+  return Wire.waitFor(&transaction);
+}
+
+/**
+ * Writes block of data preceded by its length
+ * @param address 7bit slave address
+ * @param command Command code
+ * @param data Data to write
+ * @param length Number of bytes, at most #TWOWIREPLUSSMBUS_BLOCK_MAX
+ * @return #TWOWIREPLUS_TRANSACTION_DONE on success, #TWOWIREPLUS_TRANSACTION_INVALID without bus
+ * access if #length is too large
+ */
+TwoWirePlus_TransactionState_t TwoWirePlusSMBus::blockWrite(uint8_t address, uint8_t command, const uint8_t *data, uint8_t length)
+{
+  if (length > TWOWIREPLUSSMBUS_BLOCK_MAX)
+  {
+    return TWOWIREPLUS_TRANSACTION_INVALID;
+  }
+  TwoWirePlus_Transaction_t transaction = TWOWIREPLUS_TRANSACTION_INIT(address, TwoWirePlusSMBus_buffer, length + 2, NULL, 0);
+  TwoWirePlusSMBus_buffer[0] = command;
+  TwoWirePlusSMBus_buffer[1] = length;
+  memcpy(&TwoWirePlusSMBus_buffer[2], data, length);
+  return TwoWirePlusSMBus_transfer(&transaction);
+}
+
+/**
+ * Reads block of data with a single transfer. Number of bytes is sent by device in front of
+ * the data and evaluated by ISR.
+ * @param address 7bit slave address
+ * @param command Command code
+ * @param data Buffer for data
+ * @param length Size of #data on call, number of bytes read on return
+ * @return #TWOWIREPLUS_TRANSACTION_DONE on success. If device sent more bytes than #data can
+ * hold, data is truncated and PEC, if enabled, results in #TWOWIREPLUS_TRANSACTION_CRC_ERROR.
+ */
+TwoWirePlus_TransactionState_t TwoWirePlusSMBus::blockRead(uint8_t address, uint8_t command, uint8_t *data, uint8_t *length)
+{
+  uint8_t size = (*length < TWOWIREPLUSSMBUS_BLOCK_MAX) ? *length : TWOWIREPLUSSMBUS_BLOCK_MAX;
+  TwoWirePlus_Transaction_t transaction = TWOWIREPLUS_TRANSACTION_INIT(address, &command, 1, TwoWirePlusSMBus_buffer, size + 1 + (TwoWirePlusSMBus_pec ? 1 : 0));
+  TwoWirePlus_TransactionState_t state;
+  transaction.flags = TWOWIREPLUS_TRANSACTION_FLAG_BLOCK;
+  state = TwoWirePlusSMBus_transfer(&transaction);
+  *length = 0;
+  if (state == TWOWIREPLUS_TRANSACTION_DONE)
+  {
+    *length = (TwoWirePlusSMBus_buffer[0] < size) ? TwoWirePlusSMBus_buffer[0] : size;
+    memcpy(data, &TwoWirePlusSMBus_buffer[1], *length);
+  }
+  return state;
+}
+
+/**
+ * Writes 16bit value and reads 16bit result with a single transfer, both least significant
+ * byte first
+ * @param address 7bit slave address
+ * @param command Command code
+ * @param value Value to write on call, result on return
+ * @return #TWOWIREPLUS_TRANSACTION_DONE on success
+ */
+TwoWirePlus_TransactionState_t TwoWirePlusSMBus::processCall(uint8_t address, uint8_t command, uint16_t *value)
+{
+  uint8_t request[3] = {command, (uint8_t)(*value & 0xff), (uint8_t)(*value >> 8)};
+  TwoWirePlus_Transaction_t transaction = TWOWIREPLUS_TRANSACTION_INIT(address, request, sizeof(request), TwoWirePlusSMBus_buffer, 2 + (TwoWirePlusSMBus_pec ? 1 : 0));
+  TwoWirePlus_TransactionState_t state = TwoWirePlusSMBus_transfer(&transaction);
+  if (state == TWOWIREPLUS_TRANSACTION_DONE)
+  {
+    *value = TwoWirePlusSMBus_buffer[0] | ((uint16_t)TwoWirePlusSMBus_buffer[1] << 8);
+  }
+  return state;
+}
+
+/**
+ * Services SMBALERT#: Reads alert response address. Device asserting SMBALERT# with lowest
+ * address answers with its address and releases SMBALERT#. Call repeatedly as long as
+ * SMBALERT# is asserted.
+ * @param address Address of alerting device (7bit)
+ * @return #TWOWIREPLUS_TRANSACTION_DONE if a device answered, #TWOWIREPLUS_TRANSACTION_NACK
+ * if no device is alerting
+ */
+TwoWirePlus_TransactionState_t TwoWirePlusSMBus::alertResponse(uint8_t *address)
+{
+  TwoWirePlus_Transaction_t transaction = TWOWIREPLUS_TRANSACTION_INIT(TWOWIREPLUSSMBUS_ALERT_ADDRESS, NULL, 0, TwoWirePlusSMBus_buffer, 1 + (TwoWirePlusSMBus_pec ? 1 : 0));
+  TwoWirePlus_TransactionState_t state = TwoWirePlusSMBus_transfer(&transaction);
+  if (state == TWOWIREPLUS_TRANSACTION_DONE)
+  {
+    *address = TwoWirePlusSMBus_buffer[0] >> 1;
+  }
+  return state;
+}
+
+/**
+ * Runs transaction with PEC as configured and waits until it finished
+ */
+static TwoWirePlus_TransactionState_t TwoWirePlusSMBus_transfer(TwoWirePlus_Transaction_t *transaction)
+{
+  transaction->crcMode = TwoWirePlusSMBus_pec ? TWOWIREPLUS_CRC_PEC : TWOWIREPLUS_CRC_NONE;
+  Wire.queue(transaction);
+  return Wire.waitFor(transaction);
+}
+
+/*******************| Preinstantiate Objects |*************************/
+TwoWirePlusSMBus SMBus = TwoWirePlusSMBus();
+
+/** @}*/
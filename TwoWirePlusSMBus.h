@@ -0,0 +1,47 @@
+/** @ingroup TwoWirePlus
+ * @{
+ */
+#ifndef  TWOWIREPLUSSMBUS_H
+#define  TWOWIREPLUSSMBUS_H
+
+/*******************| Inclusions |*************************************/
+#include <stdint.h>
+#include "TwoWirePlus.h"
+
+/*******************| Macros |*****************************************/
+/**
+ * Maximum number of data bytes of a block read or write
+ */
+#define TWOWIREPLUSSMBUS_BLOCK_MAX       32
+
+/**
+ * Alert response address read by host to find device asserting SMBALERT#
+ */
+#define TWOWIREPLUSSMBUS_ALERT_ADDRESS   0x0c
+
+/*******************| Type definitions |*******************************/
+
+/*******************| Global variables |*******************************/
+
+/*******************| Function prototypes |****************************/
+
+class TwoWirePlusSMBus
+{
+private:
+
+public:
+  TwoWirePlusSMBus();
+  void setPec(bool enable);
+  TwoWirePlus_TransactionState_t quickCommand(uint8_t address, uint8_t bit);
+  TwoWirePlus_TransactionState_t blockWrite(uint8_t address, uint8_t command, const uint8_t *data, uint8_t length);
+  TwoWirePlus_TransactionState_t blockRead(uint8_t address, uint8_t command, uint8_t *data, uint8_t *length);
+  TwoWirePlus_TransactionState_t processCall(uint8_t address, uint8_t command, uint16_t *value);
+  TwoWirePlus_TransactionState_t alertResponse(uint8_t *address);
+};
+
+/*******************| Preinstantiate Objects |*************************/
+extern TwoWirePlusSMBus SMBus;
+
+#endif
+
+/** @}*/
@@ -0,0 +1,197 @@
+/** @ingroup TwoWirePlus
+ * @{
+ *
+ * @brief Write-through shadow register cache on top of TwoWirePlus
+ *
+ * One #TwoWirePlusShadow per device keeps a copy of registers 0 to size - 1 in RAM. Registers
+ * are cached once they were read or written successfully:
+ *
+ *   Read:   Served from RAM if cached, otherwise SLA+W | reg | SLA+R | value | STOP
+ *   Write:  Suppressed if cached value is equal, otherwise SLA+W | reg | value | STOP
+ *   Update: Bits are modified on the value read as above and written as above
+ *
+ * Registers changed by the device itself, e.g. input ports or interrupt flags, are declared
+ * volatile and never cached. Registers changed by writing another register, e.g. an alias of the
+ * same register, are declared as side effects, see #TwoWirePlusShadow::setSideEffects. For a
+ * MCP23017 (IOCON.BANK = 0):
+ *   Volatile:     INTF, INTCAP and GPIO, i.e. volatile mask {0x00, 0xc0, 0x0f}
+ *   Side effects: GPIO writes OLAT and IOCON is mapped to 0x0A and 0x0B, i.e.
+ *                 {0x12, 0x14, 0x13, 0x15, 0x0a, 0x0b, 0x0b, 0x0a}
+ * Call #TwoWirePlusShadow::invalidate after the device was reset or IOCON.BANK was changed.
+ */
+
+/*******************| Inclusions |*************************************/
+#include "TwoWirePlusShadow.h"
+#include <Arduino.h>
+
+/*******************| Macros |*****************************************/
+
+/*******************| Type definitions |*******************************/
+
+/*******************| Global variables |*******************************/
+
+/*******************| Function prototypes |****************************/
+
+/*******************| Function Definition |****************************/
+
+/**
+ * Creates cache for one device. Nothing is cached until first access.
+ * @param address 7bit slave address
+ * @param registers Shadow copy of registers, #size bytes, owned by application
+ * @param size Number of registers cached, at most #TWOWIREPLUSSHADOW_MAXREGISTERS
+ * @param volatileMask Bit (reg & 7) of volatileMask[reg >> 3] is set for registers which are
+ * always accessed on the bus. NULL if no register is volatile.
+ */
+TwoWirePlusShadow::TwoWirePlusShadow(uint8_t address, uint8_t *registers, uint8_t size, const uint8_t *volatileMask)
+{
+  this->address = address;
+  this->registers = registers;
+  this->size = (size > TWOWIREPLUSSHADOW_MAXREGISTERS) ? TWOWIREPLUSSHADOW_MAXREGISTERS : size;
+  this->volatileMask = volatileMask;
+  this->sideEffects = NULL;
+  this->sideEffectCount = 0;
+  invalidate();
+}
+
+/**
+ * Reads register, from RAM if it's cached
+ * @param reg Register address
+ * @param value Register value
+ * @return #TWOWIREPLUS_TRANSACTION_DONE on success
+ */
+TwoWirePlus_TransactionState_t TwoWirePlusShadow::read(uint8_t reg, uint8_t *value)
+{
+  TwoWirePlus_Transaction_t transaction = TWOWIREPLUS_TRANSACTION_INIT(address, &reg, 1, value, 1);
+  TwoWirePlus_TransactionState_t state;
+
+  if (isCached(reg))
+  {
+    *value = registers[reg];
+    return TWOWIREPLUS_TRANSACTION_DONE;
+  }
+  Wire.queue(&transaction);
+  state = Wire.waitFor(&transaction);
+  if ((state == TWOWIREPLUS_TRANSACTION_DONE) && (reg < size) && !isVolatile(reg))
+  {
+    registers[reg] = *value;
+    valid[reg >> 3] |= _BV(reg & 0x07);
+  }
+  return state;
+}
+
+/**
+ * Writes register unless it's cached with the same value
+ * @param reg Register address
+ * @param value New register value
+ * @return #TWOWIREPLUS_TRANSACTION_DONE on success
+ */
+TwoWirePlus_TransactionState_t TwoWirePlusShadow::write(uint8_t reg, uint8_t value)
+{
+  uint8_t buffer[2] = {reg, value};
+  TwoWirePlus_Transaction_t transaction = TWOWIREPLUS_TRANSACTION_INIT(address, buffer, sizeof(buffer), NULL, 0);
+  TwoWirePlus_TransactionState_t state;
+
+  if (isCached(reg) && (registers[reg] == value))
+  {
+    return TWOWIREPLUS_TRANSACTION_DONE;
+  }
+  Wire.queue(&transaction);
+  state = Wire.waitFor(&transaction);
+  /* Registers changed by this write are unknown, also if write failed */
+  for (uint8_t i=0; i<sideEffectCount; i++)
+  {
+    if (sideEffects[2 * i] == reg)
+    {
+      invalidate(sideEffects[2 * i + 1]);
+    }
+  }
+  if ((reg < size) && !isVolatile(reg))
+  {
+    if (state == TWOWIREPLUS_TRANSACTION_DONE)
+    {
+      registers[reg] = value;
+      valid[reg >> 3] |= _BV(reg & 0x07);
+    }
+    else
+    {
+      /* Register content is unknown if write failed */
+      invalidate(reg);
+    }
+  }
+  return state;
+}
+
+/**
+ * Replaces bits in #mask of register by #value, read-modify-write on cached value if possible
+ * @param reg Register address
+ * @param mask Bits to be modified
+ * @param value New value of bits in #mask
+ * @return #TWOWIREPLUS_TRANSACTION_DONE on success
+ */
+TwoWirePlus_TransactionState_t TwoWirePlusShadow::update(uint8_t reg, uint8_t mask, uint8_t value)
+{
+  uint8_t current;
+  TwoWirePlus_TransactionState_t state = read(reg, &current);
+
+  if (state != TWOWIREPLUS_TRANSACTION_DONE)
+  {
+    return state;
+  }
+  return write(reg, (current & ~mask) | (value & mask));
+}
+
+/**
+ * Declares registers changed by the device when another register is written. Cached value of
+ * the changed register is dropped on each write to the written register, thus, it's read from
+ * the device next time.
+ * @param sideEffects Pairs of register written and register changed by it, owned by application
+ * @param count Number of pairs
+ */
+void TwoWirePlusShadow::setSideEffects(const uint8_t *sideEffects, uint8_t count)
+{
+  this->sideEffects = sideEffects;
+  this->sideEffectCount = count;
+}
+
+/**
+ * Drops all cached values, e.g. after device was reset
+ */
+void TwoWirePlusShadow::invalidate()
+{
+  for (uint8_t i=0; i<sizeof(valid); i++)
+  {
+    valid[i] = 0;
+  }
+}
+
+/**
+ * Drops cached value of one register
+ * @param reg Register address
+ */
+void TwoWirePlusShadow::invalidate(uint8_t reg)
+{
+  if (reg < size)
+  {
+    valid[reg >> 3] &= ~_BV(reg & 0x07);
+  }
+}
+
+/**
+ * Checks if register value is known
+ */
+bool TwoWirePlusShadow::isCached(uint8_t reg)
+{
+  return (reg < size) && (valid[reg >> 3] & _BV(reg & 0x07));
+}
+
+/**
+ * Checks if register is changed by the device itself
+ */
+bool TwoWirePlusShadow::isVolatile(uint8_t reg)
+{
+  return (volatileMask != NULL) && (volatileMask[reg >> 3] & _BV(reg & 0x07));
+}
+
+/*******************| Preinstantiate Objects |*************************/
+
+/** @}*/
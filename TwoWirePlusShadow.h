@@ -0,0 +1,52 @@
+/** @ingroup TwoWirePlus
+ * @{
+ */
+#ifndef  TWOWIREPLUSSHADOW_H
+#define  TWOWIREPLUSSHADOW_H
+
+/*******************| Inclusions |*************************************/
+#include <stdint.h>
+#include "TwoWirePlus.h"
+
+/*******************| Macros |*****************************************/
+#ifndef TWOWIREPLUSSHADOW_MAXREGISTERS
+/**
+ * Maximum number of registers of one device which can be cached
+ */
+#define TWOWIREPLUSSHADOW_MAXREGISTERS   32
+#endif
+
+/*******************| Type definitions |*******************************/
+
+/*******************| Global variables |*******************************/
+
+/*******************| Function prototypes |****************************/
+
+class TwoWirePlusShadow
+{
+private:
+  uint8_t address;
+  uint8_t *registers;
+  uint8_t size;
+  const uint8_t *volatileMask;
+  const uint8_t *sideEffects;
+  uint8_t sideEffectCount;
+  uint8_t valid[(TWOWIREPLUSSHADOW_MAXREGISTERS + 7) / 8];
+  bool isCached(uint8_t reg);
+  bool isVolatile(uint8_t reg);
+
+public:
+  TwoWirePlusShadow(uint8_t address, uint8_t *registers, uint8_t size, const uint8_t *volatileMask);
+  TwoWirePlus_TransactionState_t read(uint8_t reg, uint8_t *value);
+  TwoWirePlus_TransactionState_t write(uint8_t reg, uint8_t value);
+  TwoWirePlus_TransactionState_t update(uint8_t reg, uint8_t mask, uint8_t value);
+  void setSideEffects(const uint8_t *sideEffects, uint8_t count);
+  void invalidate();
+  void invalidate(uint8_t reg);
+};
+
+/*******************| Preinstantiate Objects |*************************/
+
+#endif
+
+/** @}*/
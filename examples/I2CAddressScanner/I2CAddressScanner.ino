@@ -5,8 +5,6 @@
 // Date: 13th of September 2015
 
 #include <TwoWirePlus.h>
-/* To get TW_STATUS definitions like TW_MT_SLA_NACK */
-#include <compat/twi.h>
 
 void setup() {
   Serial.begin (115200);
@@ -18,22 +16,21 @@ void setup() {
 
   Serial.println ();
   Serial.println ("I2C scanner. Scanning ...");
-  byte count = 0;
+  byte bitmap[TWOWIREPLUS_SCAN_BITMAP_SIZE];
+  byte count;
   
   Wire.begin();
-  for (byte i = 8; i < 120; i++)
+  /* NEW: all addresses are probed back to back by the TWI interrupt */
+  count = Wire.scan (bitmap);
+  for (byte i = TWOWIREPLUS_SCAN_FIRST; i <= TWOWIREPLUS_SCAN_LAST; i++)
   {
-    Wire.beginTransmission (i);
-    /* NEW: return value for endTransmittion is a bit different for TwoWirePlus library */
-    if (Wire.endTransmission () != TW_MT_SLA_NACK)
+    if (bitmap[i >> 3] & (1 << (i & 7)))
       {
       Serial.print ("Found address: ");
       Serial.print (i, DEC);
       Serial.print (" (0x");
       Serial.print (i, HEX);
       Serial.println (")");
-      count++;
-      delay (1);  // maybe unneeded?
       } // end of good response
   } // end of for loop
   Serial.println ("Done.");
@@ -10,11 +10,18 @@
 #include <stdint.h>
 #include <stdbool.h>
 #include <stdio.h>
+#include <string.h>
+#include <time.h>
 #include "TwoWirePlus_BaseTest.h"
 #include "TwoWirePlus_BaseTest_stub.h"
+#include "TwoWirePlus_BaseTest_twiModel.h"
 
 /* module under test has to be the last include */
 #include "TwoWirePlus.cpp"
+#include "TwoWirePlusLink.cpp"
+#include "TwoWirePlusSMBus.cpp"
+#include "TwoWirePlusShadow.cpp"
+#include "TwoWirePlusCalibration.cpp"
 
 /*******************| Macros |*****************************************/
 
@@ -43,7 +50,55 @@ void TwoWirePlus_BaseTest_resetBuffer()
 		TwoWirePlus_rxRingBuffer.buffer[i] = TWOWIREPLUS_BASETEST_BUFFERINITVALUE;
 	}
 	TwoWirePlus_bytesToReceive = 0;
-
+	TwoWirePlus_rxStalled = false;
+	TwoWirePlus_rxStallTime = 0;
+	TwoWirePlus_BaseTest_micros = 0;
+	TwoWirePlus_semaphore = false;
+	TwoWirePlus_slaveRegisters = NULL;
+	TwoWirePlus_slaveRegisterSize = 0;
+	TwoWirePlus_slaveEvents.head = 0;
+	TwoWirePlus_slaveEvents.tail = 0;
+	TwoWirePlus_slaveReply = NULL;
+	TwoWirePlus_slaveReplyLength = 0;
+	TwoWirePlus_receiveCallback = NULL;
+	TwoWirePlus_requestCallback = NULL;
+	TwoWirePlus_slaveActive = false;
+	TwoWirePlus_startPending = false;
+	TwoWirePlus_frameRemaining = 0;
+	TwoWirePlus_frameActive = false;
+	TwoWirePlus_transaction = NULL;
+	TwoWirePlus_transactionTail = NULL;
+	TwoWirePlus_arbitrationLosses = 0;
+	TwoWirePlus_scriptCount = 0;
+	TwoWirePlus_address10Pending = false;
+	for (int i=0; i<TWOWIREPLUS_DEVICETABLE_SIZE; i++)
+	{
+		TwoWirePlus_devices[i].address = 0;
+		TwoWirePlus_devices[i].present = false;
+	}
+	TwoWirePlus_probe.state = TWOWIREPLUS_TRANSACTION_DONE;
+	memset(TwoWirePlus_muxSelected, 0, sizeof(TwoWirePlus_muxSelected));
+	for (int i=0; i<TWOWIREPLUS_COALESCE_BURSTS; i++)
+	{
+		TwoWirePlus_coalesce[i].state = TWOWIREPLUS_TRANSACTION_DONE;
+	}
+	TwoWirePlus_coalesceIndex = 0;
+	TwoWirePlus_coalesceTicks = 0;
+	TwoWirePlus_coalescePending = false;
+	TwoWirePlus_delayed = NULL;
+	TwoWirePlus_txSource = NULL;
+	TwoWirePlus_txFillData = 0;
+	TwoWirePlus_txGenerator = NULL;
+	TwoWirePlus_rxConsumer = NULL;
+	TwoWirePlus_rxWatermark = 0;
+	TwoWirePlus_pingPong[0] = NULL;
+	TwoWirePlus_pingPong[1] = NULL;
+	TwoWirePlus_pingPongReady = 0;
+	TwoWirePlus_pingPongOverruns = 0;
+	TwoWirePlus_txSourceLength = 0;
+	TwoWirePlus_txSourceActive = false;
+
+	TWAR = 0;
 	TWDR = 0;
 	TWCR = 0;
 	TWBR = 0;
@@ -233,6 +288,25 @@ static void TwoWirePlus_BaseTest_requestBytes_TC1(void)
 	TEST_ASSERT_EQUAL_INT(5 + TWOWIREPLUS_RINGBUFFER_SIZE, TwoWirePlus_bytesToReceive);
 }
 
+/**
+ * Function requestBytes shall allow to request more than 255 bytes. In case total number of
+ * bytes would exceed TWOWIREPLUS_BYTECOUNT_MAX request shall be rejected and
+ * TwoWirePlus_bytesToReceive shall not wrap.
+ */
+static void TwoWirePlus_BaseTest_requestBytes_TC2(void)
+{
+	TwoWirePlus_BaseTest_resetBuffer();
+	TEST_ASSERT(Wire.requestBytes(1024));
+	TEST_ASSERT(Wire.requestBytes(1024));
+	TEST_ASSERT_EQUAL_INT(2048, Wire.getBytesToReceive());
+	TEST_ASSERT(!Wire.requestBytes(TWOWIREPLUS_BYTECOUNT_MAX - 2047));
+	TEST_ASSERT_EQUAL_INT(2048, Wire.getBytesToReceive());
+	TEST_ASSERT(Wire.requestBytes(TWOWIREPLUS_BYTECOUNT_MAX - 2048));
+	TEST_ASSERT_EQUAL_INT(TWOWIREPLUS_BYTECOUNT_MAX, Wire.getBytesToReceive());
+	/* Interrupts shall be enabled again afterwards */
+	TEST_ASSERT_EQUAL_INT(0x80, SREG);
+}
+
 /**
  * Function shall return one byte from TwoWirePlus_rxRingBuffer, if available, if not
  * 0x00 shall be returned.
@@ -827,6 +901,2619 @@ static void TwoWirePlus_BaseTest_MasterReceiver_TC2(void)
 	/* Wire.endReception can't be tested. A bit is set in this function and function will wait until bit is cleared in ISR */
 }
 
+/**
+ * Request more bytes than fit into rxRingBuffer. When rxRingBuffer is full TWINT shall not
+ * be cleared and TWI interrupt shall be disabled to stretch the clock. Reading one byte shall
+ * continue reception and time spent stretching shall be accounted.
+ */
+static void TwoWirePlus_BaseTest_MasterReceiver_TC3(void)
+{
+	int i;
+	TwoWirePlus_BaseTest_resetBuffer();
+
+	Wire.beginReception(0x42);
+	Wire.requestBytes(TWOWIREPLUS_RINGBUFFER_SIZE + 2);
+	TWSR = TW_START;
+	TWI_vect();
+	TWSR = TW_MR_SLA_ACK;
+	TWI_vect();
+	/* Fill complete buffer, all bytes shall be ACKed but the last one */
+	TWSR = TW_MR_DATA_ACK;
+	for (i=0; i<TWOWIREPLUS_RINGBUFFER_SIZE - 1; i++)
+	{
+		TWDR = i;
+		TWI_vect();
+		TEST_ASSERT_EQUAL_INT((TWOWIREPLUS_BASETEST_TWCR_TWIE | TWOWIREPLUS_BASETEST_TWCR_TWEN | TWOWIREPLUS_BASETEST_TWCR_TWEA | TWOWIREPLUS_BASETEST_TWCR_TWINT), TWCR);
+	}
+	/* Buffer is full now, TWINT must be left set and interrupt disabled */
+	TwoWirePlus_BaseTest_micros = 1000;
+	TWDR = i;
+	TWI_vect();
+	TEST_ASSERT(TwoWirePlus_RingBufferFull(TwoWirePlus_rxRingBuffer));
+	TEST_ASSERT_EQUAL_INT(TWOWIREPLUS_BASETEST_TWCR_TWEN, TWCR);
+	TEST_ASSERT(TwoWirePlus_rxStalled);
+	TEST_ASSERT_EQUAL_INT(2, TwoWirePlus_bytesToReceive);
+	/* Application reads one byte, reception shall continue with ACK */
+	TwoWirePlus_BaseTest_micros = 1250;
+	TEST_ASSERT_EQUAL_INT(0, Wire.read());
+	TEST_ASSERT(!TwoWirePlus_rxStalled);
+	TEST_ASSERT_EQUAL_INT(250, Wire.getRxStretchTime());
+	TEST_ASSERT_EQUAL_INT((TWOWIREPLUS_BASETEST_TWCR_TWIE | TWOWIREPLUS_BASETEST_TWCR_TWEN | TWOWIREPLUS_BASETEST_TWCR_TWEA | TWOWIREPLUS_BASETEST_TWCR_TWINT), TWCR);
+	/* Next byte fills buffer again */
+	TWDR = 0xa5;
+	TWI_vect();
+	TEST_ASSERT_EQUAL_INT(TWOWIREPLUS_BASETEST_TWCR_TWEN, TWCR);
+	TwoWirePlus_BaseTest_micros = 1300;
+	TEST_ASSERT_EQUAL_INT(1, Wire.read());
+	TEST_ASSERT_EQUAL_INT(300, Wire.getRxStretchTime());
+	/* Last byte shall be NACKed */
+	TEST_ASSERT_EQUAL_INT((TWOWIREPLUS_BASETEST_TWCR_TWIE | TWOWIREPLUS_BASETEST_TWCR_TWEN | TWOWIREPLUS_BASETEST_TWCR_TWINT), TWCR);
+	TWSR = TW_MR_DATA_NACK;
+	TWDR = 0x5a;
+	TWI_vect();
+	TEST_ASSERT_EQUAL_INT(0, TwoWirePlus_bytesToReceive);
+	TEST_ASSERT_EQUAL_INT((TWOWIREPLUS_BASETEST_TWCR_TWEN | TWOWIREPLUS_BASETEST_TWCR_TWEA ), TWCR);
+	/* Check data order */
+	for (i=2; i<TWOWIREPLUS_RINGBUFFER_SIZE; i++)
+	{
+		TEST_ASSERT_EQUAL_INT(i, Wire.read());
+	}
+	TEST_ASSERT_EQUAL_INT(0xa5, Wire.read());
+	TEST_ASSERT_EQUAL_INT(0x5a, Wire.read());
+	TEST_ASSERT_EQUAL_INT(0, Wire.available());
+}
+/**
+ * Stream more than 255 bytes with a single SLA+R through rxRingBuffer. Application reads
+ * whenever reception was paused. All bytes shall be received in order and only the very
+ * last one shall be NACKed.
+ */
+static void TwoWirePlus_BaseTest_MasterReceiver_TC4(void)
+{
+	uint16_t sent = 0;
+	uint16_t received = 0;
+	TwoWirePlus_BaseTest_resetBuffer();
+
+	Wire.beginReception(0x42);
+	Wire.requestBytes(600);
+	TWSR = TW_START;
+	TWI_vect();
+	TWSR = TW_MR_SLA_ACK;
+	TWI_vect();
+	while (received < 600)
+	{
+		/* Emulate two wire module: only receive if TWINT was cleared */
+		if (TWCR & TWOWIREPLUS_BASETEST_TWCR_TWINT)
+		{
+			TWSR = (TWCR & TWOWIREPLUS_BASETEST_TWCR_TWEA) ? TW_MR_DATA_ACK : TW_MR_DATA_NACK;
+			TEST_ASSERT_EQUAL_INT((sent == 599), (TWSR == TW_MR_DATA_NACK));
+			TWDR = (uint8_t)sent++;
+			TWI_vect();
+		}
+		else
+		{
+			TEST_ASSERT(Wire.available() > 0);
+			TEST_ASSERT_EQUAL_INT((uint8_t)received, Wire.read());
+			received++;
+		}
+	}
+	TEST_ASSERT_EQUAL_INT(600, sent);
+	TEST_ASSERT_EQUAL_INT(0, Wire.getBytesToReceive());
+}
+/**
+ * Default wait hook shall put CPU into idle sleep mode if TWI interrupt is enabled and
+ * enable interrupts again. If STOP is pending or TWI interrupt is disabled no TWI interrupt
+ * will occur, thus, CPU shall not be put to sleep.
+ */
+static void TwoWirePlus_BaseTest_idleSleep_TC1(void)
+{
+	TwoWirePlus_BaseTest_sleepCount = 0;
+	TwoWirePlus_BaseTest_sleepMode = SLEEP_MODE_PWR_DOWN;
+	TWCR = TWOWIREPLUS_TWCR_CLEAR;
+	cli();
+	TwoWirePlus_idleSleep();
+	TEST_ASSERT_EQUAL_INT(1, TwoWirePlus_BaseTest_sleepCount);
+	TEST_ASSERT_EQUAL_INT(SLEEP_MODE_IDLE, TwoWirePlus_BaseTest_sleepMode);
+	TEST_ASSERT_EQUAL_INT(0, TwoWirePlus_BaseTest_sleepEnabled);
+	TEST_ASSERT_EQUAL_INT(0x80, SREG);
+
+	TWCR = TWOWIREPLUS_TWCR_STOP;
+	cli();
+	TwoWirePlus_idleSleep();
+	TEST_ASSERT_EQUAL_INT(1, TwoWirePlus_BaseTest_sleepCount);
+	TEST_ASSERT_EQUAL_INT(0x80, SREG);
+
+	TWCR = TWOWIREPLUS_TWCR_RELEASE;
+	cli();
+	TwoWirePlus_idleSleep();
+	TEST_ASSERT_EQUAL_INT(1, TwoWirePlus_BaseTest_sleepCount);
+	TEST_ASSERT_EQUAL_INT(0x80, SREG);
+}
+
+/**
+ * setWaiter shall install given waiter and restore default waiter if NULL is passed
+ */
+static void TwoWirePlus_BaseTest_setWaiter_TC1(void)
+{
+	Wire.setWaiter(&TwoWirePlus_spinWaiter);
+	TEST_ASSERT(TwoWirePlus_waiter == &TwoWirePlus_spinWaiter);
+	cli();
+	TwoWirePlus_waiter->wait();
+	TEST_ASSERT_EQUAL_INT(0x80, SREG);
+	Wire.setWaiter(NULL);
+	TEST_ASSERT(TwoWirePlus_waiter == &TwoWirePlus_idleSleepWaiter);
+}
+
+/**
+ * setWaitHook shall install given hook and restore default waiter if NULL is passed
+ */
+static void TwoWirePlus_BaseTest_setWaitHook_TC1(void)
+{
+	Wire.setWaitHook(TwoWirePlus_BaseTest_twiModelWait);
+	TEST_ASSERT(TwoWirePlus_waiter->wait == TwoWirePlus_BaseTest_twiModelWait);
+	TEST_ASSERT(TwoWirePlus_waiter->notify == NULL);
+	Wire.setWaitHook(NULL);
+	TEST_ASSERT(TwoWirePlus_waiter == &TwoWirePlus_idleSleepWaiter);
+}
+
+static uint8_t TwoWirePlus_BaseTest_sleepHookCalls;
+/* Emulates two other interrupts before TWI interrupt gives semaphore */
+static void TwoWirePlus_BaseTest_semaphoreSleepHook(void)
+{
+	if (++TwoWirePlus_BaseTest_sleepHookCalls == 3)
+	{
+		TWI_vect();
+	}
+}
+
+/**
+ * Semaphore waiter shall return immediately if semaphore was already given and shall sleep
+ * until ISR gave the semaphore otherwise, even if woken up by other interrupts. Semaphore shall
+ * be taken afterwards.
+ */
+static void TwoWirePlus_BaseTest_semaphoreWait_TC1(void)
+{
+	TwoWirePlus_BaseTest_resetBuffer();
+	Wire.setWaiter(&TwoWirePlus_semaphoreWaiter);
+	TwoWirePlus_BaseTest_sleepCount = 0;
+	TwoWirePlus_BaseTest_sleepHookCalls = 0;
+	TwoWirePlus_BaseTest_sleepHook = TwoWirePlus_BaseTest_semaphoreSleepHook;
+	/* ISR shall give semaphore */
+	TWSR = TW_START;
+	TWI_vect();
+	TEST_ASSERT(TwoWirePlus_semaphore);
+	TWCR = TWOWIREPLUS_TWCR_CLEAR;
+	cli();
+	TwoWirePlus_semaphoreWait();
+	TEST_ASSERT_EQUAL_INT(0, TwoWirePlus_BaseTest_sleepCount);
+	TEST_ASSERT(!TwoWirePlus_semaphore);
+	TEST_ASSERT_EQUAL_INT(0x80, SREG);
+	/* Semaphore not given, sleep until ISR was called */
+	TWCR = TWOWIREPLUS_TWCR_CLEAR;
+	cli();
+	TwoWirePlus_semaphoreWait();
+	TEST_ASSERT_EQUAL_INT(3, TwoWirePlus_BaseTest_sleepCount);
+	TEST_ASSERT(!TwoWirePlus_semaphore);
+	TEST_ASSERT_EQUAL_INT(0x80, SREG);
+	/* No interrupt expected after STOP, shall not block */
+	TWCR = TWOWIREPLUS_TWCR_STOP;
+	cli();
+	TwoWirePlus_semaphoreWait();
+	TEST_ASSERT_EQUAL_INT(3, TwoWirePlus_BaseTest_sleepCount);
+	TwoWirePlus_BaseTest_sleepHook = NULL;
+	Wire.setWaiter(NULL);
+}
+
+/**
+ * Write eight bytes to a simulated device and read them back using blocking functions.
+ * Wait hook is called for every event on the bus only. CPU active time is reported for
+ * busy waiting (CPU active during complete transfer) and for sleeping between TWI
+ * interrupts.
+ */
+static void TwoWirePlus_BaseTest_WaitHook_TC1(void)
+{
+	uint8_t memory[16] = {0};
+	TwoWirePlus_BaseTest_Device_t device = {0x50, memory, sizeof(memory), 0, false};
+	uint32_t bitTimes;
+	uint32_t isrCalls;
+	int i;
+
+	TwoWirePlus_BaseTest_resetBuffer();
+	TwoWirePlus_BaseTest_twiModelReset();
+	TwoWirePlus_BaseTest_twiModelAddDevice(&device);
+	Wire.setWaiter(&TwoWirePlus_BaseTest_twiModelWaiter);
+
+	Wire.beginTransmission(0x50);
+	Wire.write(0x04);
+	for (i=0; i<8; i++)
+	{
+		Wire.write(0xa0 + i);
+	}
+	TEST_ASSERT_EQUAL_INT(TW_MT_DATA_ACK, Wire.endTransmission());
+	for (i=0; i<8; i++)
+	{
+		TEST_ASSERT_EQUAL_INT(0xa0 + i, memory[4 + i]);
+	}
+	/* One wake-up per bus event: START, SLA, 9 data bytes and STOP */
+	TEST_ASSERT_EQUAL_INT(12, TwoWirePlus_BaseTest_twiModelWaitCalls);
+	bitTimes = TwoWirePlus_BaseTest_twiModelBitTimes;
+	printf("\nWait hook: 9 byte write, bus %lu us, busy wait active %lu us, idle sleep active ~%lu us (%lu wake-ups)\n",
+			(unsigned long)(bitTimes * 10), (unsigned long)(bitTimes * 10),
+			(unsigned long)((TwoWirePlus_BaseTest_twiModelIsrCalls * TWOWIREPLUS_BASETEST_TWIMODEL_ISRCYCLES) / 16),
+			(unsigned long)TwoWirePlus_BaseTest_twiModelWaitCalls);
+
+	/* Set register pointer and read back */
+	Wire.beginTransmission(0x50);
+	Wire.write(0x04);
+	Wire.endTransmission();
+	TEST_ASSERT_EQUAL_INT(8, Wire.requestFrom(0x50, 8));
+	for (i=0; i<8; i++)
+	{
+		TEST_ASSERT_EQUAL_INT(0xa0 + i, Wire.read());
+	}
+	/* More than fits into rx ring buffer would never finish, nothing is sent */
+	isrCalls = TwoWirePlus_BaseTest_twiModelIsrCalls;
+	TEST_ASSERT_EQUAL_INT(0, Wire.requestFrom(0x50, TWOWIREPLUS_RINGBUFFER_SIZE + 1));
+	TEST_ASSERT_EQUAL_INT(0, TwoWirePlus_BaseTest_twiModelIsrCalls - isrCalls);
+	/* Second request without reading only gets free space of rx ring buffer */
+	TEST_ASSERT_EQUAL_INT(20, Wire.requestFrom(0x50, 20));
+	isrCalls = TwoWirePlus_BaseTest_twiModelIsrCalls;
+	TEST_ASSERT_EQUAL_INT(0, Wire.requestFrom(0x50, TWOWIREPLUS_RINGBUFFER_SIZE - 20 + 1));
+	TEST_ASSERT_EQUAL_INT(0, TwoWirePlus_BaseTest_twiModelIsrCalls - isrCalls);
+	TEST_ASSERT_EQUAL_INT(TWOWIREPLUS_RINGBUFFER_SIZE - 20, Wire.requestFrom(0x50, TWOWIREPLUS_RINGBUFFER_SIZE - 20));
+	TEST_ASSERT_EQUAL_INT(TWOWIREPLUS_RINGBUFFER_SIZE, Wire.available());
+	for (i=0; i<TWOWIREPLUS_RINGBUFFER_SIZE; i++)
+	{
+		Wire.read();
+	}
+	Wire.setWaiter(NULL);
+}
+
+/**
+ * Bytes from flash are sent by ISR without being placed in tx ring buffer. Bytes written
+ * before and after are sent in order.
+ */
+static void TwoWirePlus_BaseTest_WriteP_TC1(void)
+{
+	static const uint8_t table[40] PROGMEM = {
+		0x00, 0x01, 0x02, 0x03, 0x04, 0x05, 0x06, 0x07, 0x08, 0x09, 0x0a, 0x0b, 0x0c, 0x0d, 0x0e, 0x0f,
+		0x10, 0x11, 0x12, 0x13, 0x14, 0x15, 0x16, 0x17, 0x18, 0x19, 0x1a, 0x1b, 0x1c, 0x1d, 0x1e, 0x1f,
+		0x20, 0x21, 0x22, 0x23, 0x24, 0x25, 0x26, 0x27
+	};
+	uint8_t memory[48] = {0};
+	TwoWirePlus_BaseTest_Device_t device = {0x50, memory, sizeof(memory), 0, false};
+	int i;
+
+	TwoWirePlus_BaseTest_resetBuffer();
+	TwoWirePlus_BaseTest_twiModelReset();
+	TwoWirePlus_BaseTest_twiModelAddDevice(&device);
+	Wire.setWaiter(&TwoWirePlus_BaseTest_twiModelWaiter);
+
+	/* More bytes than fit into ring buffer */
+	Wire.beginTransmission(0x50);
+	Wire.write(0x02);
+	Wire.write_P(table, sizeof(table));
+	Wire.write(0xaa);
+	TEST_ASSERT_EQUAL_INT(TW_MT_DATA_ACK, Wire.endTransmission());
+	TEST_ASSERT_EQUAL_INT(0, memcmp(table, &memory[2], sizeof(table)));
+	TEST_ASSERT_EQUAL_INT(0xaa, memory[2 + sizeof(table)]);
+	/* Ring buffer was not used for bytes from flash */
+	for (i=3; i<TWOWIREPLUS_RINGBUFFER_SIZE; i++)
+	{
+		TEST_ASSERT_EQUAL_INT(TWOWIREPLUS_BASETEST_BUFFERINITVALUE, TwoWirePlus_txRingBuffer.buffer[i]);
+	}
+	TEST_ASSERT(!TwoWirePlus_txSourceActive);
+	Wire.setWaiter(NULL);
+}
+
+/**
+ * Fill: More bytes than a byte counter can hold are generated by ISR. Bytes written before
+ * and after are sent in order, ring buffer holds address, register and trailing byte only.
+ */
+static void TwoWirePlus_BaseTest_Fill_TC1(void)
+{
+	static uint8_t memory[1100];
+	TwoWirePlus_BaseTest_Device_t device = {0x3c, memory, sizeof(memory), 0, false};
+	uint32_t isrCalls;
+	int i;
+
+	TwoWirePlus_BaseTest_resetBuffer();
+	TwoWirePlus_BaseTest_twiModelReset();
+	TwoWirePlus_BaseTest_twiModelAddDevice(&device);
+	memset(memory, 0xff, sizeof(memory));
+	Wire.setWaiter(&TwoWirePlus_BaseTest_twiModelWaiter);
+
+	Wire.beginTransmission(0x3c);
+	Wire.write(0x00);
+	Wire.fill(0x00, 1024);
+	Wire.write(0x55);
+	TEST_ASSERT_EQUAL_INT(TW_MT_DATA_ACK, Wire.endTransmission());
+	for (i=0; i<1024; i++)
+	{
+		TEST_ASSERT_EQUAL_INT(0x00, memory[i]);
+	}
+	TEST_ASSERT_EQUAL_INT(0x55, memory[1024]);
+	TEST_ASSERT_EQUAL_INT(0xff, memory[1025]);
+	/* START, SLA, register, 1024 fill bytes and trailing byte */
+	isrCalls = TwoWirePlus_BaseTest_twiModelIsrCalls;
+	TEST_ASSERT_EQUAL_INT(1 + 1 + 1 + 1024 + 1, isrCalls);
+	TEST_ASSERT_EQUAL_INT(3, TwoWirePlus_txRingBuffer.head);
+
+	/* Nothing to fill */
+	Wire.beginTransmission(0x3c);
+	Wire.write(0x10);
+	Wire.fill(0xaa, 0);
+	TEST_ASSERT_EQUAL_INT(TW_MT_DATA_ACK, Wire.endTransmission());
+	TEST_ASSERT_EQUAL_INT(0x00, memory[0x10]);
+	Wire.setWaiter(NULL);
+}
+
+/**
+ * Generator producing a counting sequence of #TwoWirePlus_BaseTest_generatorLeft bytes
+ */
+static uint8_t TwoWirePlus_BaseTest_generatorValue = 0;
+static uint16_t TwoWirePlus_BaseTest_generatorLeft = 0;
+static uint8_t TwoWirePlus_BaseTest_generatorCalls = 0;
+
+static uint8_t TwoWirePlus_BaseTest_generator(uint8_t *buffer, uint8_t size)
+{
+	uint8_t i;
+	TwoWirePlus_BaseTest_generatorCalls++;
+	for (i=0; (i<size) && TwoWirePlus_BaseTest_generatorLeft; i++)
+	{
+		buffer[i] = TwoWirePlus_BaseTest_generatorValue++;
+		TwoWirePlus_BaseTest_generatorLeft--;
+	}
+	return i;
+}
+
+/**
+ * Stream: Generated bytes are sent by ISR in windows, bytes written afterwards follow
+ */
+static void TwoWirePlus_BaseTest_Stream_TC1(void)
+{
+	uint8_t memory[128];
+	TwoWirePlus_BaseTest_Device_t device = {0x50, memory, sizeof(memory), 0, false};
+	int i;
+
+	TwoWirePlus_BaseTest_resetBuffer();
+	TwoWirePlus_BaseTest_twiModelReset();
+	TwoWirePlus_BaseTest_twiModelAddDevice(&device);
+	memset(memory, 0xff, sizeof(memory));
+	TwoWirePlus_BaseTest_generatorValue = 0;
+	TwoWirePlus_BaseTest_generatorLeft = 100;
+	TwoWirePlus_BaseTest_generatorCalls = 0;
+	Wire.setWaiter(&TwoWirePlus_BaseTest_twiModelWaiter);
+
+	Wire.beginTransmission(0x50);
+	Wire.write(0x00);
+	Wire.stream(TwoWirePlus_BaseTest_generator);
+	Wire.write(0xaa);
+	TEST_ASSERT_EQUAL_INT(TW_MT_DATA_ACK, Wire.endTransmission());
+	for (i=0; i<100; i++)
+	{
+		TEST_ASSERT_EQUAL_INT(i, memory[i]);
+	}
+	TEST_ASSERT_EQUAL_INT(0xaa, memory[100]);
+	/* 13 windows, last call ends stream */
+	TEST_ASSERT_EQUAL_INT(14, TwoWirePlus_BaseTest_generatorCalls);
+
+	/* Empty stream */
+	Wire.beginTransmission(0x50);
+	Wire.write(0x10);
+	Wire.stream(TwoWirePlus_BaseTest_generator);
+	TEST_ASSERT_EQUAL_INT(TW_MT_DATA_ACK, Wire.endTransmission());
+	TEST_ASSERT_EQUAL_INT(0x10, memory[0x10]);
+	Wire.setWaiter(NULL);
+}
+
+/**
+ * Bytes received by consumer
+ */
+static uint8_t TwoWirePlus_BaseTest_consumed[128];
+static uint8_t TwoWirePlus_BaseTest_consumedLength = 0;
+static uint8_t TwoWirePlus_BaseTest_consumerCalls = 0;
+static TwoWirePlus_ByteCount_t TwoWirePlus_BaseTest_consumerFirstPending = 0;
+
+static void TwoWirePlus_BaseTest_consumer(const uint8_t *data, uint8_t length)
+{
+	if (TwoWirePlus_BaseTest_consumerCalls++ == 0)
+	{
+		TwoWirePlus_BaseTest_consumerFirstPending = TwoWirePlus_bytesToReceive;
+	}
+	memcpy(&TwoWirePlus_BaseTest_consumed[TwoWirePlus_BaseTest_consumedLength], data, length);
+	TwoWirePlus_BaseTest_consumedLength += length;
+}
+
+/**
+ * Consumer: Records are passed while reception is still running. Reading more bytes than fit
+ * into rx ring buffer does not stretch the clock.
+ */
+static void TwoWirePlus_BaseTest_Consumer_TC1(void)
+{
+	uint8_t memory[128];
+	TwoWirePlus_BaseTest_Device_t device = {0x50, memory, sizeof(memory), 0, false};
+	int i;
+
+	TwoWirePlus_BaseTest_resetBuffer();
+	TwoWirePlus_BaseTest_twiModelReset();
+	TwoWirePlus_BaseTest_twiModelAddDevice(&device);
+	for (i=0; i<(int)sizeof(memory); i++)
+	{
+		memory[i] = i ^ 0x5a;
+	}
+	TwoWirePlus_BaseTest_consumedLength = 0;
+	TwoWirePlus_BaseTest_consumerCalls = 0;
+	Wire.setWaiter(&TwoWirePlus_BaseTest_twiModelWaiter);
+	Wire.setConsumer(TwoWirePlus_BaseTest_consumer, 8);
+
+	Wire.beginTransmission(0x50);
+	Wire.write(0x00);
+	Wire.endTransmission();
+	Wire.beginReception(0x50);
+	TEST_ASSERT(Wire.requestBytes(100));
+	Wire.endReception();
+	TEST_ASSERT_EQUAL_INT(0, Wire.available());
+	TEST_ASSERT_EQUAL_INT(100, TwoWirePlus_BaseTest_consumedLength);
+	TEST_ASSERT_EQUAL_INT(0, memcmp(memory, TwoWirePlus_BaseTest_consumed, 100));
+	/* 12 records and remaining 4 bytes, first record while 92 bytes were still pending */
+	TEST_ASSERT_EQUAL_INT(13, TwoWirePlus_BaseTest_consumerCalls);
+	TEST_ASSERT_EQUAL_INT(92, TwoWirePlus_BaseTest_consumerFirstPending);
+	TEST_ASSERT_EQUAL_INT(0, Wire.getRxStretchTime());
+
+	/* Without consumer bytes are kept for read */
+	Wire.setConsumer(NULL, 0);
+	Wire.beginTransmission(0x50);
+	Wire.write(0x20);
+	Wire.endTransmission();
+	TEST_ASSERT_EQUAL_INT(4, Wire.requestFrom(0x50, 4));
+	TEST_ASSERT_EQUAL_INT((0x20 ^ 0x5a), Wire.read());
+	Wire.setWaiter(NULL);
+}
+
+/**
+ * Span accessors: Received bytes are processed in place, bytes to send are encoded in place.
+ * Regions end at the end of the ring buffers.
+ */
+static void TwoWirePlus_BaseTest_Span_TC1(void)
+{
+	uint8_t memory[64];
+	TwoWirePlus_BaseTest_Device_t device = {0x50, memory, sizeof(memory), 0, false};
+	const uint8_t *rx;
+	uint8_t *tx;
+	uint8_t length;
+	int i;
+
+	TwoWirePlus_BaseTest_resetBuffer();
+	TwoWirePlus_BaseTest_twiModelReset();
+	TwoWirePlus_BaseTest_twiModelAddDevice(&device);
+	for (i=0; i<(int)sizeof(memory); i++)
+	{
+		memory[i] = i;
+	}
+	Wire.setWaiter(&TwoWirePlus_BaseTest_twiModelWaiter);
+
+	/* Nothing received yet */
+	TEST_ASSERT_EQUAL_INT(0, Wire.peekSpan(&rx));
+
+	/* Move tail close to end of rx ring buffer */
+	Wire.beginTransmission(0x50);
+	Wire.write(0x00);
+	Wire.endTransmission();
+	TEST_ASSERT_EQUAL_INT(24, Wire.requestFrom(0x50, 24));
+	length = Wire.peekSpan(&rx);
+	TEST_ASSERT_EQUAL_INT(24, length);
+	TEST_ASSERT_EQUAL_INT(0, rx[0]);
+	Wire.consume(length);
+
+	/* 16 bytes wrap around */
+	TEST_ASSERT_EQUAL_INT(16, Wire.requestFrom(0x50, 16));
+	length = Wire.peekSpan(&rx);
+	TEST_ASSERT_EQUAL_INT(8, length);
+	TEST_ASSERT_EQUAL_INT(24, rx[0]);
+	Wire.consume(length);
+	length = Wire.peekSpan(&rx);
+	TEST_ASSERT_EQUAL_INT(8, length);
+	TEST_ASSERT_EQUAL_INT(32, rx[0]);
+	Wire.consume(length);
+	TEST_ASSERT_EQUAL_INT(0, Wire.available());
+
+	/* Encode in place behind address byte */
+	Wire.beginTransmission(0x50);
+	length = Wire.reserveSpan(&tx);
+	TEST_ASSERT_EQUAL_INT(TWOWIREPLUS_RINGBUFFER_SIZE - TwoWirePlus_txRingBuffer.head, length);
+	tx[0] = 0x04;
+	for (i=1; i<5; i++)
+	{
+		tx[i] = 0xa0 + i;
+	}
+	Wire.commit(5);
+	TEST_ASSERT_EQUAL_INT(TW_MT_DATA_ACK, Wire.endTransmission());
+	for (i=1; i<5; i++)
+	{
+		TEST_ASSERT_EQUAL_INT(0xa0 + i, memory[3 + i]);
+	}
+
+	/* Commit while nothing is sent starts transfer of first byte */
+	Wire.beginTransmission(0x50);
+	while (!TwoWirePlus_RingBufferEmpty(TwoWirePlus_txRingBuffer))
+	{
+		TwoWirePlus_BaseTest_twiModelStep();
+	}
+	length = Wire.reserveSpan(&tx);
+	TEST_ASSERT(length >= 2);
+	tx[0] = 0x10;
+	tx[1] = 0x55;
+	Wire.commit(2);
+	TEST_ASSERT_EQUAL_INT(TW_MT_DATA_ACK, Wire.endTransmission());
+	TEST_ASSERT_EQUAL_INT(0x55, memory[0x10]);
+	Wire.setWaiter(NULL);
+}
+
+/**
+ * Ping-pong: Application processes one buffer while ISR fills the other. Buffers not released
+ * in time are counted as overrun, buffer owned by application is never overwritten.
+ */
+static void TwoWirePlus_BaseTest_PingPong_TC1(void)
+{
+	uint8_t memory[64];
+	TwoWirePlus_BaseTest_Device_t device = {0x50, memory, sizeof(memory), 0, false};
+	uint8_t bufferA[8], bufferB[8];
+	uint8_t *buffer;
+	int records = 0;
+	int i;
+
+	TwoWirePlus_BaseTest_resetBuffer();
+	TwoWirePlus_BaseTest_twiModelReset();
+	TwoWirePlus_BaseTest_twiModelAddDevice(&device);
+	for (i=0; i<(int)sizeof(memory); i++)
+	{
+		memory[i] = i;
+	}
+	Wire.setWaiter(&TwoWirePlus_BaseTest_twiModelWaiter);
+	Wire.beginTransmission(0x50);
+	Wire.write(0x00);
+	Wire.endTransmission();
+
+	/* Release each buffer right away: five records in alternating buffers */
+	Wire.beginPingPong(bufferA, bufferB, sizeof(bufferA));
+	Wire.beginReception(0x50);
+	Wire.requestBytes(40);
+	while (Wire.getBytesToReceive() || (Wire.getFilledBuffer() != NULL))
+	{
+		TwoWirePlus_BaseTest_twiModelStep();
+		buffer = Wire.getFilledBuffer();
+		if (buffer != NULL)
+		{
+			TEST_ASSERT(buffer == ((records & 1) ? bufferB : bufferA));
+			for (i=0; i<8; i++)
+			{
+				TEST_ASSERT_EQUAL_INT(records * 8 + i, buffer[i]);
+			}
+			records++;
+			Wire.releaseBuffer(buffer);
+		}
+	}
+	Wire.endReception();
+	TEST_ASSERT_EQUAL_INT(5, records);
+	TEST_ASSERT_EQUAL_INT(0, Wire.getPingPongOverruns());
+	TEST_ASSERT_EQUAL_INT(0, Wire.available());
+
+	/* Never released: first record is kept, all following ones are overruns */
+	Wire.beginPingPong(bufferA, bufferB, sizeof(bufferA));
+	Wire.beginReception(0x50);
+	Wire.requestBytes(24);
+	Wire.endReception();
+	buffer = Wire.getFilledBuffer();
+	TEST_ASSERT(buffer == bufferA);
+	TEST_ASSERT_EQUAL_INT(40, bufferA[0]);
+	TEST_ASSERT_EQUAL_INT(2, Wire.getPingPongOverruns());
+	Wire.beginPingPong(NULL, NULL, 0);
+	Wire.setWaiter(NULL);
+}
+
+/**
+ * Timestamps: Time of reception is captured by ISR, not by application. Main loop latency
+ * after reception does not change timestamps.
+ */
+static void TwoWirePlus_BaseTest_Timestamp_TC1(void)
+{
+	uint8_t memory[16] = {0};
+	TwoWirePlus_BaseTest_Device_t device = {0x50, memory, sizeof(memory), 0, false};
+	uint8_t pointer = 0x00;
+	uint8_t data[8];
+	TwoWirePlus_Transaction_t transaction = TWOWIREPLUS_TRANSACTION_INIT(0x50, &pointer, 1, data, sizeof(data));
+	uint32_t rxEnd;
+
+	TwoWirePlus_BaseTest_resetBuffer();
+	TwoWirePlus_BaseTest_twiModelReset();
+	TwoWirePlus_BaseTest_twiModelAddDevice(&device);
+	Wire.setWaiter(&TwoWirePlus_BaseTest_twiModelWaiter);
+
+	Wire.queue(&transaction);
+	TEST_ASSERT_EQUAL_INT(TWOWIREPLUS_TRANSACTION_DONE, Wire.waitFor(&transaction));
+	/* Eight bytes of nine bit times each at 100 kHz */
+	TEST_ASSERT_EQUAL_INT(8 * 9 * 10, transaction.rxEnd - transaction.rxStart);
+	TEST_ASSERT(transaction.rxEnd <= TwoWirePlus_BaseTest_micros);
+	rxEnd = transaction.rxEnd;
+	/* Application gets round to the data much later */
+	TwoWirePlus_BaseTest_micros += 5000;
+	TEST_ASSERT_EQUAL_INT(rxEnd, transaction.rxEnd);
+	Wire.setWaiter(NULL);
+}
+
+/**
+ * Bitwise reference implementations of CRCs
+ */
+static uint8_t TwoWirePlus_BaseTest_crc8(uint8_t crc, uint8_t data)
+{
+	crc ^= data;
+	for (int i=0; i<8; i++)
+	{
+		crc = (crc & 0x80) ? (uint8_t)((crc << 1) ^ 0x07) : (uint8_t)(crc << 1);
+	}
+	return crc;
+}
+
+static uint8_t TwoWirePlus_BaseTest_crc8Word(uint8_t crc, uint8_t data)
+{
+	crc ^= data;
+	for (int i=0; i<8; i++)
+	{
+		crc = (crc & 0x80) ? (uint8_t)((crc << 1) ^ 0x31) : (uint8_t)(crc << 1);
+	}
+	return crc;
+}
+
+static uint16_t TwoWirePlus_BaseTest_crc16(uint16_t crc, uint8_t data)
+{
+	crc ^= (uint16_t)data << 8;
+	for (int i=0; i<8; i++)
+	{
+		crc = (crc & 0x8000) ? (uint16_t)((crc << 1) ^ 0x1021) : (uint16_t)(crc << 1);
+	}
+	return crc;
+}
+
+/**
+ * CRC: PEC is appended to writes and checked on reads, CRC-16 and CRC-8 of each word are checked
+ * on data read. Result is reported in transaction state.
+ */
+static void TwoWirePlus_BaseTest_Crc_TC1(void)
+{
+	uint8_t memory[16] = {0};
+	TwoWirePlus_BaseTest_Device_t device = {0x50, memory, sizeof(memory), 0, false};
+	const uint8_t write[] = {0x02, 0x5a};
+	uint8_t pointer = 0x08;
+	uint8_t data[4];
+	uint8_t words[6];
+	TwoWirePlus_Transaction_t transaction = TWOWIREPLUS_TRANSACTION_INIT(0x50, write, sizeof(write), NULL, 0);
+	uint16_t crc;
+	int i;
+
+	TwoWirePlus_BaseTest_resetBuffer();
+	TwoWirePlus_BaseTest_twiModelReset();
+	TwoWirePlus_BaseTest_twiModelAddDevice(&device);
+	Wire.setWaiter(&TwoWirePlus_BaseTest_twiModelWaiter);
+
+	/* Nibble tables match bitwise calculation */
+	for (i=0; i<256; i++)
+	{
+		TEST_ASSERT_EQUAL_INT(TwoWirePlus_BaseTest_crc8(0x5a, i), TwoWirePlus_crc8(0x5a, i));
+		TEST_ASSERT_EQUAL_INT(TwoWirePlus_BaseTest_crc16(0x1d0f, i), TwoWirePlus_crc16(0x1d0f, i));
+		TEST_ASSERT_EQUAL_INT(TwoWirePlus_BaseTest_crc8Word(0x5a, i), TwoWirePlus_crc8Word(0x5a, i));
+	}
+	/* Check value from sensor data sheets */
+	TEST_ASSERT_EQUAL_INT(0x92, TwoWirePlus_crc8Word(TwoWirePlus_crc8Word(0xff, 0xbe), 0xef));
+
+	/* PEC over SLA+W, register and data is appended */
+	transaction.crcMode = TWOWIREPLUS_CRC_PEC;
+	Wire.queue(&transaction);
+	TEST_ASSERT_EQUAL_INT(TWOWIREPLUS_TRANSACTION_DONE, Wire.waitFor(&transaction));
+	crc = TwoWirePlus_BaseTest_crc8(TwoWirePlus_BaseTest_crc8(TwoWirePlus_BaseTest_crc8(0, 0xa0), 0x02), 0x5a);
+	TEST_ASSERT_EQUAL_INT(0x5a, memory[2]);
+	TEST_ASSERT_EQUAL_INT(crc, memory[3]);
+
+	/* PEC over SLA+W, register, SLA+R and data is checked */
+	memory[8] = 0x11;
+	memory[9] = TwoWirePlus_BaseTest_crc8(TwoWirePlus_BaseTest_crc8(TwoWirePlus_BaseTest_crc8(
+			TwoWirePlus_BaseTest_crc8(0, 0xa0), 0x08), 0xa1), 0x11);
+	transaction.txData = &pointer;
+	transaction.txLength = 1;
+	transaction.rxData = data;
+	transaction.rxLength = 2;
+	Wire.queue(&transaction);
+	TEST_ASSERT_EQUAL_INT(TWOWIREPLUS_TRANSACTION_DONE, Wire.waitFor(&transaction));
+	TEST_ASSERT_EQUAL_INT(0x11, data[0]);
+	memory[8] = 0x12;
+	Wire.queue(&transaction);
+	TEST_ASSERT_EQUAL_INT(TWOWIREPLUS_TRANSACTION_CRC_ERROR, Wire.waitFor(&transaction));
+
+	/* CRC-16 over data only */
+	memory[8] = 0x31;
+	memory[9] = 0x32;
+	crc = TwoWirePlus_BaseTest_crc16(TwoWirePlus_BaseTest_crc16(0xffff, 0x31), 0x32);
+	memory[10] = crc >> 8;
+	memory[11] = crc & 0xff;
+	transaction.crcMode = TWOWIREPLUS_CRC_16;
+	transaction.rxLength = 4;
+	Wire.queue(&transaction);
+	TEST_ASSERT_EQUAL_INT(TWOWIREPLUS_TRANSACTION_DONE, Wire.waitFor(&transaction));
+	memory[11] ^= 0x01;
+	Wire.queue(&transaction);
+	TEST_ASSERT_EQUAL_INT(TWOWIREPLUS_TRANSACTION_CRC_ERROR, Wire.waitFor(&transaction));
+
+	/* CRC-8 after each word read, checksums stay in data */
+	memory[8] = 0xbe;
+	memory[9] = 0xef;
+	memory[10] = 0x92;
+	memory[11] = 0x12;
+	memory[12] = 0x34;
+	memory[13] = 0x37;
+	transaction.crcMode = TWOWIREPLUS_CRC_WORD;
+	transaction.rxData = words;
+	transaction.rxLength = sizeof(words);
+	Wire.queue(&transaction);
+	TEST_ASSERT_EQUAL_INT(TWOWIREPLUS_TRANSACTION_DONE, Wire.waitFor(&transaction));
+	TEST_ASSERT_EQUAL_INT(0, memcmp(&memory[8], words, sizeof(words)));
+	/* Mismatch of first word is not hidden by valid second word */
+	memory[9] ^= 0x01;
+	Wire.queue(&transaction);
+	TEST_ASSERT_EQUAL_INT(TWOWIREPLUS_TRANSACTION_CRC_ERROR, Wire.waitFor(&transaction));
+	memory[9] ^= 0x01;
+	memory[13] ^= 0x80;
+	Wire.queue(&transaction);
+	TEST_ASSERT_EQUAL_INT(TWOWIREPLUS_TRANSACTION_CRC_ERROR, Wire.waitFor(&transaction));
+
+	/* No checksum */
+	transaction.crcMode = TWOWIREPLUS_CRC_NONE;
+	Wire.queue(&transaction);
+	TEST_ASSERT_EQUAL_INT(TWOWIREPLUS_TRANSACTION_DONE, Wire.waitFor(&transaction));
+	Wire.setWaiter(NULL);
+}
+
+/**
+ * CRC: Host time per byte of nibble table compared to bitwise calculation and overhead of
+ * checksum calculated in ISR per transferred byte.
+ */
+static void TwoWirePlus_BaseTest_Crc_TC2(void)
+{
+	uint8_t memory[64] = {0};
+	TwoWirePlus_BaseTest_Device_t device = {0x50, memory, sizeof(memory), 0, false};
+	uint8_t pointer = 0;
+	uint8_t data[32];
+	TwoWirePlus_Transaction_t transaction = TWOWIREPLUS_TRANSACTION_INIT(0x50, &pointer, 1, data, sizeof(data));
+	struct timespec start, end;
+	volatile uint16_t crc = 0;
+	double ns[4];
+	int i, j;
+
+	TwoWirePlus_BaseTest_resetBuffer();
+	TwoWirePlus_BaseTest_twiModelReset();
+	TwoWirePlus_BaseTest_twiModelAddDevice(&device);
+	Wire.setWaiter(&TwoWirePlus_BaseTest_twiModelWaiter);
+
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	for (i=0; i<100000; i++)
+	{
+		crc = TwoWirePlus_BaseTest_crc8(crc, i);
+	}
+	clock_gettime(CLOCK_MONOTONIC, &end);
+	ns[0] = ((end.tv_sec - start.tv_sec) * 1e9 + (end.tv_nsec - start.tv_nsec)) / 100000.0;
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	for (i=0; i<100000; i++)
+	{
+		crc = TwoWirePlus_crc8(crc, i);
+	}
+	clock_gettime(CLOCK_MONOTONIC, &end);
+	ns[1] = ((end.tv_sec - start.tv_sec) * 1e9 + (end.tv_nsec - start.tv_nsec)) / 100000.0;
+
+	/* Transactions reading 32 bytes with and without CRC-16 */
+	for (j=0; j<2; j++)
+	{
+		transaction.crcMode = j ? TWOWIREPLUS_CRC_16 : TWOWIREPLUS_CRC_NONE;
+		clock_gettime(CLOCK_MONOTONIC, &start);
+		for (i=0; i<1000; i++)
+		{
+			Wire.queue(&transaction);
+			Wire.waitFor(&transaction);
+		}
+		clock_gettime(CLOCK_MONOTONIC, &end);
+		ns[2 + j] = ((end.tv_sec - start.tv_sec) * 1e9 + (end.tv_nsec - start.tv_nsec)) / (1000.0 * 33);
+	}
+	/* All zero data with CRC-16 is invalid */
+	TEST_ASSERT_EQUAL_INT(TWOWIREPLUS_TRANSACTION_CRC_ERROR, transaction.state);
+	printf("\nCRC: CRC-8 %.1f ns/byte bitwise, %.1f ns/byte nibble table (16 bytes flash); ISR CRC-16 overhead %.1f ns/byte\n",
+			ns[0], ns[1], ns[3] - ns[2]);
+	Wire.setWaiter(NULL);
+}
+
+/**
+ * Run bus model in a separate thread emulating two wire hardware. Driver shall block on a
+ * pthread condition and shall be notified by ISR running in model thread.
+ */
+static void TwoWirePlus_BaseTest_WaitHook_TC2(void)
+{
+	uint8_t memory[16] = {0};
+	TwoWirePlus_BaseTest_Device_t device = {0x51, memory, sizeof(memory), 0, false};
+	int i;
+
+	TwoWirePlus_BaseTest_resetBuffer();
+	TwoWirePlus_BaseTest_twiModelReset();
+	TwoWirePlus_BaseTest_twiModelAddDevice(&device);
+	TwoWirePlus_BaseTest_twiModelThreadStart();
+	Wire.setWaiter(&TwoWirePlus_BaseTest_twiModelThreadWaiter);
+
+	Wire.beginTransmission(0x51);
+	Wire.write(0x00);
+	for (i=0; i<12; i++)
+	{
+		Wire.write(0x30 + i);
+	}
+	TEST_ASSERT_EQUAL_INT(TW_MT_DATA_ACK, Wire.endTransmission());
+	Wire.beginTransmission(0x51);
+	Wire.write(0x02);
+	Wire.endTransmission();
+	TEST_ASSERT_EQUAL_INT(10, Wire.requestFrom(0x51, 10));
+
+	Wire.setWaiter(NULL);
+	TwoWirePlus_BaseTest_twiModelThreadStop();
+	for (i=0; i<10; i++)
+	{
+		TEST_ASSERT_EQUAL_INT(0x32 + i, Wire.read());
+	}
+	/* Every ISR call shall have notified driver from model thread */
+	TEST_ASSERT_EQUAL_INT(TwoWirePlus_BaseTest_twiModelIsrCalls, TwoWirePlus_BaseTest_twiModelThreadNotifications);
+	TEST_ASSERT(TwoWirePlus_BaseTest_twiModelThreadNotifications > 0);
+}
+
+/**
+ * In slave mode, first byte written by master shall set register pointer and following bytes
+ * shall be written to register file. Reads shall start at register pointer. Writes beyond
+ * register file shall be NACKed and reads beyond shall return 0xff.
+ */
+static void TwoWirePlus_BaseTest_Slave_TC1(void)
+{
+	uint8_t registers[8] = {0};
+	uint8_t large[256] = {0};
+	uint8_t frame[] = {0x02, 0x11, 0x22, 0x33};
+	uint8_t data[8];
+
+	TwoWirePlus_BaseTest_resetBuffer();
+	TwoWirePlus_BaseTest_twiModelReset();
+	Wire.beginSlave(0x33, registers, sizeof(registers));
+	TEST_ASSERT_EQUAL_INT(0x33 << 1, TWAR);
+	TEST_ASSERT_EQUAL_INT((TWOWIREPLUS_BASETEST_TWCR_TWIE | TWOWIREPLUS_BASETEST_TWCR_TWEN | TWOWIREPLUS_BASETEST_TWCR_TWEA), TWCR);
+	/* Other address shall not be ACKed */
+	TEST_ASSERT_EQUAL_INT(0, TwoWirePlus_BaseTest_twiModelMasterWrite(0x34, frame, sizeof(frame)));
+
+	TEST_ASSERT_EQUAL_INT(4, TwoWirePlus_BaseTest_twiModelMasterWrite(0x33, frame, sizeof(frame)));
+	TEST_ASSERT_EQUAL_INT(0x00, registers[1]);
+	TEST_ASSERT_EQUAL_INT(0x11, registers[2]);
+	TEST_ASSERT_EQUAL_INT(0x22, registers[3]);
+	TEST_ASSERT_EQUAL_INT(0x33, registers[4]);
+	TEST_ASSERT_EQUAL_INT(0x00, registers[5]);
+	/* Slave shall keep recognizing own address */
+	TEST_ASSERT((TWCR & TWOWIREPLUS_BASETEST_TWCR_TWEA) != 0);
+
+	/* Set register pointer and read */
+	frame[0] = 0x03;
+	TEST_ASSERT_EQUAL_INT(1, TwoWirePlus_BaseTest_twiModelMasterWrite(0x33, frame, 1));
+	TEST_ASSERT_EQUAL_INT(2, TwoWirePlus_BaseTest_twiModelMasterRead(0x33, data, 2));
+	TEST_ASSERT_EQUAL_INT(0x22, data[0]);
+	TEST_ASSERT_EQUAL_INT(0x33, data[1]);
+
+	/* Write beyond register file shall be NACKed */
+	frame[0] = 0x06;
+	TEST_ASSERT_EQUAL_INT(3, TwoWirePlus_BaseTest_twiModelMasterWrite(0x33, frame, 4));
+	TEST_ASSERT_EQUAL_INT(0x11, registers[6]);
+	TEST_ASSERT_EQUAL_INT(0x22, registers[7]);
+	TEST_ASSERT((TWCR & TWOWIREPLUS_BASETEST_TWCR_TWEA) != 0);
+	/* Read beyond register file */
+	frame[0] = 0x07;
+	TwoWirePlus_BaseTest_twiModelMasterWrite(0x33, frame, 1);
+	TEST_ASSERT_EQUAL_INT(3, TwoWirePlus_BaseTest_twiModelMasterRead(0x33, data, 3));
+	TEST_ASSERT_EQUAL_INT(0x22, data[0]);
+	TEST_ASSERT_EQUAL_INT(0xff, data[1]);
+	TEST_ASSERT_EQUAL_INT(0xff, data[2]);
+
+	/* Pointer does not wrap in a 256 byte register file */
+	Wire.beginSlave(0x33, large, sizeof(large));
+	frame[0] = 0xff;
+	TEST_ASSERT_EQUAL_INT(2, TwoWirePlus_BaseTest_twiModelMasterWrite(0x33, frame, 3));
+	TEST_ASSERT_EQUAL_INT(0x11, large[0xff]);
+	TEST_ASSERT_EQUAL_INT(0x00, large[0x00]);
+}
+
+/**
+ * Sustained slave throughput: host writes and reads back 32 byte frames. ISR shall be called
+ * exactly once per byte and register file shall be accessed in place. Throughput is limited
+ * by the bus only.
+ */
+static void TwoWirePlus_BaseTest_Slave_TC2(void)
+{
+	uint8_t registers[64];
+	uint8_t frame[33];
+	uint8_t data[32];
+	uint32_t payload = 0;
+	int i, j;
+
+	TwoWirePlus_BaseTest_resetBuffer();
+	TwoWirePlus_BaseTest_twiModelReset();
+	Wire.beginSlave(0x33, registers, sizeof(registers));
+	for (i=0; i<32; i++)
+	{
+		frame[0] = (i % 2) * 32;
+		for (j=0; j<32; j++)
+		{
+			frame[j + 1] = i + j;
+		}
+		TEST_ASSERT_EQUAL_INT(33, TwoWirePlus_BaseTest_twiModelMasterWrite(0x33, frame, 33));
+		TwoWirePlus_BaseTest_twiModelMasterWrite(0x33, frame, 1);
+		TEST_ASSERT_EQUAL_INT(32, TwoWirePlus_BaseTest_twiModelMasterRead(0x33, data, 32));
+		TEST_ASSERT_EQUAL_INT(0, memcmp(&frame[1], data, 32));
+		payload += 64;
+	}
+	/* Write: SLA + 33 bytes + STOP, set pointer: SLA + 1 byte + STOP, read: SLA + 32 bytes */
+	TEST_ASSERT_EQUAL_INT(32 * (35 + 3 + 33), TwoWirePlus_BaseTest_twiModelIsrCalls);
+	printf("\nSlave: %lu payload bytes in %lu us at 100 kHz, %lu bytes/s, %lu ISR calls\n",
+			(unsigned long)payload, TwoWirePlus_BaseTest_micros,
+			(unsigned long)((payload * 1000000UL) / TwoWirePlus_BaseTest_micros),
+			(unsigned long)TwoWirePlus_BaseTest_twiModelIsrCalls);
+}
+
+/**
+ * Bytes read by receive callback of frame mode slave tests
+ */
+static uint8_t TwoWirePlus_BaseTest_frameData[16];
+static uint8_t TwoWirePlus_BaseTest_frameLengths[4];
+static uint8_t TwoWirePlus_BaseTest_frames = 0;
+
+/**
+ * Receive callback which records frame length and reads only first byte of frame
+ */
+static void TwoWirePlus_BaseTest_onReceive(uint8_t numberOfBytes)
+{
+	TwoWirePlus_BaseTest_frameLengths[TwoWirePlus_BaseTest_frames] = numberOfBytes;
+	TwoWirePlus_BaseTest_frameData[TwoWirePlus_BaseTest_frames] = Wire.read();
+	TwoWirePlus_BaseTest_frames++;
+}
+
+/**
+ * Receive callback which reads as long as bytes are available and tries to read and release
+ * more bytes afterwards
+ */
+static void TwoWirePlus_BaseTest_onReceiveGreedy(uint8_t numberOfBytes)
+{
+	uint8_t count = 0;
+	TwoWirePlus_BaseTest_frameLengths[TwoWirePlus_BaseTest_frames] = numberOfBytes;
+	while (Wire.available())
+	{
+		TwoWirePlus_BaseTest_frameData[4 * TwoWirePlus_BaseTest_frames + count++] = Wire.read();
+	}
+	TEST_ASSERT_EQUAL_INT(numberOfBytes, count);
+	TEST_ASSERT_EQUAL_INT(0x00, Wire.read());
+	Wire.consume(2);
+	TwoWirePlus_BaseTest_frames++;
+}
+
+/**
+ * Frame mode slave: Frames are queued in ISR and processed in order by poll. Bytes not read
+ * by callback shall be discarded, callback can't read beyond its frame. ISR shall only be
+ * called once per byte plus SLA and STOP.
+ */
+static void TwoWirePlus_BaseTest_Slave_TC3(void)
+{
+	uint8_t frame1[] = {0x11, 0x12, 0x13};
+	uint8_t frame2[] = {0x21, 0x22, 0x23, 0x24};
+
+	TwoWirePlus_BaseTest_resetBuffer();
+	TwoWirePlus_BaseTest_twiModelReset();
+	TwoWirePlus_BaseTest_frames = 0;
+	Wire.beginSlave(0x33);
+	Wire.onReceive(TwoWirePlus_BaseTest_onReceive);
+	TEST_ASSERT_EQUAL_INT(0x33 << 1, TWAR);
+	TEST_ASSERT_EQUAL_INT(0, Wire.poll());
+
+	TEST_ASSERT_EQUAL_INT(3, TwoWirePlus_BaseTest_twiModelMasterWrite(0x33, frame1, sizeof(frame1)));
+	TEST_ASSERT_EQUAL_INT(4, TwoWirePlus_BaseTest_twiModelMasterWrite(0x33, frame2, sizeof(frame2)));
+	TEST_ASSERT_EQUAL_INT((3 + 2) + (4 + 2), TwoWirePlus_BaseTest_twiModelIsrCalls);
+	/* Nothing is processed in ISR */
+	TEST_ASSERT_EQUAL_INT(0, TwoWirePlus_BaseTest_frames);
+	TEST_ASSERT_EQUAL_INT(7, Wire.available());
+
+	TEST_ASSERT_EQUAL_INT(2, Wire.poll());
+	TEST_ASSERT_EQUAL_INT(2, TwoWirePlus_BaseTest_frames);
+	TEST_ASSERT_EQUAL_INT(3, TwoWirePlus_BaseTest_frameLengths[0]);
+	TEST_ASSERT_EQUAL_INT(0x11, TwoWirePlus_BaseTest_frameData[0]);
+	TEST_ASSERT_EQUAL_INT(4, TwoWirePlus_BaseTest_frameLengths[1]);
+	TEST_ASSERT_EQUAL_INT(0x21, TwoWirePlus_BaseTest_frameData[1]);
+	TEST_ASSERT_EQUAL_INT(0, Wire.available());
+	TEST_ASSERT_EQUAL_INT(0, Wire.poll());
+	TEST_ASSERT_EQUAL_INT(0, Wire.getSlaveOverruns());
+
+	/* Callback reading and releasing more than its frame */
+	TwoWirePlus_BaseTest_frames = 0;
+	Wire.onReceive(TwoWirePlus_BaseTest_onReceiveGreedy);
+	TwoWirePlus_BaseTest_twiModelMasterWrite(0x33, frame1, sizeof(frame1));
+	TwoWirePlus_BaseTest_twiModelMasterWrite(0x33, frame2, sizeof(frame2));
+	TEST_ASSERT_EQUAL_INT(2, Wire.poll());
+	TEST_ASSERT_EQUAL_INT(2, TwoWirePlus_BaseTest_frames);
+	TEST_ASSERT_EQUAL_INT(0, memcmp(frame1, &TwoWirePlus_BaseTest_frameData[0], sizeof(frame1)));
+	TEST_ASSERT_EQUAL_INT(0, memcmp(frame2, &TwoWirePlus_BaseTest_frameData[4], sizeof(frame2)));
+	TEST_ASSERT_EQUAL_INT(0, Wire.available());
+}
+
+/**
+ * Reply staged from request callback
+ */
+static const uint8_t TwoWirePlus_BaseTest_reply1[] = {0xa1, 0xa2};
+static const uint8_t TwoWirePlus_BaseTest_reply2[] = {0xb1, 0xb2, 0xb3};
+static void TwoWirePlus_BaseTest_onRequest(void)
+{
+	Wire.setReply(TwoWirePlus_BaseTest_reply2, sizeof(TwoWirePlus_BaseTest_reply2));
+}
+
+/**
+ * Frame mode slave: Pre-staged reply is sent, request callback may stage a different
+ * reply. Reads beyond reply return 0xff.
+ */
+static void TwoWirePlus_BaseTest_Slave_TC4(void)
+{
+	uint8_t data[4];
+
+	TwoWirePlus_BaseTest_resetBuffer();
+	TwoWirePlus_BaseTest_twiModelReset();
+	Wire.beginSlave(0x33);
+	Wire.setReply(TwoWirePlus_BaseTest_reply1, sizeof(TwoWirePlus_BaseTest_reply1));
+	TEST_ASSERT_EQUAL_INT(3, TwoWirePlus_BaseTest_twiModelMasterRead(0x33, data, 3));
+	TEST_ASSERT_EQUAL_INT(0xa1, data[0]);
+	TEST_ASSERT_EQUAL_INT(0xa2, data[1]);
+	TEST_ASSERT_EQUAL_INT(0xff, data[2]);
+	/* Reply is sent from beginning for every request */
+	TEST_ASSERT_EQUAL_INT(1, TwoWirePlus_BaseTest_twiModelMasterRead(0x33, data, 1));
+	TEST_ASSERT_EQUAL_INT(0xa1, data[0]);
+
+	Wire.onRequest(TwoWirePlus_BaseTest_onRequest);
+	TEST_ASSERT_EQUAL_INT(3, TwoWirePlus_BaseTest_twiModelMasterRead(0x33, data, 3));
+	TEST_ASSERT_EQUAL_INT(0xb1, data[0]);
+	TEST_ASSERT_EQUAL_INT(0xb2, data[1]);
+	TEST_ASSERT_EQUAL_INT(0xb3, data[2]);
+	/* Nothing shall be queued for slave transmitter */
+	TEST_ASSERT_EQUAL_INT(0, Wire.poll());
+}
+
+/**
+ * Frame mode slave: Bytes shall be NACKed if event queue or rx ring buffer is full
+ */
+static void TwoWirePlus_BaseTest_Slave_TC5(void)
+{
+	uint8_t frame[TWOWIREPLUS_RINGBUFFER_SIZE + 1];
+	uint8_t i;
+
+	TwoWirePlus_BaseTest_resetBuffer();
+	TwoWirePlus_BaseTest_twiModelReset();
+	memset(frame, 0x5a, sizeof(frame));
+	Wire.beginSlave(0x33);
+	for (i=0; i<TWOWIREPLUS_EVENTQUEUE_SIZE; i++)
+	{
+		TEST_ASSERT_EQUAL_INT(1, TwoWirePlus_BaseTest_twiModelMasterWrite(0x33, frame, 1));
+	}
+	/* Event queue full, first byte is NACKed */
+	TEST_ASSERT_EQUAL_INT(0, TwoWirePlus_BaseTest_twiModelMasterWrite(0x33, frame, 1));
+	TEST_ASSERT_EQUAL_INT(1, Wire.getSlaveOverruns());
+	TEST_ASSERT_EQUAL_INT(TWOWIREPLUS_EVENTQUEUE_SIZE, Wire.poll());
+	TEST_ASSERT_EQUAL_INT(0, Wire.available());
+
+	/* rx ring buffer full, last byte is NACKed, frame is queued nevertheless */
+	TEST_ASSERT_EQUAL_INT(TWOWIREPLUS_RINGBUFFER_SIZE, TwoWirePlus_BaseTest_twiModelMasterWrite(0x33, frame, sizeof(frame)));
+	TEST_ASSERT_EQUAL_INT(2, Wire.getSlaveOverruns());
+	TEST_ASSERT_EQUAL_INT(1, Wire.poll());
+	TEST_ASSERT_EQUAL_INT(0, Wire.available());
+}
+
+/**
+ * Queued transactions: Write, write/read and read only transactions are processed back to
+ * back with STOP followed by START. Own slave address shall stay recognized.
+ */
+static void TwoWirePlus_BaseTest_Transaction_TC1(void)
+{
+	uint8_t memory[16] = {0};
+	TwoWirePlus_BaseTest_Device_t device = {0x50, memory, sizeof(memory), 0, false};
+	uint8_t writeData[] = {0x02, 0x11, 0x22, 0x33};
+	uint8_t pointer = 0x03;
+	uint8_t readData[4] = {0};
+	TwoWirePlus_Transaction_t write = TWOWIREPLUS_TRANSACTION_INIT(0x50, writeData, sizeof(writeData), NULL, 0);
+	TwoWirePlus_Transaction_t writeRead = TWOWIREPLUS_TRANSACTION_INIT(0x50, &pointer, 1, readData, 2);
+	TwoWirePlus_Transaction_t read = TWOWIREPLUS_TRANSACTION_INIT(0x50, NULL, 0, &readData[2], 2);
+	TwoWirePlus_Transaction_t missing = TWOWIREPLUS_TRANSACTION_INIT(0x51, writeData, 1, NULL, 0);
+
+	TwoWirePlus_BaseTest_resetBuffer();
+	TwoWirePlus_BaseTest_twiModelReset();
+	TwoWirePlus_BaseTest_twiModelAddDevice(&device);
+	Wire.setWaiter(&TwoWirePlus_BaseTest_twiModelWaiter);
+	Wire.beginSlave(0x33);
+
+	Wire.queue(&write);
+	Wire.queue(&writeRead);
+	Wire.queue(&missing);
+	Wire.queue(&read);
+	TEST_ASSERT_EQUAL_INT(TWOWIREPLUS_TRANSACTION_QUEUED, read.state);
+	TEST_ASSERT_EQUAL_INT(TWOWIREPLUS_TRANSACTION_DONE, Wire.waitFor(&read));
+	TEST_ASSERT_EQUAL_INT(TWOWIREPLUS_TRANSACTION_DONE, write.state);
+	TEST_ASSERT_EQUAL_INT(TWOWIREPLUS_TRANSACTION_DONE, writeRead.state);
+	TEST_ASSERT_EQUAL_INT(TWOWIREPLUS_TRANSACTION_NACK, missing.state);
+	TEST_ASSERT_EQUAL_INT(0x11, memory[2]);
+	TEST_ASSERT_EQUAL_INT(0x22, memory[3]);
+	TEST_ASSERT_EQUAL_INT(0x33, memory[4]);
+	TEST_ASSERT_EQUAL_INT(0x22, readData[0]);
+	TEST_ASSERT_EQUAL_INT(0x33, readData[1]);
+	/* Read only transaction continues at current register pointer of device */
+	TEST_ASSERT_EQUAL_INT(0x00, readData[2]);
+	TEST_ASSERT_EQUAL_INT(0x00, readData[3]);
+	TEST_ASSERT_EQUAL_INT(7, device.pointer);
+	/* Last STOP was sent, device is still addressable as slave */
+	TEST_ASSERT((TWCR & TWOWIREPLUS_BASETEST_TWCR_TWSTO) == 0);
+	TEST_ASSERT((TWCR & TWOWIREPLUS_BASETEST_TWCR_TWEA) != 0);
+	TEST_ASSERT_EQUAL_INT(2, TwoWirePlus_BaseTest_twiModelMasterWrite(0x33, writeData, 2));
+	TEST_ASSERT_EQUAL_INT(1, Wire.poll());
+	TEST_ASSERT_EQUAL_INT(0, Wire.getArbitrationLosses());
+	Wire.setWaiter(NULL);
+}
+
+/**
+ * Queued transactions: Arbitration is lost to a master addressing this device. Slave frame
+ * shall be received and transaction shall be restarted afterwards. Arbitration lost to a
+ * master addressing another device shall restart the transaction as well.
+ */
+static void TwoWirePlus_BaseTest_Transaction_TC2(void)
+{
+	uint8_t memory[16] = {0};
+	TwoWirePlus_BaseTest_Device_t device = {0x50, memory, sizeof(memory), 0, false};
+	uint8_t writeData[] = {0x04, 0xa1, 0xa2};
+	uint8_t frame[] = {0x5a, 0x5b, 0x5c};
+	TwoWirePlus_Transaction_t write = TWOWIREPLUS_TRANSACTION_INIT(0x50, writeData, sizeof(writeData), NULL, 0);
+
+	TwoWirePlus_BaseTest_resetBuffer();
+	TwoWirePlus_BaseTest_twiModelReset();
+	TwoWirePlus_BaseTest_twiModelAddDevice(&device);
+	Wire.setWaiter(&TwoWirePlus_BaseTest_twiModelWaiter);
+	Wire.beginSlave(0x33);
+	TwoWirePlus_BaseTest_frames = 0;
+	Wire.onReceive(TwoWirePlus_BaseTest_onReceive);
+
+	TwoWirePlus_BaseTest_twiModelLoseArbitration(0x33, frame, sizeof(frame));
+	Wire.queue(&write);
+	TEST_ASSERT_EQUAL_INT(TWOWIREPLUS_TRANSACTION_DONE, Wire.waitFor(&write));
+	TEST_ASSERT_EQUAL_INT(0xa1, memory[4]);
+	TEST_ASSERT_EQUAL_INT(0xa2, memory[5]);
+	TEST_ASSERT_EQUAL_INT(1, Wire.getArbitrationLosses());
+	TEST_ASSERT_EQUAL_INT(1, Wire.poll());
+	TEST_ASSERT_EQUAL_INT(3, TwoWirePlus_BaseTest_frameLengths[0]);
+	TEST_ASSERT_EQUAL_INT(0x5a, TwoWirePlus_BaseTest_frameData[0]);
+
+	memory[4] = 0;
+	TwoWirePlus_BaseTest_twiModelLoseArbitration(0x34, frame, sizeof(frame));
+	Wire.queue(&write);
+	TEST_ASSERT_EQUAL_INT(TWOWIREPLUS_TRANSACTION_DONE, Wire.waitFor(&write));
+	TEST_ASSERT_EQUAL_INT(0xa1, memory[4]);
+	TEST_ASSERT_EQUAL_INT(2, Wire.getArbitrationLosses());
+	TEST_ASSERT_EQUAL_INT(0, Wire.poll());
+	Wire.setWaiter(NULL);
+}
+
+/**
+ * Read-modify-write: Register is read and written back within one transfer using repeated
+ * START. Nothing is written if value does not change.
+ */
+static void TwoWirePlus_BaseTest_Transaction_TC3(void)
+{
+	uint8_t memory[16] = {0};
+	TwoWirePlus_BaseTest_Device_t device = {0x50, memory, sizeof(memory), 0, false};
+	TwoWirePlus_Transaction_t update;
+	uint32_t isrCalls;
+
+	TwoWirePlus_BaseTest_resetBuffer();
+	TwoWirePlus_BaseTest_twiModelReset();
+	TwoWirePlus_BaseTest_twiModelAddDevice(&device);
+	Wire.setWaiter(&TwoWirePlus_BaseTest_twiModelWaiter);
+	memory[5] = 0xa5;
+	memory[6] = 0x77;
+
+	Wire.updateBits(&update, 0x50, 0x05, 0x0f, 0x03);
+	TEST_ASSERT_EQUAL_INT(TWOWIREPLUS_TRANSACTION_DONE, Wire.waitFor(&update));
+	TEST_ASSERT_EQUAL_INT(0xa3, memory[5]);
+	TEST_ASSERT_EQUAL_INT(0xa3, update.buffer[1]);
+	/* Neighbour register untouched */
+	TEST_ASSERT_EQUAL_INT(0x77, memory[6]);
+	/* START, SLA+W, reg, REP_START, SLA+R, data, REP_START, SLA+W, reg, data */
+	TEST_ASSERT_EQUAL_INT(10, TwoWirePlus_BaseTest_twiModelIsrCalls);
+
+	/* Value already set, no write back */
+	isrCalls = TwoWirePlus_BaseTest_twiModelIsrCalls;
+	memory[5] = 0x03;
+	Wire.updateBits(&update, 0x50, 0x05, 0x0f, 0x03);
+	TEST_ASSERT_EQUAL_INT(TWOWIREPLUS_TRANSACTION_DONE, Wire.waitFor(&update));
+	TEST_ASSERT_EQUAL_INT(6, TwoWirePlus_BaseTest_twiModelIsrCalls - isrCalls);
+
+	/* Missing device */
+	Wire.updateBits(&update, 0x51, 0x05, 0x0f, 0x03);
+	TEST_ASSERT_EQUAL_INT(TWOWIREPLUS_TRANSACTION_NACK, Wire.waitFor(&update));
+	Wire.setWaiter(NULL);
+}
+
+/**
+ * Transactions: 10 bit addresses are sent in two bytes, reads are addressed by repeated START.
+ * General call writes reach all devices accepting it at once.
+ */
+static void TwoWirePlus_BaseTest_Transaction_TC4(void)
+{
+	uint8_t memory10[16] = {0};
+	uint8_t memoryOther[16] = {0};
+	uint8_t memoryA[4] = {0};
+	uint8_t memoryB[4] = {0};
+	TwoWirePlus_BaseTest_Device_t device10 = {TWOWIREPLUS_ADDRESS_10BIT(0x2a5), memory10, sizeof(memory10), 0, false};
+	TwoWirePlus_BaseTest_Device_t deviceOther = {TWOWIREPLUS_ADDRESS_10BIT(0x1a5), memoryOther, sizeof(memoryOther), 0, false};
+	TwoWirePlus_BaseTest_Device_t deviceA = {0x20, memoryA, sizeof(memoryA), 0, false, NULL, NULL, NULL, true};
+	TwoWirePlus_BaseTest_Device_t deviceB = {0x21, memoryB, sizeof(memoryB), 0, false, NULL, NULL, NULL, true};
+	const uint8_t write[] = {0x03, 0x11, 0x22};
+	const uint8_t broadcast[] = {0x02, 0x5a};
+	uint8_t data[2] = {0};
+	TwoWirePlus_Transaction_t transaction = TWOWIREPLUS_TRANSACTION_INIT(TWOWIREPLUS_ADDRESS_10BIT(0x2a5), write, sizeof(write), NULL, 0);
+	uint32_t isrCalls;
+
+	TwoWirePlus_BaseTest_resetBuffer();
+	TwoWirePlus_BaseTest_twiModelReset();
+	TwoWirePlus_BaseTest_twiModelAddDevice(&device10);
+	TwoWirePlus_BaseTest_twiModelAddDevice(&deviceOther);
+	TwoWirePlus_BaseTest_twiModelAddDevice(&deviceA);
+	TwoWirePlus_BaseTest_twiModelAddDevice(&deviceB);
+	Wire.setWaiter(&TwoWirePlus_BaseTest_twiModelWaiter);
+
+	/* START, 11110100, 0xa5, 3 data bytes */
+	Wire.queue(&transaction);
+	TEST_ASSERT_EQUAL_INT(TWOWIREPLUS_TRANSACTION_DONE, Wire.waitFor(&transaction));
+	TEST_ASSERT_EQUAL_INT(0x11, memory10[3]);
+	TEST_ASSERT_EQUAL_INT(0x22, memory10[4]);
+	TEST_ASSERT_EQUAL_INT(0x00, memoryOther[3]);
+	TEST_ASSERT_EQUAL_INT(6, TwoWirePlus_BaseTest_twiModelIsrCalls);
+
+	/* START, 11110100, 0xa5, reg, REP_START, 11110101, 2 data bytes */
+	isrCalls = TwoWirePlus_BaseTest_twiModelIsrCalls;
+	transaction.txLength = 1;
+	transaction.rxData = data;
+	transaction.rxLength = sizeof(data);
+	Wire.queue(&transaction);
+	TEST_ASSERT_EQUAL_INT(TWOWIREPLUS_TRANSACTION_DONE, Wire.waitFor(&transaction));
+	TEST_ASSERT_EQUAL_INT(0x11, data[0]);
+	TEST_ASSERT_EQUAL_INT(0x22, data[1]);
+	TEST_ASSERT_EQUAL_INT(8, TwoWirePlus_BaseTest_twiModelIsrCalls - isrCalls);
+
+	/* Read only still needs full address: START, 11110100, 0xa5, REP_START, 11110101, 2 data bytes */
+	isrCalls = TwoWirePlus_BaseTest_twiModelIsrCalls;
+	memory10[5] = 0x33;
+	memory10[6] = 0x44;
+	transaction.txLength = 0;
+	Wire.queue(&transaction);
+	TEST_ASSERT_EQUAL_INT(TWOWIREPLUS_TRANSACTION_DONE, Wire.waitFor(&transaction));
+	TEST_ASSERT_EQUAL_INT(0x33, data[0]);
+	TEST_ASSERT_EQUAL_INT(0x44, data[1]);
+	TEST_ASSERT_EQUAL_INT(7, TwoWirePlus_BaseTest_twiModelIsrCalls - isrCalls);
+
+	/* No 10 bit device with upper address bits 11 */
+	transaction.address = TWOWIREPLUS_ADDRESS_10BIT(0x3a5);
+	Wire.queue(&transaction);
+	TEST_ASSERT_EQUAL_INT(TWOWIREPLUS_TRANSACTION_NACK, Wire.waitFor(&transaction));
+
+	/* One general call write updates both devices */
+	isrCalls = TwoWirePlus_BaseTest_twiModelIsrCalls;
+	transaction.address = TWOWIREPLUS_ADDRESS_GENERALCALL;
+	transaction.txData = broadcast;
+	transaction.txLength = sizeof(broadcast);
+	transaction.rxLength = 0;
+	Wire.queue(&transaction);
+	TEST_ASSERT_EQUAL_INT(TWOWIREPLUS_TRANSACTION_DONE, Wire.waitFor(&transaction));
+	TEST_ASSERT_EQUAL_INT(0x5a, memoryA[2]);
+	TEST_ASSERT_EQUAL_INT(0x5a, memoryB[2]);
+	TEST_ASSERT_EQUAL_INT(4, TwoWirePlus_BaseTest_twiModelIsrCalls - isrCalls);
+	Wire.setWaiter(NULL);
+}
+
+/**
+ * Bus scan: Addresses are probed back to back with repeated START by ISR, about ten bit times
+ * per address. Scan can be limited to a range.
+ */
+static void TwoWirePlus_BaseTest_Transaction_TC5(void)
+{
+	uint8_t memory[4] = {0};
+	TwoWirePlus_BaseTest_Device_t devices[4] = {
+		{0x08, memory, sizeof(memory), 0, false},
+		{0x20, memory, sizeof(memory), 0, false},
+		{0x50, memory, sizeof(memory), 0, false},
+		{0x77, memory, sizeof(memory), 0, false}
+	};
+	uint8_t bitmap[TWOWIREPLUS_SCAN_BITMAP_SIZE + 1];
+	uint32_t bitTimes;
+
+	TwoWirePlus_BaseTest_resetBuffer();
+	TwoWirePlus_BaseTest_twiModelReset();
+	for (int i=0; i<4; i++)
+	{
+		TwoWirePlus_BaseTest_twiModelAddDevice(&devices[i]);
+	}
+	Wire.setWaiter(&TwoWirePlus_BaseTest_twiModelWaiter);
+
+	TEST_ASSERT_EQUAL_INT(4, Wire.scan(bitmap));
+	TEST_ASSERT_EQUAL_INT(0x01, bitmap[0x08 >> 3]);
+	TEST_ASSERT_EQUAL_INT(0x01, bitmap[0x20 >> 3]);
+	TEST_ASSERT_EQUAL_INT(0x01, bitmap[0x50 >> 3]);
+	TEST_ASSERT_EQUAL_INT(0x80, bitmap[0x77 >> 3]);
+	TEST_ASSERT_EQUAL_INT(0x00, bitmap[0x40 >> 3]);
+	/* (REP_)START and SLA+W for each of 112 addresses, STOP */
+	TEST_ASSERT_EQUAL_INT(2 * 112, TwoWirePlus_BaseTest_twiModelIsrCalls);
+	TEST_ASSERT_EQUAL_INT(112 * 10 + 1, TwoWirePlus_BaseTest_twiModelBitTimes);
+	printf("\nScan: 112 addresses in %u us at 100 kHz\n", (unsigned int)TwoWirePlus_BaseTest_micros);
+
+	/* Range only */
+	bitTimes = TwoWirePlus_BaseTest_twiModelBitTimes;
+	TEST_ASSERT_EQUAL_INT(1, Wire.scan(bitmap, 0x40, 0x5f));
+	TEST_ASSERT_EQUAL_INT(0x00, bitmap[0x08 >> 3]);
+	TEST_ASSERT_EQUAL_INT(0x01, bitmap[0x50 >> 3]);
+	TEST_ASSERT_EQUAL_INT(32 * 10 + 1, TwoWirePlus_BaseTest_twiModelBitTimes - bitTimes);
+
+	/* Last address is limited to 7bit, byte following bitmap untouched */
+	bitTimes = TwoWirePlus_BaseTest_twiModelBitTimes;
+	bitmap[TWOWIREPLUS_SCAN_BITMAP_SIZE] = 0x5a;
+	TEST_ASSERT_EQUAL_INT(1, Wire.scan(bitmap, 0x70, 0xff));
+	TEST_ASSERT_EQUAL_INT(0x80, bitmap[0x77 >> 3]);
+	TEST_ASSERT_EQUAL_INT(0x5a, bitmap[TWOWIREPLUS_SCAN_BITMAP_SIZE]);
+	TEST_ASSERT_EQUAL_INT(16 * 10 + 1, TwoWirePlus_BaseTest_twiModelBitTimes - bitTimes);
+	Wire.setWaiter(NULL);
+}
+
+/**
+ * Lets #seconds pass on the idle bus
+ */
+static void TwoWirePlus_BaseTest_idleSeconds(uint32_t seconds)
+{
+	TwoWirePlus_BaseTest_twiModelBitTimes += seconds * TwoWirePlus_BaseTest_twiModelFrequency;
+	TwoWirePlus_BaseTest_micros += seconds * 1000000UL;
+}
+
+/**
+ * Device table: Presence is updated by every address phase, thus, known without probing.
+ * Only stale entries are revalidated, removed and re-plugged devices are detected.
+ */
+static void TwoWirePlus_BaseTest_Transaction_TC6(void)
+{
+	uint8_t memory[4] = {0};
+	TwoWirePlus_BaseTest_Device_t sensor = {0x20, memory, sizeof(memory), 0, false};
+	TwoWirePlus_BaseTest_Device_t eeprom = {0x50, memory, sizeof(memory), 0, false};
+	const uint8_t write[] = {0x00, 0x12};
+	TwoWirePlus_Transaction_t transaction = TWOWIREPLUS_TRANSACTION_INIT(0x20, write, sizeof(write), NULL, 0);
+	TwoWirePlus_Device_t device;
+	uint8_t bitmap[TWOWIREPLUS_SCAN_BITMAP_SIZE];
+	uint32_t isrCalls;
+
+	TwoWirePlus_BaseTest_resetBuffer();
+	TwoWirePlus_BaseTest_twiModelReset();
+	TwoWirePlus_BaseTest_twiModelAddDevice(&sensor);
+	TwoWirePlus_BaseTest_twiModelAddDevice(&eeprom);
+	Wire.setWaiter(&TwoWirePlus_BaseTest_twiModelWaiter);
+
+	TEST_ASSERT(!Wire.isPresent(0x20));
+	TEST_ASSERT_EQUAL_INT(2, Wire.scan(bitmap));
+	TEST_ASSERT(Wire.isPresent(0x20));
+	TEST_ASSERT(Wire.isPresent(0x50));
+	TEST_ASSERT(!Wire.isPresent(0x21));
+	TEST_ASSERT(!Wire.getDevice(0x21, &device));
+	/* Nothing stale, nothing on the bus */
+	isrCalls = TwoWirePlus_BaseTest_twiModelIsrCalls;
+	TEST_ASSERT(!Wire.revalidate(1000000UL));
+	TEST_ASSERT(Wire.isPresent(0x20));
+	TEST_ASSERT_EQUAL_INT(0, TwoWirePlus_BaseTest_twiModelIsrCalls - isrCalls);
+
+	/* Regular traffic keeps sensor fresh, EEPROM is removed meanwhile */
+	TwoWirePlus_BaseTest_idleSeconds(1);
+	Wire.queue(&transaction);
+	TEST_ASSERT_EQUAL_INT(TWOWIREPLUS_TRANSACTION_DONE, Wire.waitFor(&transaction));
+	eeprom.address = 0x51;
+	TEST_ASSERT(Wire.isPresent(0x50));
+	TEST_ASSERT(Wire.revalidate(1000000UL));
+	TEST_ASSERT_EQUAL_INT(TWOWIREPLUS_TRANSACTION_NACK, Wire.waitFor(&TwoWirePlus_probe));
+	TEST_ASSERT(!Wire.isPresent(0x50));
+	TEST_ASSERT(Wire.getDevice(0x50, &device));
+	TEST_ASSERT_EQUAL_INT(1, device.errors);
+	TEST_ASSERT(!Wire.revalidate(1000000UL));
+
+	/* Failing transaction is recorded as well */
+	transaction.address = 0x50;
+	Wire.queue(&transaction);
+	TEST_ASSERT_EQUAL_INT(TWOWIREPLUS_TRANSACTION_NACK, Wire.waitFor(&transaction));
+	TEST_ASSERT(Wire.getDevice(0x50, &device));
+	TEST_ASSERT_EQUAL_INT(2, device.errors);
+
+	/* Re-plugged EEPROM is found by revalidation */
+	eeprom.address = 0x50;
+	TwoWirePlus_BaseTest_idleSeconds(2);
+	isrCalls = TwoWirePlus_BaseTest_twiModelIsrCalls;
+	TEST_ASSERT(Wire.revalidate(1000000UL));
+	TEST_ASSERT_EQUAL_INT(TWOWIREPLUS_TRANSACTION_DONE, Wire.waitFor(&TwoWirePlus_probe));
+	/* Sensor was stalest */
+	TEST_ASSERT(!Wire.isPresent(0x50));
+	TEST_ASSERT(Wire.revalidate(1000000UL));
+	TEST_ASSERT_EQUAL_INT(TWOWIREPLUS_TRANSACTION_DONE, Wire.waitFor(&TwoWirePlus_probe));
+	TEST_ASSERT(Wire.isPresent(0x50));
+	TEST_ASSERT(Wire.isPresent(0x20));
+	/* START and SLA+W per probe */
+	TEST_ASSERT_EQUAL_INT(4, TwoWirePlus_BaseTest_twiModelIsrCalls - isrCalls);
+	Wire.setWaiter(NULL);
+}
+
+/**
+ * Simulated TCA9548A multiplexer with two EEPROMs at the same address on channel 0 and 1.
+ * Devices on deselected channels are moved to an address never used.
+ */
+static TwoWirePlus_BaseTest_Device_t *TwoWirePlus_BaseTest_muxDevices[2];
+static uint32_t TwoWirePlus_BaseTest_muxSelects = 0;
+
+static void TwoWirePlus_BaseTest_muxWrite(uint8_t data)
+{
+	TwoWirePlus_BaseTest_muxSelects++;
+	for (int i=0; i<2; i++)
+	{
+		TwoWirePlus_BaseTest_muxDevices[i]->address = (data & (1 << i)) ? 0x50 : 0x7f;
+	}
+}
+
+/**
+ * Multiplexer: Channel is selected only if it changes. Transactions which may be reordered are
+ * grouped by channel.
+ */
+static void TwoWirePlus_BaseTest_Transaction_TC7(void)
+{
+	uint8_t memory0[8] = {0};
+	uint8_t memory1[8] = {0};
+	TwoWirePlus_BaseTest_Device_t mux = {TWOWIREPLUS_MUX_ADDRESS(0), NULL, 0, 0, false, TwoWirePlus_BaseTest_muxWrite};
+	TwoWirePlus_BaseTest_Device_t eeprom0 = {0x7f, memory0, sizeof(memory0), 0, false};
+	TwoWirePlus_BaseTest_Device_t eeprom1 = {0x7f, memory1, sizeof(memory1), 0, false};
+	const uint8_t write[][2] = {{0x00, 0x11}, {0x01, 0x22}, {0x02, 0x33}, {0x03, 0x44}, {0x04, 0x55}, {0x05, 0x66}};
+	TwoWirePlus_Transaction_t transactions[6];
+	uint32_t isrCalls;
+
+	TwoWirePlus_BaseTest_resetBuffer();
+	TwoWirePlus_BaseTest_twiModelReset();
+	TwoWirePlus_BaseTest_twiModelAddDevice(&mux);
+	TwoWirePlus_BaseTest_twiModelAddDevice(&eeprom0);
+	TwoWirePlus_BaseTest_twiModelAddDevice(&eeprom1);
+	TwoWirePlus_BaseTest_muxDevices[0] = &eeprom0;
+	TwoWirePlus_BaseTest_muxDevices[1] = &eeprom1;
+	TwoWirePlus_BaseTest_muxSelects = 0;
+	Wire.setWaiter(&TwoWirePlus_BaseTest_twiModelWaiter);
+	for (int i=0; i<6; i++)
+	{
+		TwoWirePlus_transactionInit(&transactions[i], 0x50, write[i], 2, NULL, 0);
+		transactions[i].mux = TWOWIREPLUS_MUX_ADDRESS(0);
+	}
+
+	/* First access selects channel: START, SLA+W, mask, REP_START, SLA+W, reg, data */
+	Wire.queue(&transactions[0]);
+	TEST_ASSERT_EQUAL_INT(TWOWIREPLUS_TRANSACTION_DONE, Wire.waitFor(&transactions[0]));
+	TEST_ASSERT_EQUAL_INT(0x11, memory0[0]);
+	TEST_ASSERT_EQUAL_INT(7, TwoWirePlus_BaseTest_twiModelIsrCalls);
+	/* Same channel again: no select */
+	isrCalls = TwoWirePlus_BaseTest_twiModelIsrCalls;
+	Wire.queue(&transactions[1]);
+	TEST_ASSERT_EQUAL_INT(TWOWIREPLUS_TRANSACTION_DONE, Wire.waitFor(&transactions[1]));
+	TEST_ASSERT_EQUAL_INT(0x22, memory0[1]);
+	TEST_ASSERT_EQUAL_INT(4, TwoWirePlus_BaseTest_twiModelIsrCalls - isrCalls);
+	TEST_ASSERT_EQUAL_INT(1, TwoWirePlus_BaseTest_muxSelects);
+
+	/* Channels 1, 0, 1 are grouped to 1, 1, 0 */
+	for (int i=2; i<5; i++)
+	{
+		transactions[i].channel = (i == 3) ? 0 : 1;
+		transactions[i].flags = TWOWIREPLUS_TRANSACTION_FLAG_REORDER;
+		Wire.queue(&transactions[i]);
+	}
+	TEST_ASSERT(transactions[2].next == &transactions[4]);
+	TEST_ASSERT_EQUAL_INT(TWOWIREPLUS_TRANSACTION_DONE, Wire.waitFor(&transactions[3]));
+	TEST_ASSERT_EQUAL_INT(TWOWIREPLUS_TRANSACTION_DONE, transactions[4].state);
+	TEST_ASSERT_EQUAL_INT(0x33, memory1[2]);
+	TEST_ASSERT_EQUAL_INT(0x44, memory0[3]);
+	TEST_ASSERT_EQUAL_INT(0x55, memory1[4]);
+	TEST_ASSERT_EQUAL_INT(3, TwoWirePlus_BaseTest_muxSelects);
+
+	/* Transaction which must not be overtaken keeps order: 1, 0, 1 */
+	for (int i=2; i<5; i++)
+	{
+		transactions[i].flags = (i == 3) ? 0 : TWOWIREPLUS_TRANSACTION_FLAG_REORDER;
+		Wire.queue(&transactions[i]);
+	}
+	TEST_ASSERT_EQUAL_INT(TWOWIREPLUS_TRANSACTION_DONE, Wire.waitFor(&transactions[4]));
+	TEST_ASSERT_EQUAL_INT(6, TwoWirePlus_BaseTest_muxSelects);
+
+	/* Missing multiplexer */
+	transactions[5].mux = TWOWIREPLUS_MUX_ADDRESS(1);
+	Wire.queue(&transactions[5]);
+	TEST_ASSERT_EQUAL_INT(TWOWIREPLUS_TRANSACTION_NACK, Wire.waitFor(&transactions[5]));
+	Wire.setWaiter(NULL);
+}
+
+/**
+ * TWI event pending while interrupts are disabled: Queuing a transaction must not write TWCR,
+ * START is requested by ISR after it processed the event.
+ */
+static void TwoWirePlus_BaseTest_Transaction_TC8(void)
+{
+	uint8_t memory[16] = {0};
+	TwoWirePlus_BaseTest_Device_t device = {0x50, memory, sizeof(memory), 0, false};
+	uint8_t writeData[] = {0x04, 0xa1};
+	TwoWirePlus_Transaction_t write = TWOWIREPLUS_TRANSACTION_INIT(0x50, writeData, sizeof(writeData), NULL, 0);
+
+	TwoWirePlus_BaseTest_resetBuffer();
+	TwoWirePlus_BaseTest_twiModelReset();
+	TwoWirePlus_BaseTest_twiModelAddDevice(&device);
+	Wire.setWaiter(&TwoWirePlus_BaseTest_twiModelWaiter);
+	Wire.beginSlave(0x33);
+	TwoWirePlus_BaseTest_frames = 0;
+	Wire.onReceive(TwoWirePlus_BaseTest_onReceive);
+
+	/* Own SLA+W arrived, ISR did not run yet */
+	cli();
+	TWSR = TW_SR_SLA_ACK;
+	TWCR |= _BV(TWINT);
+	Wire.queue(&write);
+	TEST_ASSERT(!(TWCR & _BV(TWSTA)));
+	TEST_ASSERT(TWCR & _BV(TWINT));
+	sei();
+	TWI_vect();
+	/* Slave frame is received, START follows its STOP */
+	TWDR = 0x5a;
+	TWSR = TW_SR_DATA_ACK;
+	TWI_vect();
+	TWSR = TW_SR_STOP;
+	TWI_vect();
+	TEST_ASSERT(TWCR & _BV(TWSTA));
+	TEST_ASSERT_EQUAL_INT(TWOWIREPLUS_TRANSACTION_DONE, Wire.waitFor(&write));
+	TEST_ASSERT_EQUAL_INT(0xa1, memory[4]);
+	TEST_ASSERT_EQUAL_INT(1, Wire.poll());
+	TEST_ASSERT_EQUAL_INT(1, TwoWirePlus_BaseTest_frameLengths[0]);
+	TEST_ASSERT_EQUAL_INT(0x5a, TwoWirePlus_BaseTest_frameData[0]);
+
+	/* Any other event is not taken for the queued transaction */
+	memory[4] = 0;
+	cli();
+	TWSR = TW_BUS_ERROR;
+	TWCR |= _BV(TWINT);
+	Wire.queue(&write);
+	TEST_ASSERT(!(TWCR & _BV(TWSTA)));
+	sei();
+	TWI_vect();
+	TEST_ASSERT(TWCR & _BV(TWSTA));
+	TEST_ASSERT_EQUAL_INT(TWOWIREPLUS_TRANSACTION_DONE, Wire.waitFor(&write));
+	TEST_ASSERT_EQUAL_INT(0xa1, memory[4]);
+	Wire.setWaiter(NULL);
+}
+
+/**
+ * Second simulated multiplexer, channel 0 connects device #TwoWirePlus_BaseTest_muxDevices[1]
+ */
+static void TwoWirePlus_BaseTest_mux1Write(uint8_t data)
+{
+	TwoWirePlus_BaseTest_muxSelects++;
+	TwoWirePlus_BaseTest_muxDevices[1]->address = (data & 0x01) ? 0x50 : 0x7f;
+}
+
+/**
+ * First simulated multiplexer, channel 0 connects device #TwoWirePlus_BaseTest_muxDevices[0]
+ */
+static void TwoWirePlus_BaseTest_mux0Write(uint8_t data)
+{
+	TwoWirePlus_BaseTest_muxSelects++;
+	TwoWirePlus_BaseTest_muxDevices[0]->address = (data & 0x01) ? 0x50 : 0x7f;
+}
+
+/**
+ * Multiplexer: Channels of other multiplexers are deselected ahead of a transaction, also ahead
+ * of a transaction to a directly connected device with the same address.
+ */
+static void TwoWirePlus_BaseTest_Transaction_TC9(void)
+{
+	uint8_t memory0[8] = {0};
+	uint8_t memory1[8] = {0};
+	uint8_t memoryDirect[8] = {0};
+	TwoWirePlus_BaseTest_Device_t mux0 = {TWOWIREPLUS_MUX_ADDRESS(0), NULL, 0, 0, false, TwoWirePlus_BaseTest_mux0Write};
+	TwoWirePlus_BaseTest_Device_t mux1 = {TWOWIREPLUS_MUX_ADDRESS(1), NULL, 0, 0, false, TwoWirePlus_BaseTest_mux1Write};
+	TwoWirePlus_BaseTest_Device_t eeprom0 = {0x7f, memory0, sizeof(memory0), 0, false};
+	TwoWirePlus_BaseTest_Device_t eeprom1 = {0x7f, memory1, sizeof(memory1), 0, false};
+	TwoWirePlus_BaseTest_Device_t direct = {0x50, memoryDirect, sizeof(memoryDirect), 0, false};
+	const uint8_t write[][2] = {{0x00, 0x11}, {0x01, 0x22}, {0x02, 0x33}, {0x03, 0x44}};
+	TwoWirePlus_Transaction_t transactions[4];
+	uint32_t isrCalls;
+
+	TwoWirePlus_BaseTest_resetBuffer();
+	TwoWirePlus_BaseTest_twiModelReset();
+	/* Devices behind multiplexers are found first if they share the address with direct device */
+	TwoWirePlus_BaseTest_twiModelAddDevice(&mux0);
+	TwoWirePlus_BaseTest_twiModelAddDevice(&mux1);
+	TwoWirePlus_BaseTest_twiModelAddDevice(&eeprom0);
+	TwoWirePlus_BaseTest_twiModelAddDevice(&eeprom1);
+	TwoWirePlus_BaseTest_twiModelAddDevice(&direct);
+	TwoWirePlus_BaseTest_muxDevices[0] = &eeprom0;
+	TwoWirePlus_BaseTest_muxDevices[1] = &eeprom1;
+	TwoWirePlus_BaseTest_muxSelects = 0;
+	Wire.setWaiter(&TwoWirePlus_BaseTest_twiModelWaiter);
+	for (int i=0; i<4; i++)
+	{
+		TwoWirePlus_transactionInit(&transactions[i], 0x50, write[i], 2, NULL, 0);
+	}
+	transactions[0].mux = TWOWIREPLUS_MUX_ADDRESS(0);
+	transactions[1].mux = TWOWIREPLUS_MUX_ADDRESS(1);
+
+	/* Select channel of first multiplexer */
+	Wire.queue(&transactions[0]);
+	TEST_ASSERT_EQUAL_INT(TWOWIREPLUS_TRANSACTION_DONE, Wire.waitFor(&transactions[0]));
+	TEST_ASSERT_EQUAL_INT(0x11, memory0[0]);
+	TEST_ASSERT_EQUAL_INT(1, TwoWirePlus_BaseTest_muxSelects);
+
+	/* Other multiplexer: First one is deselected, START, SLA+W, 0, REP_START, SLA+W, mask, REP_START, SLA+W, reg, data */
+	isrCalls = TwoWirePlus_BaseTest_twiModelIsrCalls;
+	Wire.queue(&transactions[1]);
+	TEST_ASSERT_EQUAL_INT(TWOWIREPLUS_TRANSACTION_DONE, Wire.waitFor(&transactions[1]));
+	TEST_ASSERT_EQUAL_INT(10, TwoWirePlus_BaseTest_twiModelIsrCalls - isrCalls);
+	TEST_ASSERT_EQUAL_INT(3, TwoWirePlus_BaseTest_muxSelects);
+	TEST_ASSERT_EQUAL_INT(0x22, memory1[1]);
+	TEST_ASSERT_EQUAL_INT(0, memory0[1]);
+
+	/* Directly connected device: Second multiplexer is deselected */
+	Wire.queue(&transactions[2]);
+	TEST_ASSERT_EQUAL_INT(TWOWIREPLUS_TRANSACTION_DONE, Wire.waitFor(&transactions[2]));
+	TEST_ASSERT_EQUAL_INT(4, TwoWirePlus_BaseTest_muxSelects);
+	TEST_ASSERT_EQUAL_INT(0x33, memoryDirect[2]);
+	TEST_ASSERT_EQUAL_INT(0, memory1[2]);
+
+	/* All channels deselected: START, SLA+W, reg, data */
+	isrCalls = TwoWirePlus_BaseTest_twiModelIsrCalls;
+	Wire.queue(&transactions[3]);
+	TEST_ASSERT_EQUAL_INT(TWOWIREPLUS_TRANSACTION_DONE, Wire.waitFor(&transactions[3]));
+	TEST_ASSERT_EQUAL_INT(4, TwoWirePlus_BaseTest_twiModelIsrCalls - isrCalls);
+	TEST_ASSERT_EQUAL_INT(4, TwoWirePlus_BaseTest_muxSelects);
+	TEST_ASSERT_EQUAL_INT(0x44, memoryDirect[3]);
+	Wire.setWaiter(NULL);
+}
+
+/**
+ * Simulated conversion sensor. Writing 0x10 to command register starts conversion, status
+ * register 0x00 reports ready (bit 7) after conversion time elapsed, result is in register
+ * 0x01 and 0x02.
+ */
+static uint8_t TwoWirePlus_BaseTest_sensorPointer = 0;
+static bool TwoWirePlus_BaseTest_sensorPointerSet = false;
+static uint8_t TwoWirePlus_BaseTest_sensorBusy = 0;
+static uint32_t TwoWirePlus_BaseTest_sensorStatusReads = 0;
+
+static void TwoWirePlus_BaseTest_sensorWrite(uint8_t data)
+{
+	if (!TwoWirePlus_BaseTest_sensorPointerSet)
+	{
+		TwoWirePlus_BaseTest_sensorPointer = data;
+		TwoWirePlus_BaseTest_sensorPointerSet = true;
+		if (data == 0x10)
+		{
+			TwoWirePlus_BaseTest_sensorBusy = 3;
+		}
+	}
+}
+
+static uint8_t TwoWirePlus_BaseTest_sensorRead(void)
+{
+	switch (TwoWirePlus_BaseTest_sensorPointer++)
+	{
+		case 0x00:
+			TwoWirePlus_BaseTest_sensorStatusReads++;
+			if (TwoWirePlus_BaseTest_sensorBusy)
+			{
+				TwoWirePlus_BaseTest_sensorBusy--;
+				return 0x00;
+			}
+			return 0x80;
+		case 0x01:
+			return 0x12;
+		case 0x02:
+			return 0x34;
+		default:
+			return 0xff;
+	}
+}
+
+static void TwoWirePlus_BaseTest_sensorEnd(void)
+{
+	TwoWirePlus_BaseTest_sensorPointerSet = false;
+}
+
+/**
+ * Waiter stepping the model. If bus is idle, one millisecond passes and timer tick of
+ * micro-sequencer is called.
+ */
+static uint32_t TwoWirePlus_BaseTest_ticks = 0;
+static void TwoWirePlus_BaseTest_tickWait(void)
+{
+	sei();
+	if (!TwoWirePlus_BaseTest_twiModelStep())
+	{
+		TwoWirePlus_BaseTest_twiModelBitTimes += TwoWirePlus_BaseTest_twiModelFrequency / 1000;
+		TwoWirePlus_BaseTest_ticks++;
+		TEST_ASSERT(TwoWirePlus_BaseTest_ticks < 1000);
+		cli();
+		TwoWirePlus_tick();
+		sei();
+	}
+}
+static const TwoWirePlus_Waiter_t TwoWirePlus_BaseTest_tickWaiter = { TwoWirePlus_BaseTest_tickWait, NULL };
+
+/**
+ * Micro-sequencer: Start conversion, poll status with delay until ready and read result
+ * without any action of the application.
+ */
+static const uint8_t TwoWirePlus_BaseTest_sensorScript[] PROGMEM = {
+	TWOWIREPLUS_SEQ_START_WRITE(0x40), TWOWIREPLUS_SEQ_WRITE(0x10),
+	/* offset 4 */
+	TWOWIREPLUS_SEQ_DELAY(1),
+	TWOWIREPLUS_SEQ_START_WRITE(0x40), TWOWIREPLUS_SEQ_WRITE(0x00),
+	TWOWIREPLUS_SEQ_START_READ(0x40), TWOWIREPLUS_SEQ_READ(0, 1),
+	TWOWIREPLUS_SEQ_JUMP_IF_CLEAR(0, 0x80, 4),
+	TWOWIREPLUS_SEQ_START_WRITE(0x40), TWOWIREPLUS_SEQ_WRITE(0x01),
+	TWOWIREPLUS_SEQ_START_READ(0x40), TWOWIREPLUS_SEQ_READ(1, 2),
+	TWOWIREPLUS_SEQ_END
+};
+
+static void TwoWirePlus_BaseTest_Sequencer_TC1(void)
+{
+	TwoWirePlus_BaseTest_Device_t sensor = {0x40, NULL, 0, 0, false,
+			TwoWirePlus_BaseTest_sensorWrite, TwoWirePlus_BaseTest_sensorRead, TwoWirePlus_BaseTest_sensorEnd};
+	static const uint8_t missing[] PROGMEM = {TWOWIREPLUS_SEQ_START_WRITE(0x41), TWOWIREPLUS_SEQ_WRITE(0x00), TWOWIREPLUS_SEQ_END};
+	TwoWirePlus_Transaction_t transaction;
+	uint8_t slots[3] = {0};
+
+	TwoWirePlus_BaseTest_resetBuffer();
+	TwoWirePlus_BaseTest_twiModelReset();
+	TwoWirePlus_BaseTest_twiModelAddDevice(&sensor);
+	TwoWirePlus_BaseTest_sensorStatusReads = 0;
+	TwoWirePlus_BaseTest_ticks = 0;
+	Wire.setWaiter(&TwoWirePlus_BaseTest_tickWaiter);
+
+	Wire.run(&transaction, TwoWirePlus_BaseTest_sensorScript, slots);
+	TEST_ASSERT_EQUAL_INT(TWOWIREPLUS_TRANSACTION_DONE, Wire.waitFor(&transaction));
+	/* Busy for three status reads, ready at fourth */
+	TEST_ASSERT_EQUAL_INT(4, TwoWirePlus_BaseTest_sensorStatusReads);
+	TEST_ASSERT_EQUAL_INT(4, TwoWirePlus_BaseTest_ticks);
+	TEST_ASSERT_EQUAL_INT(0x80, slots[0]);
+	TEST_ASSERT_EQUAL_INT(0x12, slots[1]);
+	TEST_ASSERT_EQUAL_INT(0x34, slots[2]);
+
+	/* NACK aborts script */
+	Wire.run(&transaction, missing, slots);
+	TEST_ASSERT_EQUAL_INT(TWOWIREPLUS_TRANSACTION_NACK, Wire.waitFor(&transaction));
+	Wire.setWaiter(NULL);
+}
+
+/**
+ * Micro-sequencer: Interpreter overhead of script compared to plain queued transaction doing the
+ * same transfer. Both need the same number of ISR calls, instructions are read from flash once
+ * per instruction and not per byte, i.e. flash reads don't depend on number of bytes read.
+ */
+static void TwoWirePlus_BaseTest_Sequencer_TC2(void)
+{
+	uint8_t memory[64];
+	TwoWirePlus_BaseTest_Device_t device = {0x50, memory, sizeof(memory), 0, false};
+	static const uint8_t script[] PROGMEM = {
+		TWOWIREPLUS_SEQ_START_WRITE(0x50), TWOWIREPLUS_SEQ_WRITE(0x00),
+		TWOWIREPLUS_SEQ_START_READ(0x50), TWOWIREPLUS_SEQ_READ(0, 32),
+		TWOWIREPLUS_SEQ_END
+	};
+	static const uint8_t shortScript[] PROGMEM = {
+		TWOWIREPLUS_SEQ_START_WRITE(0x50), TWOWIREPLUS_SEQ_WRITE(0x00),
+		TWOWIREPLUS_SEQ_START_READ(0x50), TWOWIREPLUS_SEQ_READ(0, 2),
+		TWOWIREPLUS_SEQ_END
+	};
+	uint8_t pointer = 0;
+	uint8_t slots[32];
+	TwoWirePlus_Transaction_t transaction;
+	TwoWirePlus_Transaction_t plain = TWOWIREPLUS_TRANSACTION_INIT(0x50, &pointer, 1, slots, 32);
+	uint32_t isrCalls, scriptIsrCalls, flashReads, shortFlashReads;
+	int i;
+
+	TwoWirePlus_BaseTest_resetBuffer();
+	TwoWirePlus_BaseTest_twiModelReset();
+	TwoWirePlus_BaseTest_twiModelAddDevice(&device);
+	for (i=0; i<(int)sizeof(memory); i++)
+	{
+		memory[i] = i;
+	}
+	Wire.setWaiter(&TwoWirePlus_BaseTest_twiModelWaiter);
+
+	/* Plain transaction doesn't read flash */
+	isrCalls = TwoWirePlus_BaseTest_twiModelIsrCalls;
+	flashReads = TwoWirePlus_BaseTest_flashReads;
+	Wire.queue(&plain);
+	TEST_ASSERT_EQUAL_INT(TWOWIREPLUS_TRANSACTION_DONE, Wire.waitFor(&plain));
+	isrCalls = TwoWirePlus_BaseTest_twiModelIsrCalls - isrCalls;
+	TEST_ASSERT_EQUAL_INT(0, (int)(TwoWirePlus_BaseTest_flashReads - flashReads));
+
+	/* Script: same ISR calls */
+	memset(slots, 0, sizeof(slots));
+	scriptIsrCalls = TwoWirePlus_BaseTest_twiModelIsrCalls;
+	flashReads = TwoWirePlus_BaseTest_flashReads;
+	Wire.run(&transaction, script, slots);
+	TEST_ASSERT_EQUAL_INT(TWOWIREPLUS_TRANSACTION_DONE, Wire.waitFor(&transaction));
+	flashReads = TwoWirePlus_BaseTest_flashReads - flashReads;
+	scriptIsrCalls = TwoWirePlus_BaseTest_twiModelIsrCalls - scriptIsrCalls;
+	TEST_ASSERT_EQUAL_INT(0, memcmp(memory, slots, sizeof(slots)));
+	TEST_ASSERT_EQUAL_INT((int)isrCalls, (int)scriptIsrCalls);
+
+	/* Script reading 2 instead of 32 bytes: same flash reads */
+	shortFlashReads = TwoWirePlus_BaseTest_flashReads;
+	Wire.run(&transaction, shortScript, slots);
+	TEST_ASSERT_EQUAL_INT(TWOWIREPLUS_TRANSACTION_DONE, Wire.waitFor(&transaction));
+	shortFlashReads = TwoWirePlus_BaseTest_flashReads - shortFlashReads;
+	TEST_ASSERT_EQUAL_INT((int)shortFlashReads, (int)flashReads);
+	printf("\nSequencer: %u ISR calls plain and script, %u flash reads per script independent of bytes read\n",
+			(unsigned)isrCalls, (unsigned)flashReads);
+	Wire.setWaiter(NULL);
+}
+
+/**
+ * Micro-sequencer: Init scripts of two devices with power-up delays, stored in flash. Queued
+ * with one call, the bus is used by one device while the other one waits. Boot-to-ready time
+ * is compared to running both scripts one after another.
+ */
+static constexpr uint8_t TwoWirePlus_BaseTest_initScript50[] PROGMEM = {
+	TWOWIREPLUS_SEQ_START_WRITE(0x50), TWOWIREPLUS_SEQ_WRITE_BYTES(3), 0x00, 0xa0, 0xa1,
+	TWOWIREPLUS_SEQ_DELAY(5),
+	TWOWIREPLUS_SEQ_START_WRITE(0x50), TWOWIREPLUS_SEQ_WRITE_BYTES(2), 0x02, 0xa2,
+	TWOWIREPLUS_SEQ_DELAY(2),
+	TWOWIREPLUS_SEQ_END
+};
+static constexpr uint8_t TwoWirePlus_BaseTest_initScript51[] PROGMEM = {
+	TWOWIREPLUS_SEQ_START_WRITE(0x51), TWOWIREPLUS_SEQ_WRITE_BYTES(2), 0x00, 0xb0,
+	TWOWIREPLUS_SEQ_DELAY(4),
+	TWOWIREPLUS_SEQ_START_WRITE(0x51), TWOWIREPLUS_SEQ_WRITE_BYTES(3), 0x01, 0xb1, 0xb2,
+	TWOWIREPLUS_SEQ_END
+};
+static const uint8_t * const TwoWirePlus_BaseTest_initScripts[] = {
+	TwoWirePlus_BaseTest_initScript50, TwoWirePlus_BaseTest_initScript51
+};
+
+static void TwoWirePlus_BaseTest_Sequencer_TC3(void)
+{
+	uint8_t memory50[4], memory51[4];
+	TwoWirePlus_BaseTest_Device_t device50 = {0x50, memory50, sizeof(memory50), 0, false};
+	TwoWirePlus_BaseTest_Device_t device51 = {0x51, memory51, sizeof(memory51), 0, false};
+	const uint8_t expected50[] = {0xa0, 0xa1, 0xa2, 0x00};
+	const uint8_t expected51[] = {0xb0, 0xb1, 0xb2, 0x00};
+	TwoWirePlus_Transaction_t transactions[2];
+	uint32_t sequentialBitTimes, interleavedBitTimes;
+	uint32_t sequentialTicks;
+
+	TwoWirePlus_BaseTest_resetBuffer();
+	TwoWirePlus_BaseTest_twiModelReset();
+	TwoWirePlus_BaseTest_twiModelAddDevice(&device50);
+	TwoWirePlus_BaseTest_twiModelAddDevice(&device51);
+	Wire.setWaiter(&TwoWirePlus_BaseTest_tickWaiter);
+
+	/* One after another */
+	memset(memory50, 0, sizeof(memory50));
+	memset(memory51, 0, sizeof(memory51));
+	TwoWirePlus_BaseTest_ticks = 0;
+	TwoWirePlus_BaseTest_twiModelBitTimes = 0;
+	Wire.run(&transactions[0], TwoWirePlus_BaseTest_initScript50, NULL);
+	TEST_ASSERT_EQUAL_INT(TWOWIREPLUS_TRANSACTION_DONE, Wire.waitFor(&transactions[0]));
+	Wire.run(&transactions[1], TwoWirePlus_BaseTest_initScript51, NULL);
+	TEST_ASSERT_EQUAL_INT(TWOWIREPLUS_TRANSACTION_DONE, Wire.waitFor(&transactions[1]));
+	sequentialBitTimes = TwoWirePlus_BaseTest_twiModelBitTimes;
+	sequentialTicks = TwoWirePlus_BaseTest_ticks;
+	TEST_ASSERT_EQUAL_INT(0, memcmp(expected50, memory50, sizeof(memory50)));
+	TEST_ASSERT_EQUAL_INT(0, memcmp(expected51, memory51, sizeof(memory51)));
+	TEST_ASSERT_EQUAL_INT(5 + 2 + 4, sequentialTicks);
+
+	/* One submission */
+	memset(memory50, 0, sizeof(memory50));
+	memset(memory51, 0, sizeof(memory51));
+	TwoWirePlus_BaseTest_ticks = 0;
+	TwoWirePlus_BaseTest_twiModelBitTimes = 0;
+	Wire.run(transactions, TwoWirePlus_BaseTest_initScripts, 2);
+	TEST_ASSERT_EQUAL_INT(TWOWIREPLUS_TRANSACTION_DONE, Wire.waitFor(&transactions[0]));
+	TEST_ASSERT_EQUAL_INT(TWOWIREPLUS_TRANSACTION_DONE, Wire.waitFor(&transactions[1]));
+	interleavedBitTimes = TwoWirePlus_BaseTest_twiModelBitTimes;
+	TEST_ASSERT_EQUAL_INT(0, memcmp(expected50, memory50, sizeof(memory50)));
+	TEST_ASSERT_EQUAL_INT(0, memcmp(expected51, memory51, sizeof(memory51)));
+	/* Delay of second device elapses while first one waits */
+	TEST_ASSERT_EQUAL_INT(5 + 2, TwoWirePlus_BaseTest_ticks);
+	TEST_ASSERT(interleavedBitTimes < sequentialBitTimes);
+	printf("\nSequencer: boot-to-ready %lu us sequential, %lu us with one submission\n",
+			(unsigned long)((uint64_t)sequentialBitTimes * 1000000 / TwoWirePlus_BaseTest_twiModelFrequency),
+			(unsigned long)((uint64_t)interleavedBitTimes * 1000000 / TwoWirePlus_BaseTest_twiModelFrequency));
+	Wire.setWaiter(NULL);
+}
+
+/**
+ * Write merging: Writes to adjacent registers become one burst, queued on flush, on a write which
+ * does not continue the burst or when the deadline elapsed. Writes never wait for the bus, only
+ * flush does.
+ */
+static void TwoWirePlus_BaseTest_Coalesce_TC1(void)
+{
+	uint8_t memory[16] = {0};
+	TwoWirePlus_BaseTest_Device_t device = {0x50, memory, sizeof(memory), 0, false};
+	const uint8_t data[] = {0x11, 0x22, 0x33, 0x44};
+	uint8_t large[TWOWIREPLUS_COALESCE_SIZE + 1] = {0};
+	uint32_t isrCalls;
+
+	TwoWirePlus_BaseTest_resetBuffer();
+	TwoWirePlus_BaseTest_twiModelReset();
+	TwoWirePlus_BaseTest_twiModelAddDevice(&device);
+	Wire.setWaiter(&TwoWirePlus_BaseTest_tickWaiter);
+	TwoWirePlus_BaseTest_ticks = 0;
+
+	Wire.setCoalescing(3);
+	Wire.writeRegisters(0x50, 0x00, &data[0], 1);
+	Wire.writeRegisters(0x50, 0x01, &data[1], 2);
+	Wire.writeRegisters(0x50, 0x03, &data[3], 1);
+	TEST_ASSERT_EQUAL_INT(0, TwoWirePlus_BaseTest_twiModelIsrCalls);
+	Wire.flush();
+	TEST_ASSERT_EQUAL_INT(0, memcmp(data, memory, sizeof(data)));
+	/* START, SLA+W, reg and four data bytes instead of three separate transfers */
+	TEST_ASSERT_EQUAL_INT(7, TwoWirePlus_BaseTest_twiModelIsrCalls);
+
+	/* Gap in register addresses starts a new burst, first one is queued without waiting */
+	isrCalls = TwoWirePlus_BaseTest_twiModelIsrCalls;
+	TEST_ASSERT(Wire.writeRegisters(0x50, 0x08, &data[0], 1));
+	TEST_ASSERT(Wire.writeRegisters(0x50, 0x0a, &data[1], 1));
+	TEST_ASSERT_EQUAL_INT(TWOWIREPLUS_TRANSACTION_QUEUED, TwoWirePlus_coalesce[0].state);
+	/* Another device as well, but both bursts are still queued */
+	TEST_ASSERT(!Wire.writeRegisters(0x51, 0x0b, &data[2], 1));
+	TEST_ASSERT_EQUAL_INT(0, (int)(TwoWirePlus_BaseTest_twiModelIsrCalls - isrCalls));
+	Wire.flush();
+	TEST_ASSERT_EQUAL_INT(0x11, memory[8]);
+	TEST_ASSERT_EQUAL_INT(0x22, memory[10]);
+	TEST_ASSERT(Wire.writeRegisters(0x51, 0x0b, &data[2], 1));
+	/* Too large for a burst */
+	TEST_ASSERT(!Wire.writeRegisters(0x50, 0x00, large, sizeof(large)));
+
+	/* Deadline */
+	Wire.writeRegisters(0x50, 0x0c, &data[3], 1);
+	TwoWirePlus_BaseTest_ticks = 0;
+	while (memory[12] != 0x44)
+	{
+		TwoWirePlus_BaseTest_tickWait();
+	}
+	TEST_ASSERT_EQUAL_INT(3, TwoWirePlus_BaseTest_ticks);
+
+	/* Disabled: queued right away */
+	Wire.setCoalescing(0);
+	TEST_ASSERT(Wire.writeRegisters(0x50, 0x0d, &data[0], 1));
+	TEST_ASSERT_EQUAL_INT(TWOWIREPLUS_TRANSACTION_QUEUED, TwoWirePlus_coalesce[TwoWirePlus_coalesceIndex].state);
+	Wire.flush();
+	TEST_ASSERT_EQUAL_INT(0x11, memory[13]);
+	Wire.setWaiter(NULL);
+}
+
+/**
+ * Frames received by link layer
+ */
+static uint8_t TwoWirePlus_BaseTest_linkPayload[TWOWIREPLUSLINK_MAXPAYLOAD];
+static uint8_t TwoWirePlus_BaseTest_linkLength = 0;
+static uint8_t TwoWirePlus_BaseTest_linkFrames = 0;
+
+static void TwoWirePlus_BaseTest_onFrame(const uint8_t *payload, uint8_t length)
+{
+	memcpy(TwoWirePlus_BaseTest_linkPayload, payload, length);
+	TwoWirePlus_BaseTest_linkLength = length;
+	TwoWirePlus_BaseTest_linkFrames++;
+}
+
+/**
+ * Builds link frame
+ * @return Length of frame
+ */
+static uint8_t TwoWirePlus_BaseTest_linkFrame(uint8_t *frame, uint8_t sequence, const uint8_t *payload, uint8_t length)
+{
+	uint8_t crc = 0;
+	frame[0] = length;
+	frame[1] = sequence;
+	memcpy(&frame[2], payload, length);
+	for (int i=0; i<length + 2; i++)
+	{
+		crc = TwoWirePlusLink_crc8(crc, frame[i]);
+	}
+	frame[length + 2] = crc;
+	return length + TWOWIREPLUSLINK_OVERHEAD;
+}
+
+/**
+ * Link receiver: Valid frames are passed to callback, frames with CRC error are dropped and
+ * gaps in sequence are counted. Status grants credits relative to next expected frame.
+ */
+static void TwoWirePlus_BaseTest_Link_TC1(void)
+{
+	uint8_t buffer[TWOWIREPLUSLINK_MAXPAYLOAD];
+	uint8_t payload[] = {0x10, 0x20, 0x30};
+	uint8_t frame[TWOWIREPLUSLINK_MAXPAYLOAD + TWOWIREPLUSLINK_OVERHEAD];
+	uint8_t status[TWOWIREPLUSLINK_STATUS_SIZE];
+	uint8_t length;
+
+	TwoWirePlus_BaseTest_resetBuffer();
+	TwoWirePlus_BaseTest_twiModelReset();
+	TwoWirePlus_BaseTest_linkFrames = 0;
+	Link.begin(0x33, buffer, TwoWirePlus_BaseTest_onFrame);
+
+	TEST_ASSERT_EQUAL_INT(TWOWIREPLUSLINK_STATUS_SIZE, TwoWirePlus_BaseTest_twiModelMasterRead(0x33, status, sizeof(status)));
+	TEST_ASSERT_EQUAL_INT(0, status[0]);
+	TEST_ASSERT_EQUAL_INT(TWOWIREPLUSLINK_WINDOW, status[1]);
+	TEST_ASSERT_EQUAL_INT(TwoWirePlusLink_crc8(TwoWirePlusLink_crc8(0, status[0]), status[1]), status[2]);
+
+	length = TwoWirePlus_BaseTest_linkFrame(frame, 0, payload, sizeof(payload));
+	TEST_ASSERT_EQUAL_INT(length, TwoWirePlus_BaseTest_twiModelMasterWrite(0x33, frame, length));
+	TEST_ASSERT_EQUAL_INT(0, TwoWirePlus_BaseTest_linkFrames);
+	TEST_ASSERT_EQUAL_INT(1, Link.poll());
+	TEST_ASSERT_EQUAL_INT(1, TwoWirePlus_BaseTest_linkFrames);
+	TEST_ASSERT_EQUAL_INT(3, TwoWirePlus_BaseTest_linkLength);
+	TEST_ASSERT_EQUAL_INT(0, memcmp(payload, TwoWirePlus_BaseTest_linkPayload, sizeof(payload)));
+
+	/* CRC error */
+	length = TwoWirePlus_BaseTest_linkFrame(frame, 1, payload, sizeof(payload));
+	frame[3] ^= 0x01;
+	TwoWirePlus_BaseTest_twiModelMasterWrite(0x33, frame, length);
+	TEST_ASSERT_EQUAL_INT(1, Link.poll());
+	TEST_ASSERT_EQUAL_INT(1, TwoWirePlus_BaseTest_linkFrames);
+	TEST_ASSERT_EQUAL_INT(1, Link.getErrors());
+
+	/* Frames 1 and 2 are missing */
+	length = TwoWirePlus_BaseTest_linkFrame(frame, 3, payload, 1);
+	TwoWirePlus_BaseTest_twiModelMasterWrite(0x33, frame, length);
+	TEST_ASSERT_EQUAL_INT(1, Link.poll());
+	TEST_ASSERT_EQUAL_INT(2, TwoWirePlus_BaseTest_linkFrames);
+	TEST_ASSERT_EQUAL_INT(1, TwoWirePlus_BaseTest_linkLength);
+	TEST_ASSERT_EQUAL_INT(2, Link.getLostFrames());
+
+	TwoWirePlus_BaseTest_twiModelMasterRead(0x33, status, sizeof(status));
+	TEST_ASSERT_EQUAL_INT(4, status[0]);
+	TEST_ASSERT_EQUAL_INT(4 + TWOWIREPLUSLINK_WINDOW, status[1]);
+}
+
+/**
+ * Frames received by link layer as stream of (offset * 7)
+ */
+static uint32_t TwoWirePlus_BaseTest_linkStreamBytes = 0;
+static uint32_t TwoWirePlus_BaseTest_linkStreamMismatches = 0;
+
+static void TwoWirePlus_BaseTest_onStreamFrame(const uint8_t *payload, uint8_t length)
+{
+	for (int i=0; i<length; i++)
+	{
+		if (payload[i] != (uint8_t)((TwoWirePlus_BaseTest_linkStreamBytes + i) * 7))
+		{
+			TwoWirePlus_BaseTest_linkStreamMismatches++;
+		}
+	}
+	TwoWirePlus_BaseTest_linkStreamBytes += length;
+}
+
+/**
+ * Link receiver: Sender streams full frames up to the credit limit without receiver polling in
+ * between. All frames of the window fit into the receiver, next window is granted by poll.
+ */
+static void TwoWirePlus_BaseTest_Link_TC3(void)
+{
+	uint8_t buffer[TWOWIREPLUSLINK_MAXPAYLOAD];
+	uint8_t payload[TWOWIREPLUSLINK_MAXPAYLOAD];
+	uint8_t frame[TWOWIREPLUSLINK_MAXPAYLOAD + TWOWIREPLUSLINK_OVERHEAD];
+	uint8_t status[TWOWIREPLUSLINK_STATUS_SIZE];
+	uint8_t sequence = 0;
+	uint8_t length;
+
+	TEST_ASSERT(TWOWIREPLUSLINK_WINDOW > 1);
+	TwoWirePlus_BaseTest_resetBuffer();
+	TwoWirePlus_BaseTest_twiModelReset();
+	TwoWirePlus_BaseTest_linkStreamBytes = 0;
+	TwoWirePlus_BaseTest_linkStreamMismatches = 0;
+	Link.begin(0x33, buffer, TwoWirePlus_BaseTest_onStreamFrame);
+
+	/* Three windows */
+	for (int window=0; window<3; window++)
+	{
+		TwoWirePlus_BaseTest_twiModelMasterRead(0x33, status, sizeof(status));
+		TEST_ASSERT_EQUAL_INT(sequence, status[0]);
+		TEST_ASSERT_EQUAL_INT((uint8_t)(sequence + TWOWIREPLUSLINK_WINDOW), status[1]);
+		while (sequence != status[1])
+		{
+			for (int i=0; i<TWOWIREPLUSLINK_MAXPAYLOAD; i++)
+			{
+				payload[i] = (uint8_t)((sequence * TWOWIREPLUSLINK_MAXPAYLOAD + i) * 7);
+			}
+			length = TwoWirePlus_BaseTest_linkFrame(frame, sequence, payload, TWOWIREPLUSLINK_MAXPAYLOAD);
+			TEST_ASSERT_EQUAL_INT(length, TwoWirePlus_BaseTest_twiModelMasterWrite(0x33, frame, length));
+			sequence++;
+		}
+		TEST_ASSERT_EQUAL_INT(TWOWIREPLUSLINK_WINDOW, Link.poll());
+	}
+	TEST_ASSERT_EQUAL_INT(0, Wire.getSlaveOverruns());
+	TEST_ASSERT_EQUAL_INT(3 * TWOWIREPLUSLINK_WINDOW * TWOWIREPLUSLINK_MAXPAYLOAD, (int)TwoWirePlus_BaseTest_linkStreamBytes);
+	TEST_ASSERT_EQUAL_INT(0, (int)TwoWirePlus_BaseTest_linkStreamMismatches);
+	TEST_ASSERT_EQUAL_INT(0, Link.getErrors());
+	TEST_ASSERT_EQUAL_INT(0, Link.getLostFrames());
+}
+
+/**
+ * Simulated link receiver endpoint on the bus. Frames are processed immediately, thus,
+ * credits are granted as soon as frame was received.
+ */
+#define TWOWIREPLUS_BASETEST_LINKPEER_WINDOW	8
+static TwoWirePlusLink_Receiver_t TwoWirePlus_BaseTest_linkPeer;
+static uint8_t TwoWirePlus_BaseTest_linkPeerBuffer[TWOWIREPLUSLINK_MAXPAYLOAD];
+static uint8_t TwoWirePlus_BaseTest_linkPeerStatus[TWOWIREPLUSLINK_STATUS_SIZE];
+static uint8_t TwoWirePlus_BaseTest_linkPeerStatusIndex = 0;
+static uint32_t TwoWirePlus_BaseTest_linkPeerBytes = 0;
+static uint32_t TwoWirePlus_BaseTest_linkPeerMismatches = 0;
+static uint32_t TwoWirePlus_BaseTest_linkPeerStatusReads = 0;
+
+static void TwoWirePlus_BaseTest_linkPeerWrite(uint8_t data)
+{
+	TwoWirePlusLink_receiverPut(&TwoWirePlus_BaseTest_linkPeer, data);
+}
+
+static uint8_t TwoWirePlus_BaseTest_linkPeerRead(void)
+{
+	if (TwoWirePlus_BaseTest_linkPeerStatusIndex == 0)
+	{
+		TwoWirePlusLink_receiverStatus(&TwoWirePlus_BaseTest_linkPeer, TwoWirePlus_BaseTest_linkPeerStatus);
+		TwoWirePlus_BaseTest_linkPeerStatusReads++;
+	}
+	return TwoWirePlus_BaseTest_linkPeerStatus[TwoWirePlus_BaseTest_linkPeerStatusIndex++ % TWOWIREPLUSLINK_STATUS_SIZE];
+}
+
+static void TwoWirePlus_BaseTest_linkPeerEnd(void)
+{
+	if (TwoWirePlus_BaseTest_linkPeer.index && TwoWirePlusLink_receiverEnd(&TwoWirePlus_BaseTest_linkPeer))
+	{
+		/* Stream content is (offset * 7) */
+		for (int i=0; i<TwoWirePlus_BaseTest_linkPeer.length; i++)
+		{
+			if (TwoWirePlus_BaseTest_linkPeerBuffer[i] != (uint8_t)((TwoWirePlus_BaseTest_linkPeerBytes + i) * 7))
+			{
+				TwoWirePlus_BaseTest_linkPeerMismatches++;
+			}
+		}
+		TwoWirePlus_BaseTest_linkPeerBytes += TwoWirePlus_BaseTest_linkPeer.length;
+	}
+	TwoWirePlus_BaseTest_linkPeerStatusIndex = 0;
+}
+
+/**
+ * Link sender: Stream 4 KiB to simulated receiver at 400 kHz. All bytes shall arrive in order
+ * without errors. Goodput is reported.
+ */
+static void TwoWirePlus_BaseTest_Link_TC2(void)
+{
+	TwoWirePlus_BaseTest_Device_t peer = {0x42, NULL, 0, 0, false,
+			TwoWirePlus_BaseTest_linkPeerWrite, TwoWirePlus_BaseTest_linkPeerRead, TwoWirePlus_BaseTest_linkPeerEnd};
+	uint8_t data[4096];
+	uint32_t offset = 0;
+	uint8_t length;
+	uint32_t frames = 0;
+	int i;
+
+	for (i=0; i<(int)sizeof(data); i++)
+	{
+		data[i] = (uint8_t)(i * 7);
+	}
+	TwoWirePlus_BaseTest_resetBuffer();
+	TwoWirePlus_BaseTest_twiModelReset();
+	TwoWirePlus_BaseTest_twiModelFrequency = 400000;
+	TwoWirePlus_BaseTest_twiModelAddDevice(&peer);
+	TwoWirePlusLink_receiverReset(&TwoWirePlus_BaseTest_linkPeer, TwoWirePlus_BaseTest_linkPeerBuffer, TWOWIREPLUS_BASETEST_LINKPEER_WINDOW);
+	TwoWirePlus_BaseTest_linkPeerStatusIndex = 0;
+	TwoWirePlus_BaseTest_linkPeerBytes = 0;
+	TwoWirePlus_BaseTest_linkPeerMismatches = 0;
+	TwoWirePlus_BaseTest_linkPeerStatusReads = 0;
+	Wire.setWaiter(&TwoWirePlus_BaseTest_twiModelWaiter);
+
+	TEST_ASSERT(Link.connect(0x42));
+	TEST_ASSERT_EQUAL_INT(TWOWIREPLUS_BASETEST_LINKPEER_WINDOW, Link.getCredits());
+	/* Oversized payload is rejected */
+	TEST_ASSERT(!Link.send(data, TWOWIREPLUSLINK_MAXPAYLOAD + 1));
+	while (offset < sizeof(data))
+	{
+		length = ((sizeof(data) - offset) > TWOWIREPLUSLINK_MAXPAYLOAD) ? TWOWIREPLUSLINK_MAXPAYLOAD : (sizeof(data) - offset);
+		TEST_ASSERT(Link.send(&data[offset], length));
+		offset += length;
+		frames++;
+	}
+	TEST_ASSERT_EQUAL_INT(sizeof(data), TwoWirePlus_BaseTest_linkPeerBytes);
+	TEST_ASSERT_EQUAL_INT(0, TwoWirePlus_BaseTest_linkPeerMismatches);
+	TEST_ASSERT_EQUAL_INT(0, TwoWirePlus_BaseTest_linkPeer.errors);
+	TEST_ASSERT_EQUAL_INT(0, TwoWirePlus_BaseTest_linkPeer.lost);
+	/* Status is only read when credits are used up */
+	TEST_ASSERT_EQUAL_INT(1 + (frames - 1) / TWOWIREPLUS_BASETEST_LINKPEER_WINDOW, TwoWirePlus_BaseTest_linkPeerStatusReads);
+	printf("\nLink: %lu payload bytes in %lu frames, %lu us at 400 kHz, goodput %lu bytes/s (raw bus %lu bytes/s)\n",
+			(unsigned long)sizeof(data), (unsigned long)frames, TwoWirePlus_BaseTest_micros,
+			(unsigned long)(((uint64_t)sizeof(data) * 1000000UL) / TwoWirePlus_BaseTest_micros),
+			(unsigned long)(400000UL / 9));
+	Wire.setWaiter(NULL);
+}
+
+/**
+ * Simulated SMBus battery gauge at address 0x0b. Command 0x20 is a block read returning "BAT1",
+ * command 0x30 a process call returning value plus one, command 0x40 a block write. PEC is
+ * appended to all replies.
+ */
+static uint8_t TwoWirePlus_BaseTest_gaugeCommand = 0;
+static uint8_t TwoWirePlus_BaseTest_gaugeWritten[40];
+static uint8_t TwoWirePlus_BaseTest_gaugeWriteIndex = 0;
+static uint8_t TwoWirePlus_BaseTest_gaugeReply[40];
+static uint8_t TwoWirePlus_BaseTest_gaugeReadIndex = 0;
+
+static void TwoWirePlus_BaseTest_gaugeWrite(uint8_t data)
+{
+	if (TwoWirePlus_BaseTest_gaugeWriteIndex == 0)
+	{
+		TwoWirePlus_BaseTest_gaugeCommand = data;
+	}
+	TwoWirePlus_BaseTest_gaugeWritten[TwoWirePlus_BaseTest_gaugeWriteIndex++] = data;
+}
+
+static uint8_t TwoWirePlus_BaseTest_gaugeRead(void)
+{
+	uint8_t length = 0;
+	uint8_t crc;
+	int i;
+	if (TwoWirePlus_BaseTest_gaugeReadIndex == 0)
+	{
+		if (TwoWirePlus_BaseTest_gaugeCommand == 0x20)
+		{
+			memcpy(TwoWirePlus_BaseTest_gaugeReply, "\x04" "BAT1", 5);
+			length = 5;
+		}
+		else if (TwoWirePlus_BaseTest_gaugeCommand == 0x30)
+		{
+			uint16_t value = (TwoWirePlus_BaseTest_gaugeWritten[1] | (TwoWirePlus_BaseTest_gaugeWritten[2] << 8)) + 1;
+			TwoWirePlus_BaseTest_gaugeReply[0] = value & 0xff;
+			TwoWirePlus_BaseTest_gaugeReply[1] = value >> 8;
+			length = 2;
+		}
+		/* PEC over SLA+W, bytes written, SLA+R and reply */
+		crc = TwoWirePlus_BaseTest_crc8(0, 0x16);
+		for (i=0; i<TwoWirePlus_BaseTest_gaugeWriteIndex; i++)
+		{
+			crc = TwoWirePlus_BaseTest_crc8(crc, TwoWirePlus_BaseTest_gaugeWritten[i]);
+		}
+		crc = TwoWirePlus_BaseTest_crc8(crc, 0x17);
+		for (i=0; i<length; i++)
+		{
+			crc = TwoWirePlus_BaseTest_crc8(crc, TwoWirePlus_BaseTest_gaugeReply[i]);
+		}
+		TwoWirePlus_BaseTest_gaugeReply[length] = crc;
+	}
+	return TwoWirePlus_BaseTest_gaugeReply[TwoWirePlus_BaseTest_gaugeReadIndex++];
+}
+
+static void TwoWirePlus_BaseTest_gaugeEnd(void)
+{
+	/* Bytes written are kept for reply after repeated START */
+	if (TwoWirePlus_BaseTest_gaugeReadIndex)
+	{
+		TwoWirePlus_BaseTest_gaugeWriteIndex = 0;
+	}
+	TwoWirePlus_BaseTest_gaugeReadIndex = 0;
+}
+
+/**
+ * SMBus: Block read in one transfer, process call, block write, quick command and alert
+ * response, with and without PEC
+ */
+static void TwoWirePlus_BaseTest_SMBus_TC1(void)
+{
+	TwoWirePlus_BaseTest_Device_t gauge = {0x0b, NULL, 0, 0, false,
+			TwoWirePlus_BaseTest_gaugeWrite, TwoWirePlus_BaseTest_gaugeRead, TwoWirePlus_BaseTest_gaugeEnd};
+	uint8_t alertMemory[1] = {0x0b << 1};
+	TwoWirePlus_BaseTest_Device_t alert = {TWOWIREPLUSSMBUS_ALERT_ADDRESS, alertMemory, sizeof(alertMemory), 0, false};
+	const uint8_t block[] = {0x01, 0x02, 0x03};
+	const uint8_t oversized[TWOWIREPLUSSMBUS_BLOCK_MAX + 1] = {0};
+	uint8_t data[8];
+	uint8_t length;
+	uint16_t value;
+	uint8_t address = 0;
+	uint32_t isrCalls;
+	int pec;
+
+	TwoWirePlus_BaseTest_resetBuffer();
+	TwoWirePlus_BaseTest_twiModelReset();
+	TwoWirePlus_BaseTest_twiModelAddDevice(&gauge);
+	Wire.setWaiter(&TwoWirePlus_BaseTest_twiModelWaiter);
+	TwoWirePlus_BaseTest_gaugeWriteIndex = 0;
+	TwoWirePlus_BaseTest_gaugeReadIndex = 0;
+
+	for (pec=0; pec<2; pec++)
+	{
+		SMBus.setPec(pec);
+
+		/* Count byte is evaluated during transfer: START, SLA+W, command, REP START, SLA+R,
+		 * count and four data bytes (and PEC) */
+		length = sizeof(data);
+		isrCalls = TwoWirePlus_BaseTest_twiModelIsrCalls;
+		TEST_ASSERT_EQUAL_INT(TWOWIREPLUS_TRANSACTION_DONE, SMBus.blockRead(0x0b, 0x20, data, &length));
+		TEST_ASSERT_EQUAL_INT(4, length);
+		TEST_ASSERT_EQUAL_INT(0, memcmp("BAT1", data, 4));
+		TEST_ASSERT_EQUAL_INT(10 + pec, (int)(TwoWirePlus_BaseTest_twiModelIsrCalls - isrCalls));
+
+		/* Buffer too small */
+		length = 2;
+		TEST_ASSERT_EQUAL_INT((pec ? TWOWIREPLUS_TRANSACTION_CRC_ERROR : TWOWIREPLUS_TRANSACTION_DONE),
+				SMBus.blockRead(0x0b, 0x20, data, &length));
+		TEST_ASSERT_EQUAL_INT((pec ? 0 : 2), length);
+
+		value = 0x12ff;
+		TEST_ASSERT_EQUAL_INT(TWOWIREPLUS_TRANSACTION_DONE, SMBus.processCall(0x0b, 0x30, &value));
+		TEST_ASSERT_EQUAL_INT(0x1300, value);
+
+		TEST_ASSERT_EQUAL_INT(TWOWIREPLUS_TRANSACTION_DONE, SMBus.blockWrite(0x0b, 0x40, block, sizeof(block)));
+		TEST_ASSERT_EQUAL_INT(5 + pec, TwoWirePlus_BaseTest_gaugeWriteIndex);
+		TEST_ASSERT_EQUAL_INT(0x40, TwoWirePlus_BaseTest_gaugeWritten[0]);
+		TEST_ASSERT_EQUAL_INT(3, TwoWirePlus_BaseTest_gaugeWritten[1]);
+		TEST_ASSERT_EQUAL_INT(0, memcmp(block, &TwoWirePlus_BaseTest_gaugeWritten[2], sizeof(block)));
+		if (pec)
+		{
+			uint8_t crc = TwoWirePlus_BaseTest_crc8(0, 0x16);
+			for (int i=0; i<5; i++)
+			{
+				crc = TwoWirePlus_BaseTest_crc8(crc, TwoWirePlus_BaseTest_gaugeWritten[i]);
+			}
+			TEST_ASSERT_EQUAL_INT(crc, TwoWirePlus_BaseTest_gaugeWritten[5]);
+		}
+		TwoWirePlus_BaseTest_gaugeWriteIndex = 0;
+	}
+	SMBus.setPec(false);
+
+	/* Block larger than SMBus limit is refused without bus access */
+	isrCalls = TwoWirePlus_BaseTest_twiModelIsrCalls;
+	TEST_ASSERT_EQUAL_INT(TWOWIREPLUS_TRANSACTION_INVALID, SMBus.blockWrite(0x0b, 0x40, oversized, sizeof(oversized)));
+	TEST_ASSERT_EQUAL_INT(0, (int)(TwoWirePlus_BaseTest_twiModelIsrCalls - isrCalls));
+	TEST_ASSERT_EQUAL_INT(0, TwoWirePlus_BaseTest_gaugeWriteIndex);
+
+	/* Quick command */
+	TEST_ASSERT_EQUAL_INT(TWOWIREPLUS_TRANSACTION_DONE, SMBus.quickCommand(0x0b, 0));
+	TEST_ASSERT_EQUAL_INT(TWOWIREPLUS_TRANSACTION_DONE, SMBus.quickCommand(0x0b, 1));
+	TEST_ASSERT_EQUAL_INT(TWOWIREPLUS_TRANSACTION_NACK, SMBus.quickCommand(0x0c, 0));
+
+	/* No device alerting, then gauge answers alert response address */
+	TEST_ASSERT_EQUAL_INT(TWOWIREPLUS_TRANSACTION_NACK, SMBus.alertResponse(&address));
+	TwoWirePlus_BaseTest_twiModelAddDevice(&alert);
+	TEST_ASSERT_EQUAL_INT(TWOWIREPLUS_TRANSACTION_DONE, SMBus.alertResponse(&address));
+	TEST_ASSERT_EQUAL_INT(0x0b, address);
+	Wire.setWaiter(NULL);
+}
+
+/**
+ * Simulated MCP23017 (IOCON.BANK = 0): Writing GPIO writes OLAT as well, IOCON is mapped to
+ * 0x0A and 0x0B.
+ */
+static TwoWirePlus_BaseTest_Device_t *TwoWirePlus_BaseTest_expander;
+
+static void TwoWirePlus_BaseTest_expanderWrite(uint8_t data)
+{
+	TwoWirePlus_BaseTest_Device_t *device = TwoWirePlus_BaseTest_expander;
+	uint8_t reg = device->pointer % device->size;
+
+	if (!device->pointerSet)
+	{
+		device->pointer = data;
+		device->pointerSet = true;
+		return;
+	}
+	device->memory[reg] = data;
+	if ((reg == 0x12) || (reg == 0x13))
+	{
+		device->memory[reg + 2] = data;
+	}
+	else if ((reg == 0x0a) || (reg == 0x0b))
+	{
+		device->memory[reg ^ 0x01] = data;
+	}
+	device->pointer++;
+}
+
+/**
+ * Shadow registers: Simulated MCP23017 port expander. Unchanged writes and reads of cached
+ * registers don't touch the bus, GPIO, INTF and INTCAP are always read from device. Writes to
+ * GPIO and IOCON drop cached OLAT and the other IOCON address.
+ */
+static void TwoWirePlus_BaseTest_Shadow_TC1(void)
+{
+	uint8_t memory[0x16] = {0};
+	TwoWirePlus_BaseTest_Device_t device = {0x20, memory, sizeof(memory), 0, false, TwoWirePlus_BaseTest_expanderWrite};
+	const uint8_t volatileMask[] = {0x00, 0xc0, 0x0f};
+	const uint8_t sideEffects[] = {0x12, 0x14, 0x13, 0x15, 0x0a, 0x0b, 0x0b, 0x0a};
+	uint8_t registers[0x16];
+	uint8_t registersMissing[0x16];
+	TwoWirePlusShadow expander(0x20, registers, sizeof(registers), volatileMask);
+	TwoWirePlusShadow missing(0x21, registersMissing, sizeof(registersMissing), volatileMask);
+	uint32_t isrCalls;
+	uint8_t value;
+
+	TwoWirePlus_BaseTest_resetBuffer();
+	TwoWirePlus_BaseTest_twiModelReset();
+	TwoWirePlus_BaseTest_twiModelAddDevice(&device);
+	TwoWirePlus_BaseTest_expander = &device;
+	Wire.setWaiter(&TwoWirePlus_BaseTest_twiModelWaiter);
+	expander.setSideEffects(sideEffects, sizeof(sideEffects) / 2);
+
+	/* OLATA written once: START, SLA+W, reg, data */
+	TEST_ASSERT_EQUAL_INT(TWOWIREPLUS_TRANSACTION_DONE, expander.write(0x14, 0x01));
+	TEST_ASSERT_EQUAL_INT(4, TwoWirePlus_BaseTest_twiModelIsrCalls);
+	isrCalls = TwoWirePlus_BaseTest_twiModelIsrCalls;
+	TEST_ASSERT_EQUAL_INT(TWOWIREPLUS_TRANSACTION_DONE, expander.write(0x14, 0x01));
+	TEST_ASSERT_EQUAL_INT(0, TwoWirePlus_BaseTest_twiModelIsrCalls - isrCalls);
+	/* Read-modify-write on cached value, only write on the bus */
+	TEST_ASSERT_EQUAL_INT(TWOWIREPLUS_TRANSACTION_DONE, expander.update(0x14, 0x02, 0x02));
+	TEST_ASSERT_EQUAL_INT(0x03, memory[0x14]);
+	TEST_ASSERT_EQUAL_INT(4, TwoWirePlus_BaseTest_twiModelIsrCalls - isrCalls);
+	isrCalls = TwoWirePlus_BaseTest_twiModelIsrCalls;
+	TEST_ASSERT_EQUAL_INT(TWOWIREPLUS_TRANSACTION_DONE, expander.read(0x14, &value));
+	TEST_ASSERT_EQUAL_INT(0x03, value);
+	TEST_ASSERT_EQUAL_INT(0, TwoWirePlus_BaseTest_twiModelIsrCalls - isrCalls);
+
+	/* GPIOA is volatile */
+	memory[0x12] = 0x55;
+	TEST_ASSERT_EQUAL_INT(TWOWIREPLUS_TRANSACTION_DONE, expander.read(0x12, &value));
+	TEST_ASSERT_EQUAL_INT(0x55, value);
+	memory[0x12] = 0xaa;
+	TEST_ASSERT_EQUAL_INT(TWOWIREPLUS_TRANSACTION_DONE, expander.read(0x12, &value));
+	TEST_ASSERT_EQUAL_INT(0xaa, value);
+	/* START, SLA+W, reg, REP_START, SLA+R, data for each read */
+	TEST_ASSERT_EQUAL_INT(2 * 6, TwoWirePlus_BaseTest_twiModelIsrCalls - isrCalls);
+
+	/* IODIRA is read once */
+	isrCalls = TwoWirePlus_BaseTest_twiModelIsrCalls;
+	memory[0x00] = 0xff;
+	TEST_ASSERT_EQUAL_INT(TWOWIREPLUS_TRANSACTION_DONE, expander.read(0x00, &value));
+	memory[0x00] = 0x00;
+	TEST_ASSERT_EQUAL_INT(TWOWIREPLUS_TRANSACTION_DONE, expander.read(0x00, &value));
+	TEST_ASSERT_EQUAL_INT(0xff, value);
+	TEST_ASSERT_EQUAL_INT(6, TwoWirePlus_BaseTest_twiModelIsrCalls - isrCalls);
+	/* Device was reset */
+	expander.invalidate();
+	TEST_ASSERT_EQUAL_INT(TWOWIREPLUS_TRANSACTION_DONE, expander.read(0x00, &value));
+	TEST_ASSERT_EQUAL_INT(0x00, value);
+
+	/* GPIOA write changes OLATA, which is read from device again */
+	TEST_ASSERT_EQUAL_INT(TWOWIREPLUS_TRANSACTION_DONE, expander.read(0x14, &value));
+	TEST_ASSERT_EQUAL_INT(TWOWIREPLUS_TRANSACTION_DONE, expander.write(0x12, 0x80));
+	TEST_ASSERT_EQUAL_INT(TWOWIREPLUS_TRANSACTION_DONE, expander.read(0x14, &value));
+	TEST_ASSERT_EQUAL_INT(0x80, value);
+	isrCalls = TwoWirePlus_BaseTest_twiModelIsrCalls;
+	TEST_ASSERT_EQUAL_INT(TWOWIREPLUS_TRANSACTION_DONE, expander.write(0x14, 0x80));
+	TEST_ASSERT_EQUAL_INT(0, TwoWirePlus_BaseTest_twiModelIsrCalls - isrCalls);
+
+	/* IOCON written at 0x0A is seen at 0x0B */
+	TEST_ASSERT_EQUAL_INT(TWOWIREPLUS_TRANSACTION_DONE, expander.read(0x0b, &value));
+	TEST_ASSERT_EQUAL_INT(0x00, value);
+	TEST_ASSERT_EQUAL_INT(TWOWIREPLUS_TRANSACTION_DONE, expander.write(0x0a, 0x40));
+	TEST_ASSERT_EQUAL_INT(TWOWIREPLUS_TRANSACTION_DONE, expander.read(0x0b, &value));
+	TEST_ASSERT_EQUAL_INT(0x40, value);
+	TEST_ASSERT_EQUAL_INT(TWOWIREPLUS_TRANSACTION_DONE, expander.write(0x0b, 0x00));
+	TEST_ASSERT_EQUAL_INT(TWOWIREPLUS_TRANSACTION_DONE, expander.read(0x0a, &value));
+	TEST_ASSERT_EQUAL_INT(0x00, value);
+
+	/* Failed writes are not cached */
+	isrCalls = TwoWirePlus_BaseTest_twiModelIsrCalls;
+	TEST_ASSERT_EQUAL_INT(TWOWIREPLUS_TRANSACTION_NACK, missing.write(0x14, 0x03));
+	TEST_ASSERT_EQUAL_INT(TWOWIREPLUS_TRANSACTION_NACK, missing.write(0x14, 0x03));
+	TEST_ASSERT_EQUAL_INT(2 * 2, TwoWirePlus_BaseTest_twiModelIsrCalls - isrCalls);
+	Wire.setWaiter(NULL);
+}
+
+/**
+ * Calibration cache: Simulated BMP280 at 0x76 with chip ID 0x58 in register 0xd0 and 24 bytes
+ * of calibration data at 0x88. Second boot reads chip ID only.
+ */
+static void TwoWirePlus_BaseTest_Calibration_TC1(void)
+{
+	uint8_t memory[256] = {0};
+	TwoWirePlus_BaseTest_Device_t device = {0x76, memory, sizeof(memory), 0, false};
+	uint8_t data[24];
+	uint32_t bitTimes;
+	uint32_t missBitTimes;
+	uint32_t eepromWrites;
+	uint8_t before[TWOWIREPLUSCALIBRATION_RECORD_SIZE(24)];
+	uint8_t after[TWOWIREPLUSCALIBRATION_RECORD_SIZE(24)];
+	uint32_t writes;
+
+	TwoWirePlus_BaseTest_resetBuffer();
+	TwoWirePlus_BaseTest_twiModelReset();
+	TwoWirePlus_BaseTest_twiModelAddDevice(&device);
+	Wire.setWaiter(&TwoWirePlus_BaseTest_twiModelWaiter);
+	memset(TwoWirePlus_BaseTest_eeprom, 0xff, sizeof(TwoWirePlus_BaseTest_eeprom));
+	TwoWirePlus_BaseTest_eepromWrites = 0;
+	memory[0xd0] = 0x58;
+	for (int i=0; i<24; i++)
+	{
+		memory[0x88 + i] = (uint8_t)(0x30 + i);
+	}
+
+	/* First boot: chip ID and block read, record stored */
+	TEST_ASSERT_EQUAL_INT(TWOWIREPLUS_TRANSACTION_DONE, Calibration.read(0x76, 0xd0, 0x88, data, sizeof(data), 0x10));
+	TEST_ASSERT_EQUAL_INT(0, memcmp(&memory[0x88], data, sizeof(data)));
+	TEST_ASSERT_EQUAL_INT(TWOWIREPLUSCALIBRATION_RECORD_SIZE(24), TwoWirePlus_BaseTest_eepromWrites);
+	missBitTimes = TwoWirePlus_BaseTest_twiModelBitTimes;
+
+	/* Second boot: chip ID only */
+	memset(data, 0, sizeof(data));
+	bitTimes = TwoWirePlus_BaseTest_twiModelBitTimes;
+	TEST_ASSERT_EQUAL_INT(TWOWIREPLUS_TRANSACTION_DONE, Calibration.read(0x76, 0xd0, 0x88, data, sizeof(data), 0x10));
+	TEST_ASSERT_EQUAL_INT(0, memcmp(&memory[0x88], data, sizeof(data)));
+	/* START, SLA+W, reg, REP_START, SLA+R, chip ID, STOP */
+	TEST_ASSERT_EQUAL_INT(1 + 9 + 9 + 1 + 9 + 9 + 1, TwoWirePlus_BaseTest_twiModelBitTimes - bitTimes);
+	TEST_ASSERT_EQUAL_INT(TWOWIREPLUSCALIBRATION_RECORD_SIZE(24), TwoWirePlus_BaseTest_eepromWrites);
+	printf("\nCalibration: boot read %lu us from device, %lu us with EEPROM cache at 100 kHz\n",
+			(unsigned long)(missBitTimes * 10), (unsigned long)((TwoWirePlus_BaseTest_twiModelBitTimes - bitTimes) * 10));
+
+	/* Corrupted record is read again, length is invalidated, corrupted cell rewritten and
+	 * length restored */
+	TwoWirePlus_BaseTest_eeprom[0x10 + TWOWIREPLUSCALIBRATION_HEADER_SIZE + 3] ^= 0x01;
+	eepromWrites = TwoWirePlus_BaseTest_eepromWrites;
+	bitTimes = TwoWirePlus_BaseTest_twiModelBitTimes;
+	TEST_ASSERT_EQUAL_INT(TWOWIREPLUS_TRANSACTION_DONE, Calibration.read(0x76, 0xd0, 0x88, data, sizeof(data), 0x10));
+	TEST_ASSERT_EQUAL_INT(0, memcmp(&memory[0x88], data, sizeof(data)));
+	TEST_ASSERT_EQUAL_INT(missBitTimes, TwoWirePlus_BaseTest_twiModelBitTimes - bitTimes);
+	TEST_ASSERT_EQUAL_INT(3, TwoWirePlus_BaseTest_eepromWrites - eepromWrites);
+
+	/* Record torn after length was invalidated is rejected although data and CRC are intact */
+	TwoWirePlus_BaseTest_eeprom[0x10 + 3] = (uint8_t)~24;
+	bitTimes = TwoWirePlus_BaseTest_twiModelBitTimes;
+	TEST_ASSERT_EQUAL_INT(TWOWIREPLUS_TRANSACTION_DONE, Calibration.read(0x76, 0xd0, 0x88, data, sizeof(data), 0x10));
+	TEST_ASSERT_EQUAL_INT(missBitTimes, TwoWirePlus_BaseTest_twiModelBitTimes - bitTimes);
+	TEST_ASSERT_EQUAL_INT(24, TwoWirePlus_BaseTest_eeprom[0x10 + 3]);
+
+	/* Sensor replaced by BME280, i.e. other model with other chip ID */
+	memory[0xd0] = 0x60;
+	memory[0x88] = 0x99;
+	TEST_ASSERT_EQUAL_INT(TWOWIREPLUS_TRANSACTION_DONE, Calibration.read(0x76, 0xd0, 0x88, data, sizeof(data), 0x10));
+	TEST_ASSERT_EQUAL_INT(0x99, data[0]);
+	TEST_ASSERT_EQUAL_INT(0x60, TwoWirePlus_BaseTest_eeprom[0x10 + 1]);
+
+	/* Power loss after each EEPROM write while record is replaced: Length is only valid while
+	 * record is completely old or completely new, next boot always gets data of device */
+	memory[0xd0] = 0x58;
+	for (int i=0; i<24; i++)
+	{
+		memory[0x88 + i] = (uint8_t)(0xc0 + i);
+	}
+	memcpy(before, &TwoWirePlus_BaseTest_eeprom[0x10], sizeof(before));
+	eepromWrites = TwoWirePlus_BaseTest_eepromWrites;
+	TEST_ASSERT_EQUAL_INT(TWOWIREPLUS_TRANSACTION_DONE, Calibration.read(0x76, 0xd0, 0x88, data, sizeof(data), 0x10));
+	memcpy(after, &TwoWirePlus_BaseTest_eeprom[0x10], sizeof(after));
+	writes = TwoWirePlus_BaseTest_eepromWrites - eepromWrites;
+	TEST_ASSERT_EQUAL_INT(24, after[3]);
+	for (uint32_t cut=0; cut<writes; cut++)
+	{
+		memcpy(&TwoWirePlus_BaseTest_eeprom[0x10], before, sizeof(before));
+		TwoWirePlus_BaseTest_eepromWriteLimit = TwoWirePlus_BaseTest_eepromWrites + cut;
+		TEST_ASSERT_EQUAL_INT(TWOWIREPLUS_TRANSACTION_DONE, Calibration.read(0x76, 0xd0, 0x88, data, sizeof(data), 0x10));
+		TwoWirePlus_BaseTest_eepromWriteLimit = UINT32_MAX;
+		if (TwoWirePlus_BaseTest_eeprom[0x10 + 3] == 24)
+		{
+			TEST_ASSERT((memcmp(before, &TwoWirePlus_BaseTest_eeprom[0x10], sizeof(before)) == 0)
+					|| (memcmp(after, &TwoWirePlus_BaseTest_eeprom[0x10], sizeof(after)) == 0));
+		}
+		memset(data, 0, sizeof(data));
+		TEST_ASSERT_EQUAL_INT(TWOWIREPLUS_TRANSACTION_DONE, Calibration.read(0x76, 0xd0, 0x88, data, sizeof(data), 0x10));
+		TEST_ASSERT_EQUAL_INT(0, memcmp(&memory[0x88], data, sizeof(data)));
+	}
+
+	/* Missing sensor */
+	TEST_ASSERT_EQUAL_INT(TWOWIREPLUS_TRANSACTION_NACK, Calibration.read(0x77, 0xd0, 0x88, data, sizeof(data), 0x40));
+	Wire.setWaiter(NULL);
+}
 
 /* Possible further test to be implemented
  *  - No bytes requested but bytes received
@@ -865,6 +3552,7 @@ TestRef TwoWirePlus_BaseTest_RunTests(void)
 	new_TestFixture("beginReception: Check correct address is sent", TwoWirePlus_BaseTest_beginReception_TC1),
 	new_TestFixture("beginReception: No changes to TWDR", TwoWirePlus_BaseTest_beginReception_TC2),
 	new_TestFixture("requestBytes: Check TwoWirePlus_bytesToReceive", TwoWirePlus_BaseTest_requestBytes_TC1),
+	new_TestFixture("requestBytes: Check 16 bit request without wrap", TwoWirePlus_BaseTest_requestBytes_TC2),
 	new_TestFixture("available: Check if available bytes are correct", TwoWirePlus_BaseTest_available_TC1),
 	new_TestFixture("read: Check normal buffer read", TwoWirePlus_BaseTest_read_TC1),
 	new_TestFixture("read: Check buffer read when buffer was used", TwoWirePlus_BaseTest_read_TC2),
@@ -882,6 +3570,47 @@ TestRef TwoWirePlus_BaseTest_RunTests(void)
 	new_TestFixture("RingBuffer: Full/Empty test", TwoWirePlus_BaseTest_RingBuffer_TC2),
 	new_TestFixture("Master Receiver: ",TwoWirePlus_BaseTest_MasterReceiver_TC1),
 	new_TestFixture("Master Receiver: ",TwoWirePlus_BaseTest_MasterReceiver_TC2),
+	new_TestFixture("Master Receiver: Clock stretching on full rx buffer",TwoWirePlus_BaseTest_MasterReceiver_TC3),
+	new_TestFixture("Master Receiver: Stream more than 255 bytes",TwoWirePlus_BaseTest_MasterReceiver_TC4),
+	new_TestFixture("idleSleep: Sleep only if TWI interrupt is expected",TwoWirePlus_BaseTest_idleSleep_TC1),
+	new_TestFixture("setWaiter: Install and restore waiter",TwoWirePlus_BaseTest_setWaiter_TC1),
+	new_TestFixture("setWaitHook: Install and restore hook",TwoWirePlus_BaseTest_setWaitHook_TC1),
+	new_TestFixture("semaphoreWait: Sleep until notified by ISR",TwoWirePlus_BaseTest_semaphoreWait_TC1),
+	new_TestFixture("Wait hook: Write and read simulated device",TwoWirePlus_BaseTest_WaitHook_TC1),
+	new_TestFixture("Wait hook: Notify from model thread",TwoWirePlus_BaseTest_WaitHook_TC2),
+	new_TestFixture("Slave: Register file access",TwoWirePlus_BaseTest_Slave_TC1),
+	new_TestFixture("Slave: Throughput",TwoWirePlus_BaseTest_Slave_TC2),
+	new_TestFixture("Slave: Deferred frame processing",TwoWirePlus_BaseTest_Slave_TC3),
+	new_TestFixture("Slave: Pre-staged reply",TwoWirePlus_BaseTest_Slave_TC4),
+	new_TestFixture("Slave: NACK if queue is full",TwoWirePlus_BaseTest_Slave_TC5),
+	new_TestFixture("Transaction: Queued master transactions",TwoWirePlus_BaseTest_Transaction_TC1),
+	new_TestFixture("Transaction: Arbitration lost",TwoWirePlus_BaseTest_Transaction_TC2),
+	new_TestFixture("Transaction: Read-modify-write",TwoWirePlus_BaseTest_Transaction_TC3),
+	new_TestFixture("Transaction: 10 bit address and general call",TwoWirePlus_BaseTest_Transaction_TC4),
+	new_TestFixture("Transaction: Bus scan",TwoWirePlus_BaseTest_Transaction_TC5),
+	new_TestFixture("Transaction: Device presence table",TwoWirePlus_BaseTest_Transaction_TC6),
+	new_TestFixture("Transaction: Multiplexer channel caching",TwoWirePlus_BaseTest_Transaction_TC7),
+	new_TestFixture("Transaction: START deferred while TWI event is pending",TwoWirePlus_BaseTest_Transaction_TC8),
+	new_TestFixture("Transaction: Other multiplexers deselected",TwoWirePlus_BaseTest_Transaction_TC9),
+	new_TestFixture("Sequencer: Conversion sensor script",TwoWirePlus_BaseTest_Sequencer_TC1),
+	new_TestFixture("Sequencer: Interpreter overhead",TwoWirePlus_BaseTest_Sequencer_TC2),
+	new_TestFixture("Sequencer: Interleaved init scripts",TwoWirePlus_BaseTest_Sequencer_TC3),
+	new_TestFixture("Coalescing: Adjacent register writes",TwoWirePlus_BaseTest_Coalesce_TC1),
+	new_TestFixture("write_P: Bytes from flash",TwoWirePlus_BaseTest_WriteP_TC1),
+	new_TestFixture("fill: Repeated bytes",TwoWirePlus_BaseTest_Fill_TC1),
+	new_TestFixture("stream: Generated bytes",TwoWirePlus_BaseTest_Stream_TC1),
+	new_TestFixture("Consumer: Records during reception",TwoWirePlus_BaseTest_Consumer_TC1),
+	new_TestFixture("Span: In place ring buffer access",TwoWirePlus_BaseTest_Span_TC1),
+	new_TestFixture("Ping-pong: Double buffered reception",TwoWirePlus_BaseTest_PingPong_TC1),
+	new_TestFixture("Timestamp: Captured by ISR",TwoWirePlus_BaseTest_Timestamp_TC1),
+	new_TestFixture("CRC: PEC and CRC-16 in ISR",TwoWirePlus_BaseTest_Crc_TC1),
+	new_TestFixture("CRC: Cost per byte",TwoWirePlus_BaseTest_Crc_TC2),
+	new_TestFixture("Link: Receive frames",TwoWirePlus_BaseTest_Link_TC1),
+	new_TestFixture("Link: Goodput at 400 kHz",TwoWirePlus_BaseTest_Link_TC2),
+	new_TestFixture("Link: Window of frames without poll",TwoWirePlus_BaseTest_Link_TC3),
+	new_TestFixture("SMBus: Protocols",TwoWirePlus_BaseTest_SMBus_TC1),
+	new_TestFixture("Shadow: Register cache",TwoWirePlus_BaseTest_Shadow_TC1),
+	new_TestFixture("Calibration: EEPROM cache",TwoWirePlus_BaseTest_Calibration_TC1),
   };
    EMB_UNIT_TESTCALLER(TwoWirePlus_BaseTest,"TwoWirePlus_BaseTest",setUp,tearDown, fixtures);
    return (TestRef)&TwoWirePlus_BaseTest;
@@ -23,6 +23,9 @@
 #define TWS6 6
 #define TWS7 7
 
+/* TWAR */
+#define TWGCE 0
+
 /* TWCR */
 #define TWIE 0
 #define TWEN 2
@@ -10,6 +10,10 @@
 
 /*******************| Inclusions |*************************************/
 #include <stdint.h>
+#include <stddef.h>
+#include <avr/sleep.h>
+#include <avr/eeprom.h>
+#include <avr/pgmspace.h>
 
 /*******************| Macros |*****************************************/
 
@@ -32,6 +36,26 @@ uint8_t TWSR;
 uint8_t TWBR;
 uint8_t TWCR;
 uint8_t TWDR;
+uint8_t TWAR;
+
+/* Status register, only used for interrupt flag */
+uint8_t SREG = 0x80;
+
+unsigned long TwoWirePlus_BaseTest_micros = 0;
+
+/* Internal EEPROM */
+uint8_t TwoWirePlus_BaseTest_eeprom[TWOWIREPLUS_BASETEST_EEPROM_SIZE];
+uint32_t TwoWirePlus_BaseTest_eepromWrites = 0;
+uint32_t TwoWirePlus_BaseTest_eepromWriteLimit = UINT32_MAX;
+
+/* Flash */
+uint32_t TwoWirePlus_BaseTest_flashReads = 0;
+
+/* Sleep mode registers */
+uint8_t TwoWirePlus_BaseTest_sleepMode = 0;
+uint8_t TwoWirePlus_BaseTest_sleepEnabled = 0;
+uint32_t TwoWirePlus_BaseTest_sleepCount = 0;
+void (*TwoWirePlus_BaseTest_sleepHook)(void) = NULL;
 
 /*******************| Function Definition |****************************/
 
@@ -52,6 +76,52 @@ void digitalWrite(int pinNumber, uint8_t value)
 	}
 }
 
+unsigned long micros(void)
+{
+	return TwoWirePlus_BaseTest_micros;
+}
+
+uint8_t eeprom_read_byte(const uint8_t *address)
+{
+	return TwoWirePlus_BaseTest_eeprom[(size_t)address % TWOWIREPLUS_BASETEST_EEPROM_SIZE];
+}
+
+void eeprom_read_block(void *dst, const void *src, size_t length)
+{
+	for (size_t i=0; i<length; i++)
+	{
+		((uint8_t *)dst)[i] = TwoWirePlus_BaseTest_eeprom[((size_t)src + i) % TWOWIREPLUS_BASETEST_EEPROM_SIZE];
+	}
+}
+
+/* Like avr-libc, only bytes which differ are written */
+void eeprom_update_block(const void *src, void *dst, size_t length)
+{
+	for (size_t i=0; i<length; i++)
+	{
+		uint8_t *cell = &TwoWirePlus_BaseTest_eeprom[((size_t)dst + i) % TWOWIREPLUS_BASETEST_EEPROM_SIZE];
+		if ((*cell != ((const uint8_t *)src)[i]) && (TwoWirePlus_BaseTest_eepromWrites < TwoWirePlus_BaseTest_eepromWriteLimit))
+		{
+			*cell = ((const uint8_t *)src)[i];
+			TwoWirePlus_BaseTest_eepromWrites++;
+		}
+	}
+}
+
+void eeprom_update_byte(uint8_t *address, uint8_t value)
+{
+	eeprom_update_block(&value, address, 1);
+}
+
+void TwoWirePlus_BaseTest_sleepCpu(void)
+{
+	TwoWirePlus_BaseTest_sleepCount++;
+	if (TwoWirePlus_BaseTest_sleepHook != NULL)
+	{
+		TwoWirePlus_BaseTest_sleepHook();
+	}
+}
+
 /*******************| Preinstantiate Objects |*************************/
 Serial_t Serial;
 
@@ -11,6 +11,9 @@
 
 #define _BV(bit) (1 << (bit))
 
+#define cli()		(SREG &= ~0x80)
+#define sei()		(SREG |= 0x80)
+
 #define HEX			0x01
 
 #define SDA			1
@@ -32,10 +35,17 @@ extern uint8_t TWSR;
 extern uint8_t TWBR;
 extern uint8_t TWCR;
 extern uint8_t TWDR;
+extern uint8_t TWAR;
+
+extern uint8_t SREG;
+
+/* Value returned by micros(), to be set by test */
+extern unsigned long TwoWirePlus_BaseTest_micros;
 
 /*******************| Function Definition |****************************/
 
 void digitalWrite(int, uint8_t);
+unsigned long micros(void);
 
 class Serial_t {
 
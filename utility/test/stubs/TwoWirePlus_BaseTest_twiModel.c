@@ -0,0 +1,551 @@
+#include "TwoWirePlus_BaseTest_twiModel.h"
+
+/** \brief TwoWirePlus two wire bus model
+ *
+ * Host side model of the AVR two wire module and the bus including simulated slave
+ * devices. Model is stepped whenever the driver waits for the two wire interface,
+ * i.e. from wait hook. Each step executes the action requested in TWCR and calls
+ * TWI interrupt afterwards if enabled.
+ * A pending command is signaled by TWINT being written as one to TWCR. As soon as the
+ * action was executed TWINT is cleared in TWCR. Commands which don't cause bus activity, e.g.
+ * ACK written while bus is idle, are taken right away, i.e. TWINT is cleared as well.
+ * Model can also be run in a separate thread emulating the two wire hardware. In this
+ * case ISR is called in model thread and driver is notified via pthread condition.
+ * In addition, model can act as two wire master addressing the driver in slave mode. A
+ * competing master can be injected which wins arbitration during the next SLA sent by the
+ * driver.
+ */
+
+/*******************| Inclusions |*************************************/
+#include <stdio.h>
+#include <stdlib.h>
+#include <pthread.h>
+#include <Arduino.h>
+#include "TwoWirePlus_BaseTest_stub.h"
+#include <compat/twi.h>
+
+/*******************| Macros |*****************************************/
+/* Number of consecutive steps without any action after which the model assumes a dead lock */
+#define TWOWIREPLUS_BASETEST_TWIMODEL_MAXIDLE		10000
+
+/*******************| Type definitions |*******************************/
+typedef enum
+{
+	TWOWIREPLUS_BASETEST_TWIMODEL_IDLE,
+	TWOWIREPLUS_BASETEST_TWIMODEL_SLA,
+	TWOWIREPLUS_BASETEST_TWIMODEL_MT,
+	TWOWIREPLUS_BASETEST_TWIMODEL_MT_ADDRESS10,
+	TWOWIREPLUS_BASETEST_TWIMODEL_MT_BROADCAST,
+	TWOWIREPLUS_BASETEST_TWIMODEL_MR,
+	TWOWIREPLUS_BASETEST_TWIMODEL_MT_NACKED,
+	TWOWIREPLUS_BASETEST_TWIMODEL_MR_NACKED
+} TwoWirePlus_BaseTest_twiModelState_t;
+
+/*******************| Global variables |*******************************/
+uint32_t TwoWirePlus_BaseTest_twiModelBitTimes = 0;
+uint32_t TwoWirePlus_BaseTest_twiModelIsrCalls = 0;
+uint32_t TwoWirePlus_BaseTest_twiModelWaitCalls = 0;
+uint32_t TwoWirePlus_BaseTest_twiModelFrequency = 100000;
+
+static TwoWirePlus_BaseTest_Device_t *TwoWirePlus_BaseTest_twiModelDevices[TWOWIREPLUS_BASETEST_TWIMODEL_DEVICES];
+static TwoWirePlus_BaseTest_Device_t *TwoWirePlus_BaseTest_twiModelDevice = NULL;
+static TwoWirePlus_BaseTest_twiModelState_t TwoWirePlus_BaseTest_twiModelState = TWOWIREPLUS_BASETEST_TWIMODEL_IDLE;
+static uint32_t TwoWirePlus_BaseTest_twiModelIdle = 0;
+
+/* 10 bit device addressed by SLA+W until STOP, i.e. still addressed by 11110xx1 after repeated START */
+static TwoWirePlus_BaseTest_Device_t *TwoWirePlus_BaseTest_twiModelDevice10 = NULL;
+static uint8_t TwoWirePlus_BaseTest_twiModelAddress10 = 0;
+
+/* Competing master winning arbitration during next SLA */
+static uint8_t TwoWirePlus_BaseTest_twiModelArbitrationAddress = 0;
+static const uint8_t *TwoWirePlus_BaseTest_twiModelArbitrationData = NULL;
+static uint16_t TwoWirePlus_BaseTest_twiModelArbitrationLength = 0;
+
+uint32_t TwoWirePlus_BaseTest_twiModelThreadNotifications = 0;
+static pthread_t TwoWirePlus_BaseTest_twiModelThread;
+static pthread_t TwoWirePlus_BaseTest_twiModelMainThread;
+static pthread_mutex_t TwoWirePlus_BaseTest_twiModelMutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t TwoWirePlus_BaseTest_twiModelCond = PTHREAD_COND_INITIALIZER;
+static bool TwoWirePlus_BaseTest_twiModelRunning = false;
+static bool TwoWirePlus_BaseTest_twiModelStepRequested = false;
+static bool TwoWirePlus_BaseTest_twiModelNotified = false;
+
+static void TwoWirePlus_BaseTest_twiModelThreadWait(void);
+static void TwoWirePlus_BaseTest_twiModelThreadNotify(void);
+static uint16_t TwoWirePlus_BaseTest_twiModelSlaveWrite(uint8_t status, const uint8_t *data, uint16_t length);
+
+const TwoWirePlus_Waiter_t TwoWirePlus_BaseTest_twiModelWaiter = { TwoWirePlus_BaseTest_twiModelWait, NULL };
+const TwoWirePlus_Waiter_t TwoWirePlus_BaseTest_twiModelThreadWaiter = { TwoWirePlus_BaseTest_twiModelThreadWait, TwoWirePlus_BaseTest_twiModelThreadNotify };
+
+/*******************| Function Definition |****************************/
+void TWI_vect(void);
+
+/**
+ * Removes all devices and resets bus state and statistics
+ */
+void TwoWirePlus_BaseTest_twiModelReset(void)
+{
+	for (int i=0; i<TWOWIREPLUS_BASETEST_TWIMODEL_DEVICES; i++)
+	{
+		TwoWirePlus_BaseTest_twiModelDevices[i] = NULL;
+	}
+	TwoWirePlus_BaseTest_twiModelDevice = NULL;
+	TwoWirePlus_BaseTest_twiModelDevice10 = NULL;
+	TwoWirePlus_BaseTest_twiModelState = TWOWIREPLUS_BASETEST_TWIMODEL_IDLE;
+	TwoWirePlus_BaseTest_twiModelBitTimes = 0;
+	TwoWirePlus_BaseTest_twiModelIsrCalls = 0;
+	TwoWirePlus_BaseTest_twiModelWaitCalls = 0;
+	TwoWirePlus_BaseTest_twiModelIdle = 0;
+	TwoWirePlus_BaseTest_twiModelFrequency = 100000;
+	TwoWirePlus_BaseTest_twiModelArbitrationData = NULL;
+}
+
+/**
+ * Adds a simulated slave device to the bus
+ */
+void TwoWirePlus_BaseTest_twiModelAddDevice(TwoWirePlus_BaseTest_Device_t *device)
+{
+	for (int i=0; i<TWOWIREPLUS_BASETEST_TWIMODEL_DEVICES; i++)
+	{
+		if (TwoWirePlus_BaseTest_twiModelDevices[i] == NULL)
+		{
+			device->pointer = 0;
+			device->pointerSet = false;
+			TwoWirePlus_BaseTest_twiModelDevices[i] = device;
+			return;
+		}
+	}
+}
+
+static TwoWirePlus_BaseTest_Device_t *TwoWirePlus_BaseTest_twiModelFind(uint16_t address)
+{
+	for (int i=0; i<TWOWIREPLUS_BASETEST_TWIMODEL_DEVICES; i++)
+	{
+		if ((TwoWirePlus_BaseTest_twiModelDevices[i] != NULL) && (TwoWirePlus_BaseTest_twiModelDevices[i]->address == address))
+		{
+			return TwoWirePlus_BaseTest_twiModelDevices[i];
+		}
+	}
+	return NULL;
+}
+
+/**
+ * Checks if any 10 bit device matches upper address bits of 11110xx0
+ */
+static bool TwoWirePlus_BaseTest_twiModelMatch10(uint8_t sla)
+{
+	for (int i=0; i<TWOWIREPLUS_BASETEST_TWIMODEL_DEVICES; i++)
+	{
+		TwoWirePlus_BaseTest_Device_t *device = TwoWirePlus_BaseTest_twiModelDevices[i];
+		if ((device != NULL) && (device->address & TWOWIREPLUS_ADDRESS_10BIT_FLAG) && (((device->address >> 7) & 0x06) == (sla & 0x06)))
+		{
+			return true;
+		}
+	}
+	return false;
+}
+
+/**
+ * Writes one byte to device, either to register pointer or to memory
+ */
+static void TwoWirePlus_BaseTest_twiModelWrite(TwoWirePlus_BaseTest_Device_t *device, uint8_t data)
+{
+	if (device->write != NULL)
+	{
+		device->write(data);
+	}
+	else if (!device->pointerSet)
+	{
+		device->pointer = data;
+		device->pointerSet = true;
+	}
+	else
+	{
+		device->memory[device->pointer % device->size] = data;
+		device->pointer++;
+	}
+}
+
+/**
+ * Executes one action requested in TWCR and calls ISR afterwards if TWI interrupt is enabled.
+ * @return true if an action was executed, false if no action was requested
+ */
+bool TwoWirePlus_BaseTest_twiModelStep(void)
+{
+	TwoWirePlus_BaseTest_Device_t *device = TwoWirePlus_BaseTest_twiModelDevice;
+	uint8_t status;
+
+	if (!(TWCR & _BV(TWEN)) || !(TWCR & _BV(TWINT)))
+	{
+		return false;
+	}
+	/* STOP or repeated START end the transfer to current device */
+	if (TWCR & (_BV(TWSTO) | _BV(TWSTA)))
+	{
+		if ((device != NULL) && (device->end != NULL))
+		{
+			device->end();
+		}
+		TwoWirePlus_BaseTest_twiModelDevice = NULL;
+	}
+	/* STOP does not set TWINT, only TWSTO is cleared after STOP was sent. If START was
+	 * requested together with STOP it's executed in next step */
+	if (TWCR & _BV(TWSTO))
+	{
+		TwoWirePlus_BaseTest_twiModelState = TWOWIREPLUS_BASETEST_TWIMODEL_IDLE;
+		TwoWirePlus_BaseTest_twiModelDevice10 = NULL;
+		TwoWirePlus_BaseTest_twiModelBitTimes += 1;
+		TWCR &= (TWCR & _BV(TWSTA)) ? ~_BV(TWSTO) : ~(_BV(TWSTO) | _BV(TWINT));
+		TwoWirePlus_BaseTest_micros = (TwoWirePlus_BaseTest_twiModelBitTimes * 1000000UL) / TwoWirePlus_BaseTest_twiModelFrequency;
+		return true;
+	}
+	if (TWCR & _BV(TWSTA))
+	{
+		status = (TwoWirePlus_BaseTest_twiModelState == TWOWIREPLUS_BASETEST_TWIMODEL_IDLE) ? TW_START : TW_REP_START;
+		TwoWirePlus_BaseTest_twiModelState = TWOWIREPLUS_BASETEST_TWIMODEL_SLA;
+		TwoWirePlus_BaseTest_twiModelBitTimes += 1;
+	}
+	else
+	{
+		switch (TwoWirePlus_BaseTest_twiModelState)
+		{
+			case TWOWIREPLUS_BASETEST_TWIMODEL_SLA:
+				if (TwoWirePlus_BaseTest_twiModelArbitrationData != NULL)
+				{
+					/* Competing master wins. Bus is idle again after its STOP */
+					const uint8_t *data = TwoWirePlus_BaseTest_twiModelArbitrationData;
+					TwoWirePlus_BaseTest_twiModelArbitrationData = NULL;
+					TwoWirePlus_BaseTest_twiModelState = TWOWIREPLUS_BASETEST_TWIMODEL_IDLE;
+					TWCR &= ~_BV(TWINT);
+					if (TwoWirePlus_BaseTest_twiModelArbitrationAddress == (TWAR >> 1))
+					{
+						TwoWirePlus_BaseTest_twiModelSlaveWrite(TW_SR_ARB_LOST_SLA_ACK, data, TwoWirePlus_BaseTest_twiModelArbitrationLength);
+						return true;
+					}
+					/* Addressed another device */
+					TwoWirePlus_BaseTest_twiModelBitTimes += 9 * TwoWirePlus_BaseTest_twiModelArbitrationLength + 1;
+					status = TW_MT_ARB_LOST;
+					break;
+				}
+				if (TWDR == (TW_WRITE | (TWOWIREPLUS_ADDRESS_GENERALCALL << 1)))
+				{
+					/* General call is ACKed if any device accepts it */
+					bool ack = false;
+					for (int i=0; i<TWOWIREPLUS_BASETEST_TWIMODEL_DEVICES; i++)
+					{
+						if ((TwoWirePlus_BaseTest_twiModelDevices[i] != NULL) && TwoWirePlus_BaseTest_twiModelDevices[i]->generalCall)
+						{
+							TwoWirePlus_BaseTest_twiModelDevices[i]->pointerSet = false;
+							ack = true;
+						}
+					}
+					status = ack ? TW_MT_SLA_ACK : TW_MT_SLA_NACK;
+					TwoWirePlus_BaseTest_twiModelState = ack ? TWOWIREPLUS_BASETEST_TWIMODEL_MT_BROADCAST : TWOWIREPLUS_BASETEST_TWIMODEL_MT_NACKED;
+					break;
+				}
+				if ((TWDR & 0xf9) == 0xf0)
+				{
+					/* First byte of 10 bit address, device is selected by second byte */
+					TwoWirePlus_BaseTest_twiModelAddress10 = TWDR & 0x06;
+					status = TwoWirePlus_BaseTest_twiModelMatch10(TWDR) ? TW_MT_SLA_ACK : TW_MT_SLA_NACK;
+					TwoWirePlus_BaseTest_twiModelState = (status == TW_MT_SLA_ACK) ? TWOWIREPLUS_BASETEST_TWIMODEL_MT_ADDRESS10 : TWOWIREPLUS_BASETEST_TWIMODEL_MT_NACKED;
+					break;
+				}
+				if ((TWDR & 0xf9) == 0xf1)
+				{
+					/* Only 10 bit device addressed before repeated START responds */
+					device = ((TwoWirePlus_BaseTest_twiModelDevice10 != NULL) && (((TwoWirePlus_BaseTest_twiModelDevice10->address >> 7) & 0x06) == (TWDR & 0x06))) ? TwoWirePlus_BaseTest_twiModelDevice10 : NULL;
+				}
+				else
+				{
+					device = TwoWirePlus_BaseTest_twiModelFind(TWDR >> 1);
+				}
+				TwoWirePlus_BaseTest_twiModelDevice = device;
+				if (TWDR & TW_READ)
+				{
+					status = (device != NULL) ? TW_MR_SLA_ACK : TW_MR_SLA_NACK;
+					TwoWirePlus_BaseTest_twiModelState = (device != NULL) ? TWOWIREPLUS_BASETEST_TWIMODEL_MR : TWOWIREPLUS_BASETEST_TWIMODEL_MR_NACKED;
+				}
+				else
+				{
+					status = (device != NULL) ? TW_MT_SLA_ACK : TW_MT_SLA_NACK;
+					TwoWirePlus_BaseTest_twiModelState = (device != NULL) ? TWOWIREPLUS_BASETEST_TWIMODEL_MT : TWOWIREPLUS_BASETEST_TWIMODEL_MT_NACKED;
+					if (device != NULL)
+					{
+						device->pointerSet = false;
+					}
+				}
+				break;
+			case TWOWIREPLUS_BASETEST_TWIMODEL_MT:
+				TwoWirePlus_BaseTest_twiModelWrite(device, TWDR);
+				status = TW_MT_DATA_ACK;
+				break;
+			case TWOWIREPLUS_BASETEST_TWIMODEL_MT_ADDRESS10:
+				device = TwoWirePlus_BaseTest_twiModelFind(TWOWIREPLUS_ADDRESS_10BIT(((uint16_t)TwoWirePlus_BaseTest_twiModelAddress10 << 7) | TWDR));
+				TwoWirePlus_BaseTest_twiModelDevice = device;
+				TwoWirePlus_BaseTest_twiModelDevice10 = device;
+				if (device != NULL)
+				{
+					device->pointerSet = false;
+				}
+				status = (device != NULL) ? TW_MT_DATA_ACK : TW_MT_DATA_NACK;
+				TwoWirePlus_BaseTest_twiModelState = (device != NULL) ? TWOWIREPLUS_BASETEST_TWIMODEL_MT : TWOWIREPLUS_BASETEST_TWIMODEL_MT_NACKED;
+				break;
+			case TWOWIREPLUS_BASETEST_TWIMODEL_MT_BROADCAST:
+				for (int i=0; i<TWOWIREPLUS_BASETEST_TWIMODEL_DEVICES; i++)
+				{
+					if ((TwoWirePlus_BaseTest_twiModelDevices[i] != NULL) && TwoWirePlus_BaseTest_twiModelDevices[i]->generalCall)
+					{
+						TwoWirePlus_BaseTest_twiModelWrite(TwoWirePlus_BaseTest_twiModelDevices[i], TWDR);
+					}
+				}
+				status = TW_MT_DATA_ACK;
+				break;
+			case TWOWIREPLUS_BASETEST_TWIMODEL_MT_NACKED:
+				status = TW_MT_DATA_NACK;
+				break;
+			case TWOWIREPLUS_BASETEST_TWIMODEL_MR:
+				if (device->read != NULL)
+				{
+					TWDR = device->read();
+				}
+				else
+				{
+					TWDR = device->memory[device->pointer % device->size];
+					device->pointer++;
+				}
+				if (TWCR & _BV(TWEA))
+				{
+					status = TW_MR_DATA_ACK;
+				}
+				else
+				{
+					status = TW_MR_DATA_NACK;
+					TwoWirePlus_BaseTest_twiModelState = TWOWIREPLUS_BASETEST_TWIMODEL_MR_NACKED;
+				}
+				break;
+			default:
+				/* Nothing happens on the bus without START, command was taken */
+				TWCR &= ~_BV(TWINT);
+				return false;
+		}
+		TwoWirePlus_BaseTest_twiModelBitTimes += 9;
+	}
+	TWSR = status;
+	TWCR &= ~_BV(TWINT);
+	TwoWirePlus_BaseTest_micros = (TwoWirePlus_BaseTest_twiModelBitTimes * 1000000UL) / TwoWirePlus_BaseTest_twiModelFrequency;
+	if (TWCR & _BV(TWIE))
+	{
+		TwoWirePlus_BaseTest_twiModelIsrCalls++;
+		TWI_vect();
+	}
+	return true;
+}
+
+/**
+ * Wait hook to be used by driver. Executes one step of the model. In case the driver waits
+ * but nothing happens on the bus anymore test is aborted.
+ */
+void TwoWirePlus_BaseTest_twiModelWait(void)
+{
+	sei();
+	TwoWirePlus_BaseTest_twiModelWaitCalls++;
+	if (TwoWirePlus_BaseTest_twiModelStep())
+	{
+		TwoWirePlus_BaseTest_twiModelIdle = 0;
+	}
+	else if (++TwoWirePlus_BaseTest_twiModelIdle > TWOWIREPLUS_BASETEST_TWIMODEL_MAXIDLE)
+	{
+		printf("\nTWI model: driver waits but bus is idle (TWCR 0x%02x, TWSR 0x%02x)\n", TWCR, TWSR);
+		exit(1);
+	}
+}
+
+/**
+ * Model thread emulating two wire hardware. Executes one step whenever driver waits. If no
+ * ISR was called during step, e.g. for STOP, model thread notifies driver itself.
+ */
+static void *TwoWirePlus_BaseTest_twiModelThreadMain(void *arg)
+{
+	(void)arg;
+	pthread_mutex_lock(&TwoWirePlus_BaseTest_twiModelMutex);
+	while (TwoWirePlus_BaseTest_twiModelRunning)
+	{
+		if (!TwoWirePlus_BaseTest_twiModelStepRequested)
+		{
+			pthread_cond_wait(&TwoWirePlus_BaseTest_twiModelCond, &TwoWirePlus_BaseTest_twiModelMutex);
+			continue;
+		}
+		TwoWirePlus_BaseTest_twiModelStepRequested = false;
+		pthread_mutex_unlock(&TwoWirePlus_BaseTest_twiModelMutex);
+		uint32_t isrCalls = TwoWirePlus_BaseTest_twiModelIsrCalls;
+		TwoWirePlus_BaseTest_twiModelStep();
+		pthread_mutex_lock(&TwoWirePlus_BaseTest_twiModelMutex);
+		if (isrCalls == TwoWirePlus_BaseTest_twiModelIsrCalls)
+		{
+			TwoWirePlus_BaseTest_twiModelNotified = true;
+			pthread_cond_broadcast(&TwoWirePlus_BaseTest_twiModelCond);
+		}
+	}
+	pthread_mutex_unlock(&TwoWirePlus_BaseTest_twiModelMutex);
+	return NULL;
+}
+
+/**
+ * Starts model thread. Use #TwoWirePlus_BaseTest_twiModelThreadWaiter as driver waiter afterwards.
+ */
+void TwoWirePlus_BaseTest_twiModelThreadStart(void)
+{
+	TwoWirePlus_BaseTest_twiModelMainThread = pthread_self();
+	TwoWirePlus_BaseTest_twiModelThreadNotifications = 0;
+	TwoWirePlus_BaseTest_twiModelRunning = true;
+	TwoWirePlus_BaseTest_twiModelStepRequested = false;
+	TwoWirePlus_BaseTest_twiModelNotified = false;
+	pthread_create(&TwoWirePlus_BaseTest_twiModelThread, NULL, TwoWirePlus_BaseTest_twiModelThreadMain, NULL);
+}
+
+/**
+ * Stops model thread
+ */
+void TwoWirePlus_BaseTest_twiModelThreadStop(void)
+{
+	pthread_mutex_lock(&TwoWirePlus_BaseTest_twiModelMutex);
+	TwoWirePlus_BaseTest_twiModelRunning = false;
+	pthread_cond_broadcast(&TwoWirePlus_BaseTest_twiModelCond);
+	pthread_mutex_unlock(&TwoWirePlus_BaseTest_twiModelMutex);
+	pthread_join(TwoWirePlus_BaseTest_twiModelThread, NULL);
+}
+
+/**
+ * Wait function: requests one step from model thread and blocks until notified
+ */
+static void TwoWirePlus_BaseTest_twiModelThreadWait(void)
+{
+	sei();
+	TwoWirePlus_BaseTest_twiModelWaitCalls++;
+	pthread_mutex_lock(&TwoWirePlus_BaseTest_twiModelMutex);
+	TwoWirePlus_BaseTest_twiModelNotified = false;
+	TwoWirePlus_BaseTest_twiModelStepRequested = true;
+	pthread_cond_broadcast(&TwoWirePlus_BaseTest_twiModelCond);
+	while (!TwoWirePlus_BaseTest_twiModelNotified)
+	{
+		pthread_cond_wait(&TwoWirePlus_BaseTest_twiModelCond, &TwoWirePlus_BaseTest_twiModelMutex);
+	}
+	pthread_mutex_unlock(&TwoWirePlus_BaseTest_twiModelMutex);
+}
+
+/**
+ * Notify function: called by ISR running in model thread
+ */
+static void TwoWirePlus_BaseTest_twiModelThreadNotify(void)
+{
+	pthread_mutex_lock(&TwoWirePlus_BaseTest_twiModelMutex);
+	if (!pthread_equal(pthread_self(), TwoWirePlus_BaseTest_twiModelMainThread))
+	{
+		TwoWirePlus_BaseTest_twiModelThreadNotifications++;
+	}
+	TwoWirePlus_BaseTest_twiModelNotified = true;
+	pthread_cond_broadcast(&TwoWirePlus_BaseTest_twiModelCond);
+	pthread_mutex_unlock(&TwoWirePlus_BaseTest_twiModelMutex);
+}
+
+/**
+ * Calls ISR with given status as if two wire hardware set TWINT
+ */
+static void TwoWirePlus_BaseTest_twiModelSlaveEvent(uint8_t status, uint8_t bitTimes)
+{
+	TwoWirePlus_BaseTest_twiModelBitTimes += bitTimes;
+	TwoWirePlus_BaseTest_micros = (TwoWirePlus_BaseTest_twiModelBitTimes * 1000000UL) / TwoWirePlus_BaseTest_twiModelFrequency;
+	TWSR = status;
+	TwoWirePlus_BaseTest_twiModelIsrCalls++;
+	TWI_vect();
+	/* Slave transfer is driven by model, only START is executed by next step */
+	if (!(TWCR & (_BV(TWSTA) | _BV(TWSTO))))
+	{
+		TWCR &= ~_BV(TWINT);
+	}
+}
+
+/**
+ * Model acts as two wire master and writes #data to driver in slave mode. Transfer ends with
+ * STOP.
+ * @return Number of data bytes ACKed by driver or zero if address was not ACKed
+ */
+uint16_t TwoWirePlus_BaseTest_twiModelMasterWrite(uint8_t address, const uint8_t *data, uint16_t length)
+{
+	/* START and SLA+W */
+	if (!(TWCR & _BV(TWEN)) || !(TWCR & _BV(TWEA)) || ((TWAR >> 1) != address))
+	{
+		TwoWirePlus_BaseTest_twiModelBitTimes += 11;
+		return 0;
+	}
+	return TwoWirePlus_BaseTest_twiModelSlaveWrite(TW_SR_SLA_ACK, data, length);
+}
+
+/**
+ * Injects a competing master which wins arbitration during the next SLA sent by the driver
+ * and writes #data to #address. If #address is the own address of the driver, driver is
+ * addressed as slave, otherwise driver sees arbitration lost.
+ * @note #data must stay valid until arbitration took place
+ */
+void TwoWirePlus_BaseTest_twiModelLoseArbitration(uint8_t address, const uint8_t *data, uint16_t length)
+{
+	TwoWirePlus_BaseTest_twiModelArbitrationAddress = address;
+	TwoWirePlus_BaseTest_twiModelArbitrationData = data;
+	TwoWirePlus_BaseTest_twiModelArbitrationLength = length;
+}
+
+/**
+ * Writes #data to driver addressed as slave receiver. SLA was reported with #status.
+ * @return Number of data bytes ACKed by driver
+ */
+static uint16_t TwoWirePlus_BaseTest_twiModelSlaveWrite(uint8_t status, const uint8_t *data, uint16_t length)
+{
+	uint16_t i;
+	TwoWirePlus_BaseTest_twiModelSlaveEvent(status, 10);
+	for (i=0; i<length; i++)
+	{
+		TWDR = data[i];
+		if (!(TWCR & _BV(TWEA)))
+		{
+			TwoWirePlus_BaseTest_twiModelSlaveEvent(TW_SR_DATA_NACK, 9);
+			break;
+		}
+		TwoWirePlus_BaseTest_twiModelSlaveEvent(TW_SR_DATA_ACK, 9);
+	}
+	if (i == length)
+	{
+		TwoWirePlus_BaseTest_twiModelSlaveEvent(TW_SR_STOP, 1);
+	}
+	else
+	{
+		TwoWirePlus_BaseTest_twiModelBitTimes += 1;
+	}
+	return i;
+}
+
+/**
+ * Model acts as two wire master and reads #length bytes from driver in slave mode. Last byte
+ * is NACKed and transfer ends with STOP.
+ * @return Number of bytes read or zero if address was not ACKed
+ */
+uint16_t TwoWirePlus_BaseTest_twiModelMasterRead(uint8_t address, uint8_t *data, uint16_t length)
+{
+	uint16_t i;
+	/* START and SLA+R */
+	if (!(TWCR & _BV(TWEN)) || !(TWCR & _BV(TWEA)) || ((TWAR >> 1) != address) || (length == 0))
+	{
+		TwoWirePlus_BaseTest_twiModelBitTimes += 11;
+		return 0;
+	}
+	TwoWirePlus_BaseTest_twiModelSlaveEvent(TW_ST_SLA_ACK, 10);
+	for (i=0; i<length; i++)
+	{
+		data[i] = TWDR;
+		TwoWirePlus_BaseTest_twiModelSlaveEvent((i == (length - 1)) ? TW_ST_DATA_NACK : TW_ST_DATA_ACK, 9);
+	}
+	TwoWirePlus_BaseTest_twiModelBitTimes += 1;
+	return i;
+}
+
+/*******************| Preinstantiate Objects |*************************/
@@ -0,0 +1,67 @@
+#ifndef  TWOWIREPLUS_BASETEST_TWIMODEL_H
+#define  TWOWIREPLUS_BASETEST_TWIMODEL_H
+
+/*******************| Inclusions |*************************************/
+#include <stdint.h>
+#include <stdbool.h>
+#include "TwoWirePlus.h"
+
+/*******************| Macros |*****************************************/
+/* Maximum number of simulated slave devices on the bus */
+#define TWOWIREPLUS_BASETEST_TWIMODEL_DEVICES		8
+
+/* Number of CPU cycles assumed for one ISR invocation (incl. prologue/epilogue) */
+#define TWOWIREPLUS_BASETEST_TWIMODEL_ISRCYCLES		80
+
+/*******************| Type definitions |*******************************/
+
+/**
+ * Simulated two wire slave device with register file. First byte written after SLA+W
+ * sets the register pointer, all following bytes are written to memory. Reads return
+ * memory content. Register pointer is incremented after each data byte.
+ * If #write is set, device behavior is implemented by the callbacks instead.
+ * 10 bit devices use TWOWIREPLUS_ADDRESS_10BIT(address) as #address.
+ */
+typedef struct
+{
+	uint16_t address;		/*!< 7 bit or 10 bit slave address */
+	uint8_t *memory;		/*!< Register file of device */
+	uint16_t size;			/*!< Size of register file */
+	uint16_t pointer;		/*!< Current register pointer */
+	bool pointerSet;		/*!< Register pointer was already set in this transfer */
+	void (*write)(uint8_t data);	/*!< Optional: Called for each byte written to device */
+	uint8_t (*read)(void);		/*!< Optional: Called for each byte read from device */
+	void (*end)(void);		/*!< Optional: Called at STOP or repeated START ending a transfer to device */
+	bool generalCall;		/*!< Device accepts writes to general call address */
+} TwoWirePlus_BaseTest_Device_t;
+
+/*******************| Global variables |*******************************/
+/* Number of bit times the bus was busy */
+extern uint32_t TwoWirePlus_BaseTest_twiModelBitTimes;
+/* Number of times ISR was called by model */
+extern uint32_t TwoWirePlus_BaseTest_twiModelIsrCalls;
+/* Number of times driver waited for two wire interface */
+extern uint32_t TwoWirePlus_BaseTest_twiModelWaitCalls;
+/* SCL frequency used to convert bit times to micros */
+extern uint32_t TwoWirePlus_BaseTest_twiModelFrequency;
+/* Waiter stepping the model in the calling thread */
+extern const TwoWirePlus_Waiter_t TwoWirePlus_BaseTest_twiModelWaiter;
+/* Waiter handing over to model thread and waiting on a pthread condition for notification */
+extern const TwoWirePlus_Waiter_t TwoWirePlus_BaseTest_twiModelThreadWaiter;
+/* Number of notifications received from ISR running in model thread */
+extern uint32_t TwoWirePlus_BaseTest_twiModelThreadNotifications;
+
+/*******************| Function Definition |****************************/
+void TwoWirePlus_BaseTest_twiModelReset(void);
+void TwoWirePlus_BaseTest_twiModelAddDevice(TwoWirePlus_BaseTest_Device_t *device);
+bool TwoWirePlus_BaseTest_twiModelStep(void);
+void TwoWirePlus_BaseTest_twiModelWait(void);
+void TwoWirePlus_BaseTest_twiModelThreadStart(void);
+void TwoWirePlus_BaseTest_twiModelThreadStop(void);
+uint16_t TwoWirePlus_BaseTest_twiModelMasterWrite(uint8_t address, const uint8_t *data, uint16_t length);
+void TwoWirePlus_BaseTest_twiModelLoseArbitration(uint8_t address, const uint8_t *data, uint16_t length);
+uint16_t TwoWirePlus_BaseTest_twiModelMasterRead(uint8_t address, uint8_t *data, uint16_t length);
+
+/*******************| Preinstantiate Objects |*************************/
+
+#endif
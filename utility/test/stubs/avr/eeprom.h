@@ -0,0 +1,30 @@
+#ifndef  TWOWIREPLUS_EEPROM_H
+#define  TWOWIREPLUS_EEPROM_H
+
+/*******************| Inclusions |*************************************/
+#include <stdint.h>
+#include <stddef.h>
+
+/*******************| Macros |*****************************************/
+/* Size of internal EEPROM of ATmega328P */
+#define TWOWIREPLUS_BASETEST_EEPROM_SIZE	1024
+
+/*******************| Type definitions |*******************************/
+
+/*******************| Global variables |*******************************/
+/* EEPROM content, erased EEPROM reads 0xff */
+extern uint8_t TwoWirePlus_BaseTest_eeprom[TWOWIREPLUS_BASETEST_EEPROM_SIZE];
+/* Number of bytes actually written, i.e. cell wear */
+extern uint32_t TwoWirePlus_BaseTest_eepromWrites;
+/* Cells are not written anymore once #TwoWirePlus_BaseTest_eepromWrites reached limit, i.e. power loss */
+extern uint32_t TwoWirePlus_BaseTest_eepromWriteLimit;
+
+/*******************| Function Definition |****************************/
+uint8_t eeprom_read_byte(const uint8_t *address);
+void eeprom_read_block(void *dst, const void *src, size_t length);
+void eeprom_update_block(const void *src, void *dst, size_t length);
+void eeprom_update_byte(uint8_t *address, uint8_t value);
+
+/*******************| Preinstantiate Objects |*************************/
+
+#endif
@@ -0,0 +1,28 @@
+#ifndef  TWOWIREPLUS_PGMSPACE_H
+#define  TWOWIREPLUS_PGMSPACE_H
+
+/*******************| Inclusions |*************************************/
+#include <stdint.h>
+
+/*******************| Macros |*****************************************/
+/* Flash and RAM share one address space on host, byte reads are counted */
+#define PROGMEM
+#define pgm_read_byte(address)	TwoWirePlus_BaseTest_pgmReadByte(address)
+#define pgm_read_word(address)	(*(const uint16_t *)(address))
+
+/*******************| Type definitions |*******************************/
+
+/*******************| Global variables |*******************************/
+/* Number of bytes read by pgm_read_byte, i.e. interpreter work of micro-sequencer */
+extern uint32_t TwoWirePlus_BaseTest_flashReads;
+
+/*******************| Function Definition |****************************/
+static inline uint8_t TwoWirePlus_BaseTest_pgmReadByte(const void *address)
+{
+	TwoWirePlus_BaseTest_flashReads++;
+	return *(const uint8_t *)address;
+}
+
+/*******************| Preinstantiate Objects |*************************/
+
+#endif
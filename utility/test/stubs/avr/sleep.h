@@ -0,0 +1,30 @@
+#ifndef  TWOWIREPLUS_SLEEP_H
+#define  TWOWIREPLUS_SLEEP_H
+
+/*******************| Inclusions |*************************************/
+#include <stdint.h>
+
+/*******************| Macros |*****************************************/
+#define SLEEP_MODE_IDLE			0x00
+#define SLEEP_MODE_PWR_DOWN		0x02
+
+#define set_sleep_mode(mode)	(TwoWirePlus_BaseTest_sleepMode = (mode))
+#define sleep_enable()			(TwoWirePlus_BaseTest_sleepEnabled = 1)
+#define sleep_disable()			(TwoWirePlus_BaseTest_sleepEnabled = 0)
+#define sleep_cpu()				TwoWirePlus_BaseTest_sleepCpu()
+
+/*******************| Type definitions |*******************************/
+
+/*******************| Global variables |*******************************/
+extern uint8_t TwoWirePlus_BaseTest_sleepMode;
+extern uint8_t TwoWirePlus_BaseTest_sleepEnabled;
+extern uint32_t TwoWirePlus_BaseTest_sleepCount;
+/* Called whenever CPU is put to sleep, e.g. to emulate an interrupt. May be NULL */
+extern void (*TwoWirePlus_BaseTest_sleepHook)(void);
+
+/*******************| Function Definition |****************************/
+void TwoWirePlus_BaseTest_sleepCpu(void);
+
+/*******************| Preinstantiate Objects |*************************/
+
+#endif
@@ -134,6 +134,10 @@
  * stop or repeated start condition received while selected */
 #define TW_SR_STOP		0xA0
 
+/**
+ * illegal start or stop condition */
+#define TW_BUS_ERROR		0x00
+
 /*******************| Type definitions |*******************************/
 
 /*******************| Global variables |*******************************/